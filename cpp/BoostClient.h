@@ -1,88 +1,501 @@
 #ifndef BOOSTCLIENT_H_
 #define BOOSTCLIENT_H_
 
+#include <algorithm>
 #include <iostream>
+#include <stdlib.h>
+#include <time.h>
 #include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
 #include <boost/system/error_code.hpp>
+#include <boost/thread.hpp>
 #include <sstream>
 
+#include "IoServicePool.h"
+#include "SendQueue.h"
+#include "probes.h"
+
+// Reconnect delays, doubling after each failed attempt
+#define RECONNECT_MIN_DELAY 0.1
+#define RECONNECT_MAX_DELAY 30.0
+
+// Resolve the address again after this many failed attempts
+#define RECONNECT_RESOLVE_INTERVAL 8
+
+// Give up on a connect attempt after this many seconds, unless
+// a timeout is given
+#define CONNECT_DEFAULT_TIMEOUT 5.0
+
 using boost::asio::ip::tcp;
 
-class client
+/*
+ * Data is written asynchronously from an I/O thread so
+ * that a rate limit can pace the output without blocking
+ * the caller.  The connection is established on the same
+ * thread, and re-established with exponential backoff when
+ * it is lost, so the caller never waits on a resolve or
+ * connect.  Each connect attempt is abandoned after a
+ * timeout so an unreachable peer can't hold it up.
+ *
+ * Every client runs on one of the few threads of the
+ * shared client pool.  A client is made with create, and
+ * closed once the last pointer create returned, or a copy
+ * of it, is released; its pending handlers keep it alive
+ * until they have finished
+ */
+class client : public boost::enable_shared_from_this<client>
 {
 public:
-	client(unsigned short port, std::string ip_addr) :
-		s_(io_service_),
-		port_(port),
-		ip_addr_(ip_addr)
-	{}
+	static boost::shared_ptr<client> create(unsigned short port, std::string ip_addr)
+	{
+		boost::shared_ptr<client> self(new client(port, ip_addr));
+		return boost::shared_ptr<client>(self.get(), closer(self));
+	}
 
-	bool connect()
+	/*
+	 * Start connecting in the background and return at
+	 * once.  Until the first attempt finishes the client
+	 * is connecting, and if it fails it keeps trying
+	 */
+	void connect(double timeout)
 	{
-		try
-		{
-			tcp::resolver resolver(io_service_);
-			std::stringstream ss;
-			ss<<port_;
-			tcp::resolver::query query(ip_addr_, ss.str());
-			tcp::resolver::iterator iter = resolver.resolve(query);
-			s_.connect(*iter);
-			return is_connected();
-		}
-		catch (...)
-		{
-			s_.close();
-			return false;
-		}
+		boost::mutex::scoped_lock lock(socketLock_);
+
+		connectTimeout_ = timeout;
+
+		if (state_ != DISCONNECTED)
+			return;
+
+		state_ = CONNECTING;
+		io_service_.post(boost::bind(&client::handle_reconnect, shared_from_this(),
+				boost::system::error_code()));
 	}
 
+	/*
+	 * Never blocks: start reconnecting in the background
+	 * if nothing is already trying to
+	 */
 	bool connect_if_necessary()
 	{
-		if (is_connected())
-			return true;
-		return connect();
+		boost::mutex::scoped_lock lock(socketLock_);
+
+		if (state_ == DISCONNECTED)
+			schedule_reconnect();
+
+		return state_ == CONNECTED;
 	}
 
 	bool is_connected()
 	{
-		return s_.is_open();
+		boost::mutex::scoped_lock lock(socketLock_);
+		return state_ == CONNECTED;
+	}
+
+	// True until the first connect attempt has finished
+	bool is_connecting()
+	{
+		boost::mutex::scoped_lock lock(socketLock_);
+		return state_ == CONNECTING;
+	}
+
+	void setConnectTimeout(double timeout)
+	{
+		boost::mutex::scoped_lock lock(socketLock_);
+		connectTimeout_ = timeout;
 	}
 
 	template<typename T, typename U>
 	void write(std::vector<T, U>& data)
 	{
-		if (connect_if_necessary())
+		write(makeSharedBuffer(data));
+	}
+
+	void write(const SharedBuffer& buffer)
+	{
+		boost::mutex::scoped_lock lock(socketLock_);
+		bool holding = writeQueue_.holding();
+
+		if (state_ == CONNECTED && writeQueue_.push(buffer))
 		{
-			size_t bytesWritten=0;
-			boost::system::error_code ec;
-			char* dataBytes = reinterpret_cast<char*>(&data[0]);
-			size_t numBytes = data.size()*sizeof(T);
-			while (bytesWritten!= numBytes)
+			SINK_PROBE3(enqueue, buffer->size(), port_, writeQueue_.queuedBytes());
+
+			// Enough has built up, so stop waiting on the deadline
+			if (holding)
 			{
-				bytesWritten+= boost::asio::write(s_, boost::asio::buffer(&dataBytes[bytesWritten], numBytes-bytesWritten),boost::asio::transfer_all(), ec);
-				if (ec)
-				{
-					s_.close();
-					break;
-				}
+				++pacingGeneration_;
+				pacingTimer_.cancel();
 			}
+
+			start_write();
 		}
 	}
+
 	template<typename T>
 	void read(std::vector<char, T> & data, size_t index=0)
 	{
 		int bytesReceived=0;
-		if (connect_if_necessary() && s_.available()!=0)
+		if (connect_if_necessary())
 		{
-			bytesReceived = s_.read_some(boost::asio::buffer(&data[index], data.size()-index));
+			boost::mutex::scoped_lock lock(socketLock_);
+			boost::system::error_code ec;
+			if (state_ == CONNECTED && s_.available(ec)!=0)
+			{
+				bytesReceived = s_.read_some(boost::asio::buffer(&data[index], data.size()-index), ec);
+			}
 		}
 		data.resize(index+bytesReceived);
 	}
+
+	// The total time writes have waited on the rate limit
+	double pacingDelay()
+	{
+		boost::mutex::scoped_lock lock(socketLock_);
+		return writeQueue_.pacingDelay();
+	}
+
+	void setRateLimit(double bytesPerSecond, size_t burstSize)
+	{
+		boost::mutex::scoped_lock lock(socketLock_);
+		writeQueue_.setRateLimit(bytesPerSecond, burstSize);
+	}
+
+	void setCoalescing(size_t bytes, double maxDelay)
+	{
+		boost::mutex::scoped_lock lock(socketLock_);
+		writeQueue_.setCoalescing(bytes, maxDelay);
+	}
+
+	// The number of bytes waiting to be written
+	size_t queuedBytes()
+	{
+		boost::mutex::scoped_lock lock(socketLock_);
+		return writeQueue_.queuedBytes();
+	}
+
+	void setMemoryBudget(const boost::shared_ptr<MemoryBudget>& budget)
+	{
+		boost::mutex::scoped_lock lock(socketLock_);
+		writeQueue_.setBudget(budget);
+	}
+
+	// Drop the data waiting to be written, returning how much
+	size_t shed()
+	{
+		boost::mutex::scoped_lock lock(socketLock_);
+		return writeQueue_.shed();
+	}
+
+	// Pin the I/O thread, which is shared with other clients
+	bool setAffinity(const std::string& cpus)
+	{
+		return thread_->setAffinity(cpus);
+	}
+
+	std::string placement()
+	{
+		return thread_->placement();
+	}
+
 private:
-	boost::asio::io_service io_service_;
+	client(unsigned short port, std::string ip_addr) :
+		thread_(IoServicePool::clients().next()),
+		io_service_(thread_->service()),
+		s_(io_service_),
+		connectTimer_(io_service_),
+		pacingTimer_(io_service_),
+		pacingGeneration_(0),
+		reconnectTimer_(io_service_),
+		resolver_(io_service_),
+		closed_(false),
+		connectTimeout_(CONNECT_DEFAULT_TIMEOUT),
+		failures_(0),
+		port_(port),
+		ip_addr_(ip_addr),
+		seed_(time(NULL) ^ port),
+		state_(DISCONNECTED)
+	{
+	}
+
+	// Closes the client when the pointers handed out by create
+	// are released
+	struct closer
+	{
+		closer(const boost::shared_ptr<client>& self) :
+			self_(self)
+		{
+		}
+
+		void operator()(client*)
+		{
+			self_->close();
+			self_.reset();
+		}
+
+		boost::shared_ptr<client> self_;
+	};
+
+	/*
+	 * Stop connecting and writing.  The socket and timers are
+	 * closed on the I/O thread, which makes their pending
+	 * handlers finish
+	 */
+	void close()
+	{
+		boost::mutex::scoped_lock lock(socketLock_);
+		closed_ = true;
+		io_service_.post(boost::bind(&client::handle_close, shared_from_this()));
+	}
+
+	void handle_close()
+	{
+		boost::mutex::scoped_lock lock(socketLock_);
+		boost::system::error_code ec;
+
+		connectTimer_.cancel(ec);
+		pacingTimer_.cancel(ec);
+		reconnectTimer_.cancel(ec);
+		resolver_.cancel();
+		s_.close(ec);
+		writeQueue_.clear();
+	}
+
+	enum State {
+		DISCONNECTED,
+		CONNECTING,
+		RECONNECTING,
+		CONNECTED
+	};
+
+	tcp::resolver::query query()
+	{
+		std::stringstream ss;
+		ss<<port_;
+		return tcp::resolver::query(ip_addr_, ss.str());
+	}
+
+	//must be called with the socketLock_ held
+	void start_write()
+	{
+		double delay;
+
+		if (!writeQueue_.next(gather_, delay))
+		{
+			return;
+		}
+
+		// Wait for the rate limit or the coalescing deadline before
+		// writing the next chunks
+		if (delay > 0)
+		{
+			pacingTimer_.expires_from_now(boost::posix_time::microseconds(long(delay*1e6)+1));
+			pacingTimer_.async_wait(boost::bind(&client::handle_pace, shared_from_this(),
+					boost::asio::placeholders::error, pacingGeneration_));
+		}
+		else
+		{
+			boost::asio::async_write(s_,
+					gather_,
+					boost::bind(&client::handle_write, shared_from_this(),
+							boost::asio::placeholders::error,
+							boost::asio::placeholders::bytes_transferred));
+		}
+	}
+
+	// A wait that was abandoned may still complete, so only the
+	// latest one starts a write
+	void handle_pace(const boost::system::error_code& error, unsigned int generation)
+	{
+		if (!error)
+		{
+			boost::mutex::scoped_lock lock(socketLock_);
+
+			if (!closed_ && generation == pacingGeneration_)
+			{
+				start_write();
+			}
+		}
+	}
+
+	void handle_write(const boost::system::error_code& error,
+			size_t bytes_transferred)
+	{
+		boost::mutex::scoped_lock lock(socketLock_);
+
+		SINK_PROBE3(write_done, bytes_transferred, port_, error.value());
+
+		if (closed_)
+		{
+			return;
+		}
+
+		if (error)
+		{
+			SINK_PROBE2(disconnect, port_, error.value());
+
+			// Drop the queued data and reconnect in the background
+			boost::system::error_code ec;
+			s_.close(ec);
+			writeQueue_.clear();
+
+			if (state_ == CONNECTED)
+			{
+				schedule_reconnect();
+			}
+		}
+		else if (writeQueue_.consume(bytes_transferred))
+		{
+			start_write();
+		}
+	}
+
+	/*
+	 * Wait before the next attempt.  The delay doubles with
+	 * each failure and is randomized so many clients that lost
+	 * the same server don't all retry at once.  Must be called
+	 * with the socketLock_ held
+	 */
+	void schedule_reconnect()
+	{
+		double delay = std::min(RECONNECT_MAX_DELAY, RECONNECT_MIN_DELAY * (1 << std::min(failures_, 16u)));
+		delay *= 0.5 + 0.5 * rand_r(&seed_) / RAND_MAX;
+
+		state_ = RECONNECTING;
+		reconnectTimer_.expires_from_now(boost::posix_time::microseconds(long(delay*1e6)));
+		reconnectTimer_.async_wait(boost::bind(&client::handle_reconnect, shared_from_this(),
+				boost::asio::placeholders::error));
+	}
+
+	void handle_reconnect(const boost::system::error_code& error)
+	{
+		if (error)
+			return;
+
+		boost::mutex::scoped_lock lock(socketLock_);
+
+		if (closed_)
+			return;
+
+		// Use the cached endpoints, resolving again now and then in
+		// case the address has changed
+		if (endpoints_.empty() || (failures_ != 0 && failures_ % RECONNECT_RESOLVE_INTERVAL == 0))
+		{
+			resolver_.async_resolve(query(),
+					boost::bind(&client::handle_resolve, shared_from_this(),
+							boost::asio::placeholders::error,
+							boost::asio::placeholders::iterator));
+		}
+		else
+		{
+			start_connect(0);
+		}
+	}
+
+	void handle_resolve(const boost::system::error_code& error,
+			tcp::resolver::iterator iter)
+	{
+		boost::mutex::scoped_lock lock(socketLock_);
+
+		if (closed_)
+		{
+			return;
+		}
+
+		if (!error)
+		{
+			endpoints_.assign(iter, tcp::resolver::iterator());
+		}
+
+		if (endpoints_.empty())
+		{
+			++failures_;
+			schedule_reconnect();
+		}
+		else
+		{
+			start_connect(0);
+		}
+	}
+
+	//must be called with the socketLock_ held
+	void start_connect(size_t index)
+	{
+		boost::system::error_code ec;
+		s_.close(ec);
+		s_.async_connect(endpoints_[index],
+				boost::bind(&client::handle_connect, shared_from_this(),
+						boost::asio::placeholders::error, index));
+
+		if (connectTimeout_ > 0)
+		{
+			connectTimer_.expires_from_now(boost::posix_time::microseconds(long(connectTimeout_*1e6)));
+			connectTimer_.async_wait(boost::bind(&client::handle_connect_timeout, shared_from_this(),
+					boost::asio::placeholders::error));
+		}
+	}
+
+	// Closing the socket makes the pending connect fail
+	void handle_connect_timeout(const boost::system::error_code& error)
+	{
+		boost::mutex::scoped_lock lock(socketLock_);
+
+		if (!error && state_ != CONNECTED &&
+				connectTimer_.expires_at() <= boost::asio::deadline_timer::traits_type::now())
+		{
+			boost::system::error_code ec;
+			s_.close(ec);
+		}
+	}
+
+	void handle_connect(const boost::system::error_code& error, size_t index)
+	{
+		boost::mutex::scoped_lock lock(socketLock_);
+
+		connectTimer_.cancel();
+
+		if (closed_)
+		{
+			return;
+		}
+
+		if (!error)
+		{
+			SINK_PROBE2(connect, port_, ip_addr_.c_str());
+			state_ = CONNECTED;
+			failures_ = 0;
+		}
+		else if (index + 1 < endpoints_.size())
+		{
+			start_connect(index + 1);
+		}
+		else
+		{
+			boost::system::error_code ec;
+			s_.close(ec);
+			++failures_;
+			schedule_reconnect();
+		}
+	}
+
+	boost::shared_ptr<IoThread> thread_;
+	boost::asio::io_service& io_service_;
 	tcp::socket s_;
+	boost::asio::deadline_timer connectTimer_;
+	std::vector<boost::asio::const_buffer> gather_;
+	boost::asio::deadline_timer pacingTimer_;
+	unsigned int pacingGeneration_;
+	boost::asio::deadline_timer reconnectTimer_;
+	tcp::resolver resolver_;
+	bool closed_;
+	double connectTimeout_;
+	std::vector<tcp::endpoint> endpoints_;
+	unsigned int failures_;
 	unsigned short port_;
 	std::string ip_addr_;
+	unsigned int seed_;
+	State state_;
+	SendQueue writeQueue_;
+	boost::mutex socketLock_;
 
 };
 
@@ -1,31 +1,163 @@
-#include <omniORB4/CORBA.h>
+#include <stdint.h>
 #include "BoostServer.h"
+#include "corelog.h"
 
+// The pending read keeps the session alive, so it can't be
+// destroyed underneath the read when a write fails first
 void session::start()
 {
 	socket_.async_read_some(boost::asio::buffer(read_data_, max_length_),
-			boost::bind(&session::handle_read, this,
+			boost::bind(&session::handle_read, shared_from_this(),
 					boost::asio::placeholders::error,
 					boost::asio::placeholders::bytes_transferred));
 }
 
-template<typename T, typename U>
-void session::write(std::vector<T, U>& data)
+// Record who connected and when, before the session is shared
+// with the writing thread
+void session::setPeer(const std::string& address)
+{
+	address_ = address;
+	connectedAt_ = TokenBucket::now();
+}
+
+// Queue a buffer, returning true if the session has fallen
+// further behind than the slow consumer limits allow
+bool session::write(const SharedBuffer& buffer)
 {
 	if (socket_.is_open())
 	{
 		boost::mutex::scoped_lock lock(writeLock_);
-		size_t numBytes = data.size()*sizeof(T);
-		writeBuffer_.push_back(std::vector<char>(numBytes));
-		memcpy(&writeBuffer_.back()[0],&data[0],numBytes);
-		if (writeBuffer_.size()==1)
+		bool holding = writeBuffer_.holding();
+
+		if (writeBuffer_.push(buffer))
 		{
-			boost::asio::async_write(socket_,
-				boost::asio::buffer(writeBuffer_[0]),
-				boost::bind(&session::handle_write, shared_from_this(),
-						boost::asio::placeholders::error));
+			SINK_PROBE3(enqueue, buffer->size(), port_, writeBuffer_.queuedBytes());
+
+			// Enough has built up, so stop waiting on the deadline
+			if (holding)
+			{
+				++pacingGeneration_;
+				pacingTimer_.cancel();
+			}
+
+			start_write();
 		}
+
+		return overLimits(1);
 	}
+
+	return false;
+}
+
+// Whether the session is more than a fraction of either slow
+// consumer limit behind.  Must be called with the writeLock_ held
+bool session::overLimits(double fraction)
+{
+	return (maxBytes_ && writeBuffer_.queuedBytes() > maxBytes_ * fraction) ||
+			(maxLag_ && writeBuffer_.lag() > maxLag_ * fraction);
+}
+
+// Whether the session has fallen further behind than the slow
+// consumer limits allow
+bool session::behind()
+{
+	boost::mutex::scoped_lock lock(writeLock_);
+	return socket_.is_open() && overLimits(1);
+}
+
+double session::pacingDelay()
+{
+	boost::mutex::scoped_lock lock(writeLock_);
+	return writeBuffer_.pacingDelay();
+}
+
+void session::setRateLimit(double bytesPerSecond, size_t burstSize)
+{
+	boost::mutex::scoped_lock lock(writeLock_);
+	writeBuffer_.setRateLimit(bytesPerSecond, burstSize);
+}
+
+void session::setCoalescing(size_t bytes, double maxDelay)
+{
+	boost::mutex::scoped_lock lock(writeLock_);
+	writeBuffer_.setCoalescing(bytes, maxDelay);
+}
+
+size_t session::queuedBytes()
+{
+	boost::mutex::scoped_lock lock(writeLock_);
+	return writeBuffer_.queuedBytes();
+}
+
+void session::setMemoryBudget(const boost::shared_ptr<MemoryBudget>& budget)
+{
+	boost::mutex::scoped_lock lock(writeLock_);
+	writeBuffer_.setBudget(budget);
+}
+
+size_t session::shed()
+{
+	boost::mutex::scoped_lock lock(writeLock_);
+	return writeBuffer_.shed();
+}
+
+// 0 turns either limit off
+void session::setSlowConsumerLimit(double maxLag, size_t maxBytes)
+{
+	boost::mutex::scoped_lock lock(writeLock_);
+	maxLag_ = maxLag;
+	maxBytes_ = maxBytes;
+}
+
+// Mark the session as only getting the newest data, returning
+// true the first time
+bool session::downgrade()
+{
+	boost::mutex::scoped_lock lock(writeLock_);
+	bool first = !downgraded_;
+	downgraded_ = true;
+	return first;
+}
+
+// Give a downgraded session everything again once it is back
+// within half of the limits, returning true if it was.  The
+// margin keeps a session near a limit from flapping
+bool session::caughtUp()
+{
+	boost::mutex::scoped_lock lock(writeLock_);
+
+	if (!downgraded_ || overLimits(0.5))
+	{
+		return false;
+	}
+
+	downgraded_ = false;
+	return true;
+}
+
+// Must be called on the I/O thread.  The pending operations
+// fail, and the session goes away once they have
+void session::close()
+{
+	boost::system::error_code ec;
+	evicted_ = true;
+	pacingTimer_.cancel(ec);
+	socket_.shutdown(tcp::socket::shutdown_both, ec);
+	socket_.close(ec);
+}
+
+// How far behind the session is, for logging
+std::string session::describeBacklog()
+{
+	boost::mutex::scoped_lock lock(writeLock_);
+	double connected = TokenBucket::now() - connectedAt_;
+	std::ostringstream description;
+
+	description << address_ << " is " << writeBuffer_.lag() << " s behind with "
+			<< writeBuffer_.queuedBytes() << " bytes queued, draining "
+			<< (connected > 0 ? writeBuffer_.drainedBytes() / connected : 0) << " bytes/s";
+
+	return description.str();
 }
 
 void session::handle_read(const boost::system::error_code& error,
@@ -33,9 +165,7 @@ void session::handle_read(const boost::system::error_code& error,
 {
 	if (!error)
 	{
-		read_data_.resize(bytes_transferred);
-		server_->newSessionData(read_data_);
-		read_data_.resize(max_length_);
+		server_->newSessionData(&read_data_[0], bytes_transferred);
 		socket_.async_read_some(boost::asio::buffer(read_data_, max_length_),
 				boost::bind(&session::handle_read, shared_from_this(),
 						boost::asio::placeholders::error,
@@ -43,73 +173,371 @@ void session::handle_read(const boost::system::error_code& error,
 	}
 	else
 	{
-		std::cerr<<"ERROR reading session data: "<<error<<std::endl;
+		SINK_PROBE2(disconnect, port_, error.value());
+		if (!evicted_)
+		{
+			std::cerr<<"ERROR reading session data: "<<error<<std::endl;
+		}
 		server_->closeSession(shared_from_this());
 	}
 }
 
-void session::handle_write(const boost::system::error_code& error)
+//must be called with the writeLock_ held
+void session::start_write()
+{
+	double delay;
+
+	if (!writeBuffer_.next(gather_, delay))
+	{
+		return;
+	}
+
+	// Wait for the rate limit or the coalescing deadline before
+	// writing the next chunks
+	if (delay > 0)
+	{
+		pacingTimer_.expires_from_now(boost::posix_time::microseconds(long(delay*1e6)+1));
+		pacingTimer_.async_wait(boost::bind(&session::handle_pace, shared_from_this(),
+				boost::asio::placeholders::error, pacingGeneration_));
+	}
+	else
+	{
+		boost::asio::async_write(socket_,
+				gather_,
+				boost::bind(&session::handle_write, shared_from_this(),
+						boost::asio::placeholders::error,
+						boost::asio::placeholders::bytes_transferred));
+	}
+}
+
+// A wait that was abandoned may still complete, so only the
+// latest one starts a write
+void session::handle_pace(const boost::system::error_code& error, unsigned int generation)
+{
+	if (!error)
+	{
+		boost::mutex::scoped_lock lock(writeLock_);
+
+		if (generation == pacingGeneration_)
+		{
+			start_write();
+		}
+	}
+}
+
+void session::handle_write(const boost::system::error_code& error,
+		size_t bytes_transferred)
 {
 	boost::mutex::scoped_lock lock(writeLock_);
-	writeBuffer_.pop_front();
+
+	SINK_PROBE3(write_done, bytes_transferred, port_, error.value());
+
 	if (error)
 	{
-		std::cerr<<"ERROR writting session data: "<<error<<std::endl;
+		SINK_PROBE2(disconnect, port_, error.value());
+		if (!evicted_)
+		{
+			std::cerr<<"ERROR writting session data: "<<error<<std::endl;
+		}
+		writeBuffer_.clear();
+		lock.unlock();
 		server_->closeSession(shared_from_this());
 	}
-	else if(!writeBuffer_.empty())
+	else if(writeBuffer_.consume(bytes_transferred))
 	{
-		boost::asio::async_write(socket_,
-						boost::asio::buffer(writeBuffer_[0]),
-						boost::bind(&session::handle_write, shared_from_this(),
-								boost::asio::placeholders::error));
+		start_write();
 	}
 }
 
 
 template<typename T, typename U>
 void server::write(std::vector<T, U>& data)
+{
+	write(makeSharedBuffer(data));
+}
+
+/*
+ * Send a buffer to every session.  A session that has fallen
+ * too far behind is either disconnected or has its backlog
+ * dropped, so it can't hold up the others or take memory
+ * without bound
+ */
+void server::write(const SharedBuffer& buffer)
+{
+	boost::mutex::scoped_lock lock(sessionsLock_);
+	std::list<session_ptr>::iterator i = sessions_.begin();
+	while (i!=sessions_.end())
+	{
+		i = checkSession(i, (*i)->write(buffer));
+	}
+}
+
+/*
+ * Act on whether a session is behind, returning the next one.
+ * In drop mode a session that is behind has its backlog shed
+ * until it catches up; otherwise it is disconnected.  Must be
+ * called with the sessionsLock_ held
+ */
+std::list<session_ptr>::iterator server::checkSession(std::list<session_ptr>::iterator i, bool behind)
+{
+	session_ptr thisSession= *i;
+	if (!behind)
+	{
+		if (thisSession->caughtUp())
+		{
+			CORE_LOG_INFO(server, "Slow consumer on port " << port_ << " caught up: " << thisSession->describeBacklog());
+		}
+		return ++i;
+	}
+	else if (slowConsumerDrop_)
+	{
+		if (thisSession->downgrade())
+		{
+			CORE_LOG_WARN(server, "Dropping data for slow consumer on port " << port_ << ": " << thisSession->describeBacklog());
+			slowConsumers_++;
+		}
+		slowConsumerDropped_ += thisSession->shed();
+		return ++i;
+	}
+	else
+	{
+		CORE_LOG_WARN(server, "Disconnecting slow consumer on port " << port_ << ": " << thisSession->describeBacklog());
+		slowConsumers_++;
+		slowConsumerDropped_ += thisSession->shed();
+		closedPacingDelay_ += thisSession->pacingDelay();
+		io_service_.post(boost::bind(&session::close, thisSession));
+		return sessions_.erase(i);
+	}
+}
+
+// Must be called on the I/O thread.  Checks the sessions
+// periodically while a slow consumer limit is set
+void server::start_check()
+{
+	if (checking_)
+	{
+		return;
+	}
+
+	{
+		boost::mutex::scoped_lock lock(sessionsLock_);
+		if (!slowConsumerLag_ && !slowConsumerBytes_)
+		{
+			return;
+		}
+	}
+
+	checking_ = true;
+	checkTimer_.expires_from_now(boost::posix_time::microseconds(long(SLOW_CONSUMER_CHECK_INTERVAL*1e6)));
+	checkTimer_.async_wait(boost::bind(&server::handle_check, this, boost::asio::placeholders::error));
+}
+
+/*
+ * Catch the sessions that fall behind, or catch up, while
+ * nothing is being written to them
+ */
+void server::handle_check(const boost::system::error_code& error)
+{
+	checking_ = false;
+
+	if (error)
+	{
+		return;
+	}
+
+	{
+		boost::mutex::scoped_lock lock(sessionsLock_);
+		std::list<session_ptr>::iterator i = sessions_.begin();
+		while (i!=sessions_.end())
+		{
+			i = checkSession(i, (*i)->behind());
+		}
+	}
+
+	start_check();
+}
+
+// The total time sessions on this port have waited on the rate limit
+double server::pacingDelay()
 {
 	boost::mutex::scoped_lock lock(sessionsLock_);
+	double delay = closedPacingDelay_;
 	for (std::list<session_ptr>::iterator i = sessions_.begin(); i!=sessions_.end(); i++)
 	{
-		session_ptr thisSession= *i;
-		thisSession->write(data);
+		delay += (*i)->pacingDelay();
 	}
+	return delay;
 }
+
+void server::setRateLimit(double bytesPerSecond, size_t burstSize)
+{
+	boost::mutex::scoped_lock lock(sessionsLock_);
+	rateLimit_ = bytesPerSecond;
+	burstSize_ = burstSize;
+	for (std::list<session_ptr>::iterator i = sessions_.begin(); i!=sessions_.end(); i++)
+	{
+		(*i)->setRateLimit(rateLimit_, burstSize_);
+	}
+}
+
+// The largest backlog of any session, so the slowest reader
+// determines how loaded this port is
+size_t server::queuedBytes()
+{
+	boost::mutex::scoped_lock lock(sessionsLock_);
+	size_t queued = 0;
+	for (std::list<session_ptr>::iterator i = sessions_.begin(); i!=sessions_.end(); i++)
+	{
+		queued = std::max(queued, (*i)->queuedBytes());
+	}
+	return queued;
+}
+
+void server::setCoalescing(size_t bytes, double maxDelay)
+{
+	boost::mutex::scoped_lock lock(sessionsLock_);
+	coalesceBytes_ = bytes;
+	coalesceDelay_ = maxDelay;
+	for (std::list<session_ptr>::iterator i = sessions_.begin(); i!=sessions_.end(); i++)
+	{
+		(*i)->setCoalescing(coalesceBytes_, coalesceDelay_);
+	}
+}
+
+void server::setMemoryBudget(const boost::shared_ptr<MemoryBudget>& budget)
+{
+	boost::mutex::scoped_lock lock(sessionsLock_);
+	budget_ = budget;
+	for (std::list<session_ptr>::iterator i = sessions_.begin(); i!=sessions_.end(); i++)
+	{
+		(*i)->setMemoryBudget(budget_);
+	}
+}
+
+// Drop the data queued for the session furthest behind,
+// returning how much was dropped
+size_t server::shedSlowest()
+{
+	boost::mutex::scoped_lock lock(sessionsLock_);
+	session_ptr slowest;
+	size_t queued = 0;
+	for (std::list<session_ptr>::iterator i = sessions_.begin(); i!=sessions_.end(); i++)
+	{
+		size_t sessionQueued = (*i)->queuedBytes();
+		if (sessionQueued > queued)
+		{
+			queued = sessionQueued;
+			slowest = *i;
+		}
+	}
+	return slowest ? slowest->shed() : 0;
+}
+
+/*
+ * Treat sessions that are more than maxLag seconds or maxBytes
+ * behind as slow consumers, and either drop their backlog or
+ * disconnect them.  0 turns either limit off
+ */
+void server::setSlowConsumerLimit(double maxLag, size_t maxBytes, bool drop)
+{
+	boost::mutex::scoped_lock lock(sessionsLock_);
+	slowConsumerLag_ = maxLag;
+	slowConsumerBytes_ = maxBytes;
+	slowConsumerDrop_ = drop;
+	for (std::list<session_ptr>::iterator i = sessions_.begin(); i!=sessions_.end(); i++)
+	{
+		(*i)->setSlowConsumerLimit(slowConsumerLag_, slowConsumerBytes_);
+	}
+	io_service_.post(boost::bind(&server::start_check, this));
+}
+
+// The slow consumers found since the last call, and how much
+// of their data was dropped
+unsigned int server::takeSlowConsumers(size_t& droppedBytes)
+{
+	boost::mutex::scoped_lock lock(sessionsLock_);
+	unsigned int found = slowConsumers_;
+	droppedBytes = slowConsumerDropped_;
+	slowConsumers_ = 0;
+	slowConsumerDropped_ = 0;
+	return found;
+}
+
+// Pin the I/O thread, which then allocates from its own node.
+// An empty list leaves a thread that was never pinned alone
+bool server::setAffinity(const std::string& cpus)
+{
+	if (cpus.empty() && !pinned_)
+	{
+		return true;
+	}
+
+	if (!pinThread(thread_->native_handle(), cpus))
+	{
+		return false;
+	}
+
+	pinned_ = !cpus.empty();
+	io_service_.post(boost::bind(pinned_ ? &preferLocalNode : &resetMemoryPolicy));
+	return true;
+}
+
+std::string server::placement()
+{
+	return describePlacement(thread_->native_handle());
+}
+
 template<typename T>
 void server::read(std::vector<char, T> & data, size_t index)
 {
 	boost::mutex::scoped_lock lock(pendingDataLock_);
-	int numRead=std::min(data.size()-index, pendingData_.size());
+	size_t numRead=pendingData_.read(&data[0]+index, data.size()-index);
 	data.resize(index+numRead);
-	int j=0;
-	for (unsigned int i=index; i!=data.size(); i++)
-	{
-		data[i]=pendingData_[j];
-		j++;
-	}
-	pendingData_.erase(pendingData_.begin(), pendingData_.begin()+numRead);
 }
 
 bool server::is_connected()
 {
+	boost::mutex::scoped_lock lock(sessionsLock_);
 	return !sessions_.empty();
 }
 
-template<typename T>
-void server::newSessionData(std::vector<char, T>& data)
+void server::newSessionData(const char* data, size_t size)
+{
+	boost::mutex::scoped_lock lock(pendingDataLock_);
+	if (!discardInbound_)
+	{
+		pendingData_.write(data, size);
+	}
+}
+
+/*
+ * Set the size of each socket read for new sessions, the
+ * capacity of the inbound buffer, and whether inbound data
+ * is thrown away instead of being buffered
+ */
+void server::configureInbound(size_t readChunkSize, size_t bufferSize, bool discard)
 {
+	{
+		boost::mutex::scoped_lock lock(sessionsLock_);
+		maxLength_ = std::max(readChunkSize, size_t(1));
+	}
+
 	boost::mutex::scoped_lock lock(pendingDataLock_);
-	int oldSize=pendingData_.size();
-	pendingData_.resize(oldSize+data.size());
-	char* newData= &data[0];
-	for (unsigned int i=oldSize; i!=pendingData_.size(); i++)
+	discardInbound_ = discard;
+	if (discard)
 	{
-		pendingData_[i]=*newData;
-		newData++;
+		pendingData_.clear();
 	}
+	pendingData_.resize(bufferSize);
 }
+
+// The number of inbound bytes lost because nobody read them
+size_t server::inboundOverwritten()
+{
+	boost::mutex::scoped_lock lock(pendingDataLock_);
+	return pendingData_.overwritten();
+}
+
 void server::closeSession(session_ptr ptr)
 {
 	boost::mutex::scoped_lock lock(sessionsLock_);
@@ -117,6 +545,7 @@ void server::closeSession(session_ptr ptr)
 	{
 		if (ptr==*i)
 		{
+			closedPacingDelay_ += ptr->pacingDelay();
 			sessions_.remove(ptr);
 			break;
 		}
@@ -127,7 +556,8 @@ void server::closeSession(session_ptr ptr)
 void server::start_accept()
 {
 	{
-		session_ptr new_session(new session(io_service_, this, maxLength_));
+		boost::mutex::scoped_lock lock(sessionsLock_);
+		session_ptr new_session(new session(io_service_, this, maxLength_, port_));
 
 		acceptor_.async_accept(new_session->socket(),
 				boost::bind(&server::handle_accept, this, new_session,
@@ -142,9 +572,18 @@ void server::handle_accept(session_ptr new_session,
 		{
 			{
 				boost::mutex::scoped_lock lock(sessionsLock_);
+				boost::system::error_code ec;
+				std::string address = new_session->socket().remote_endpoint(ec).address().to_string();
+				SINK_PROBE2(connect, port_, address.c_str());
+
+				new_session->setRateLimit(rateLimit_, burstSize_);
+				new_session->setCoalescing(coalesceBytes_, coalesceDelay_);
+				new_session->setMemoryBudget(budget_);
+				new_session->setSlowConsumerLimit(slowConsumerLag_, slowConsumerBytes_);
+				new_session->setPeer(address);
 				sessions_.push_back(new_session);
 
-				session_ptr new_session(new session(io_service_, this, maxLength_));
+				session_ptr new_session(new session(io_service_, this, maxLength_, port_));
 				acceptor_.async_accept(new_session->socket(),
 								boost::bind(&server::handle_accept, this, new_session,
 										boost::asio::placeholders::error));
@@ -175,9 +614,9 @@ template void server::read(std::vector<char, std::allocator<char> >&, size_t);
 template void server::write(std::vector<unsigned char, std::allocator<unsigned char> >&);
 template void server::write(std::vector<char, std::allocator<char> >&);
 template void server::write(std::vector<signed char, std::allocator<signed char> >&);
-template void server::write(std::vector<CORBA::Short, std::allocator<CORBA::Short> >&);
-template void server::write(std::vector<CORBA::UShort, std::allocator<CORBA::UShort> >&);
-template void server::write(std::vector<CORBA::Long, std::allocator<CORBA::Long> >&);
-template void server::write(std::vector<CORBA::ULong, std::allocator<CORBA::ULong> >&);
-template void server::write(std::vector<CORBA::Float, std::allocator<CORBA::Float> >&);
-template void server::write(std::vector<CORBA::Double, std::allocator<CORBA::Double> >&);
+template void server::write(std::vector<int16_t, std::allocator<int16_t> >&);
+template void server::write(std::vector<uint16_t, std::allocator<uint16_t> >&);
+template void server::write(std::vector<int32_t, std::allocator<int32_t> >&);
+template void server::write(std::vector<uint32_t, std::allocator<uint32_t> >&);
+template void server::write(std::vector<float, std::allocator<float> >&);
+template void server::write(std::vector<double, std::allocator<double> >&);
@@ -12,18 +12,35 @@
 #include <boost/enable_shared_from_this.hpp>
 #include <deque>
 
+#include "SendQueue.h"
+#include "affinity.h"
+#include "bytering.h"
+#include "probes.h"
+
 using boost::asio::ip::tcp;
 
+// While a slow consumer limit is set, every session of a server
+// is checked this often, in seconds, even when nothing is written
+#define SLOW_CONSUMER_CHECK_INTERVAL 0.1
+
 class server;
 
 class session :  public boost::enable_shared_from_this<session>
 {
 public:
-	session(boost::asio::io_service& io_service, server* s, size_t max_length)
+	session(boost::asio::io_service& io_service, server* s, size_t max_length, unsigned short port)
 	: socket_(io_service),
 	  server_(s),
 	  read_data_(max_length),
-	  max_length_(max_length)
+	  max_length_(max_length),
+	  pacingTimer_(io_service),
+	  pacingGeneration_(0),
+	  port_(port),
+	  connectedAt_(0),
+	  downgraded_(false),
+	  evicted_(false),
+	  maxLag_(0),
+	  maxBytes_(0)
 	{
 	}
 
@@ -33,26 +50,51 @@ public:
 	}
 
 	void start();
+	void setPeer(const std::string& address);
 
-	template<typename T, typename U>
-	void write(std::vector<T, U>& data);
+	bool write(const SharedBuffer& buffer);
 
+	double pacingDelay();
+	void setRateLimit(double bytesPerSecond, size_t burstSize);
+	void setCoalescing(size_t bytes, double maxDelay);
+	size_t queuedBytes();
+	void setMemoryBudget(const boost::shared_ptr<MemoryBudget>& budget);
+	size_t shed();
 
+	void setSlowConsumerLimit(double maxLag, size_t maxBytes);
+	bool behind();
+	bool downgrade();
+	bool caughtUp();
+	void close();
+	std::string describeBacklog();
 
 private:
 	void handle_read(const boost::system::error_code& error,
 			size_t bytes_transferred);
 
-
-	void handle_write(const boost::system::error_code& error);
+	bool overLimits(double fraction);
+	void start_write();
+	void handle_pace(const boost::system::error_code& error, unsigned int generation);
+	void handle_write(const boost::system::error_code& error,
+			size_t bytes_transferred);
 
 
 	tcp::socket socket_;
 	server* server_;
 	std::vector<char> read_data_;
 	size_t max_length_;
-	std::deque<std::vector<char> > writeBuffer_;
+	std::vector<boost::asio::const_buffer> gather_;
+	boost::asio::deadline_timer pacingTimer_;
+	unsigned int pacingGeneration_;
+	unsigned short port_;
+	SendQueue writeBuffer_;
 	boost::mutex writeLock_;
+	std::string address_;
+	double connectedAt_;
+	bool downgraded_;
+	bool evicted_;
+	double maxLag_;
+	size_t maxBytes_;
 
 };
 
@@ -61,10 +103,26 @@ typedef boost::shared_ptr<session> session_ptr;
 class server
 {
 public:
-	server(short port, size_t maxLength=1024) :
+	server(short port, size_t maxLength=65536, size_t inboundBufferSize=1048576) :
 		acceptor_(io_service_, tcp::endpoint(tcp::v4(), port)),
+		checkTimer_(io_service_),
+		checking_(false),
+		pendingData_(inboundBufferSize),
 		thread_(NULL),
-		maxLength_(maxLength)
+		maxLength_(maxLength),
+		burstSize_(0),
+		coalesceBytes_(0),
+		coalesceDelay_(0),
+		discardInbound_(false),
+		closedPacingDelay_(0),
+		pinned_(false),
+		rateLimit_(0),
+		slowConsumerBytes_(0),
+		slowConsumerDrop_(false),
+		slowConsumerDropped_(0),
+		slowConsumerLag_(0),
+		slowConsumers_(0),
+		port_(port)
 	{
 		start_accept();
 		thread_ = new boost::thread(boost::bind(&server::run, this));
@@ -87,12 +145,28 @@ public:
 
 	template<typename T, typename U>
 	void write(std::vector<T, U>& data);
+	void write(const SharedBuffer& buffer);
 	template<typename T>
 	void read(std::vector<char, T> & data, size_t index=0);
 	bool is_connected();
 
-	template<typename T>
-	void newSessionData(std::vector<char, T>& data);
+	double pacingDelay();
+	void setRateLimit(double bytesPerSecond, size_t burstSize);
+	void setCoalescing(size_t bytes, double maxDelay);
+	size_t queuedBytes();
+	void setMemoryBudget(const boost::shared_ptr<MemoryBudget>& budget);
+	size_t shedSlowest();
+
+	void setSlowConsumerLimit(double maxLag, size_t maxBytes, bool drop);
+	unsigned int takeSlowConsumers(size_t& droppedBytes);
+
+	bool setAffinity(const std::string& cpus);
+	std::string placement();
+
+	void configureInbound(size_t readChunkSize, size_t bufferSize, bool discard);
+	size_t inboundOverwritten();
+
+	void newSessionData(const char* data, size_t size);
 	void closeSession(session_ptr ptr);
 
 
@@ -103,14 +177,34 @@ private:
 
 	void run();
 
+	std::list<session_ptr>::iterator checkSession(std::list<session_ptr>::iterator i, bool behind);
+	void start_check();
+	void handle_check(const boost::system::error_code& error);
+
 	boost::asio::io_service io_service_;
 	tcp::acceptor acceptor_;
+	boost::asio::deadline_timer checkTimer_;
+	bool checking_;
 	std::list<session_ptr> sessions_;
-	std::vector<char> pendingData_;
+	ByteRing pendingData_;
 	boost::mutex sessionsLock_;
 	boost::mutex pendingDataLock_;
 	boost::thread* thread_;
+	boost::shared_ptr<MemoryBudget> budget_;
 	size_t maxLength_;
+	size_t burstSize_;
+	size_t coalesceBytes_;
+	double coalesceDelay_;
+	bool discardInbound_;
+	double closedPacingDelay_;
+	bool pinned_;
+	double rateLimit_;
+	size_t slowConsumerBytes_;
+	bool slowConsumerDrop_;
+	size_t slowConsumerDropped_;
+	double slowConsumerLag_;
+	unsigned int slowConsumers_;
+	unsigned short port_;
 };
 
 
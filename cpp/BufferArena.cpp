@@ -0,0 +1,319 @@
+#include "BufferArena.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "corelog.h"
+
+// Never destroyed, since buffers may still be released by other
+// threads while the process exits
+BufferArena &BufferArena::instance()
+{
+	static BufferArena *arena = new BufferArena();
+	return *arena;
+}
+
+BufferArena::BufferArena() :
+	high_(NULL),
+	low_(NULL),
+	misses_(0),
+	reserved_(false)
+{
+}
+
+BufferArena::~BufferArena()
+{
+}
+
+/*
+ * The index of the free list for an allocation, or false if it
+ * is too small or too large for the arena
+ */
+bool BufferArena::sizeClass(size_t bytes, size_t &index)
+{
+	if (bytes < ARENA_MIN_BLOCK) {
+		return false;
+	}
+
+	size_t block = ARENA_MIN_BLOCK;
+
+	for (index = 0; index != ARENA_CLASSES; ++index, block <<= 1) {
+		if (bytes <= block) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Map a region and fault in every page of it now, rather than on
+ * first use.  Locking the region faults it in as well
+ */
+bool BufferArena::mapRegion(Region &region, size_t bytes, ArenaPages pages, bool lock)
+{
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+	void *map = MAP_FAILED;
+
+	if (pages == ARENA_PAGES_EXPLICIT) {
+		bytes = (bytes + ARENA_HUGE_PAGE - 1) / ARENA_HUGE_PAGE * ARENA_HUGE_PAGE;
+		map = mmap(NULL, bytes, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+
+		if (map == MAP_FAILED) {
+			CORE_LOG_WARN(BufferArena, "Unable to map " << bytes << " bytes of huge pages, using transparent huge pages: " << strerror(errno));
+			pages = ARENA_PAGES_TRANSPARENT;
+		}
+	}
+
+	if (map == MAP_FAILED) {
+		map = mmap(NULL, bytes, PROT_READ | PROT_WRITE, flags, -1, 0);
+
+		if (map == MAP_FAILED) {
+			CORE_LOG_ERROR(BufferArena, "Unable to map " << bytes << " bytes for the buffer arena: " << strerror(errno));
+			return false;
+		}
+	}
+
+	if (pages == ARENA_PAGES_TRANSPARENT and madvise(map, bytes, MADV_HUGEPAGE) != 0) {
+		CORE_LOG_DEBUG(BufferArena, "Transparent huge pages are not available: " << strerror(errno));
+	}
+
+	region.base = static_cast<char *>(map);
+	region.next = 0;
+	region.size = bytes;
+	region.used = 0;
+
+	if (lock and mlock(region.base, region.size) != 0) {
+		CORE_LOG_WARN(BufferArena, "Unable to lock the buffer arena in memory: " << strerror(errno));
+		lock = false;
+	}
+
+	if (not lock) {
+		size_t page = sysconf(_SC_PAGESIZE);
+
+		for (size_t offset = 0; offset < region.size; offset += page) {
+			region.base[offset] = 0;
+		}
+	}
+
+	return true;
+}
+
+void BufferArena::unmapRegion(Region &region)
+{
+	if (region.base) {
+		munmap(region.base, region.size);
+		region = Region();
+	}
+}
+
+/*
+ * Map and fault in a new region of bytes, or stop using the arena
+ * if bytes is zero.  The caller should be the thread that uses
+ * the buffers most, after it is pinned, so the pages come from
+ * its node.  Every lock is held while the regions are swapped,
+ * the arena wide one first
+ */
+bool BufferArena::reserve(size_t bytes, ArenaPages pages, bool lock)
+{
+	Region region;
+
+	if (bytes and not mapRegion(region, bytes, pages, lock)) {
+		return false;
+	}
+
+	boost::mutex::scoped_lock guard(lock_);
+
+	for (size_t i = 0; i != ARENA_CLASSES; ++i) {
+		classes_[i].lock.lock();
+		classes_[i].free.clear();
+	}
+
+	if (current_.used) {
+		retired_.push_back(current_);
+	} else {
+		unmapRegion(current_);
+	}
+
+	current_ = region;
+	__atomic_store_n(&misses_, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&reserved_, current_.base != NULL, __ATOMIC_RELEASE);
+	updateSpan();
+
+	for (size_t i = 0; i != ARENA_CLASSES; ++i) {
+		classes_[i].lock.unlock();
+	}
+
+	return true;
+}
+
+/*
+ * Publish the lowest and highest addresses of the mapped
+ * regions, for deallocate to tell arena blocks from heap ones
+ * without a lock.  Called with lock_ held
+ */
+void BufferArena::updateSpan()
+{
+	char *low = current_.base;
+	char *high = current_.base ? current_.base + current_.size : NULL;
+
+	for (std::vector<Region>::const_iterator i = retired_.begin(); i != retired_.end(); ++i) {
+		if (not low or i->base < low) {
+			low = i->base;
+		}
+
+		if (i->base + i->size > high) {
+			high = i->base + i->size;
+		}
+	}
+
+	__atomic_store_n(&low_, low, __ATOMIC_RELEASE);
+	__atomic_store_n(&high_, high, __ATOMIC_RELEASE);
+}
+
+// True if an address may belong to one of the regions
+bool BufferArena::spans(const char *address) const
+{
+	return address >= __atomic_load_n(&low_, __ATOMIC_ACQUIRE) and address < __atomic_load_n(&high_, __ATOMIC_ACQUIRE);
+}
+
+// A new block from the unused end of the current region, which
+// is reserved if there is one
+void *BufferArena::carve(size_t block, bool &reserved)
+{
+	boost::mutex::scoped_lock guard(lock_);
+
+	reserved = current_.base != NULL;
+
+	if (current_.next + block > current_.size) {
+		return NULL;
+	}
+
+	void *carved = current_.base + current_.next;
+
+	current_.next += block;
+	__atomic_add_fetch(&current_.used, block, __ATOMIC_RELAXED);
+	return carved;
+}
+
+/*
+ * A block of a size class taken from the front of the smallest
+ * larger free block.  The rest of that block is put on the free
+ * lists of the sizes in between, one block of each
+ */
+void *BufferArena::split(size_t index)
+{
+	for (size_t larger = index + 1; larger < ARENA_CLASSES; ++larger) {
+		char *block;
+
+		{
+			boost::mutex::scoped_lock guard(classes_[larger].lock);
+
+			if (classes_[larger].free.empty()) {
+				continue;
+			}
+
+			block = static_cast<char *>(classes_[larger].free.back());
+			classes_[larger].free.pop_back();
+			__atomic_add_fetch(&current_.used, size_t(ARENA_MIN_BLOCK) << index, __ATOMIC_RELAXED);
+		}
+
+		for (size_t rest = index; rest != larger; ++rest) {
+			boost::mutex::scoped_lock guard(classes_[rest].lock);
+
+			// A reserve in between dropped the block's region
+			if (current_.contains(block)) {
+				classes_[rest].free.push_back(block + (size_t(ARENA_MIN_BLOCK) << rest));
+			}
+		}
+
+		return block;
+	}
+
+	return NULL;
+}
+
+void *BufferArena::allocate(size_t bytes)
+{
+	size_t index;
+
+	if (__atomic_load_n(&reserved_, __ATOMIC_ACQUIRE) and sizeClass(bytes, index)) {
+		size_t block = size_t(ARENA_MIN_BLOCK) << index;
+
+		{
+			boost::mutex::scoped_lock guard(classes_[index].lock);
+
+			if (not classes_[index].free.empty()) {
+				void *reused = classes_[index].free.back();
+				classes_[index].free.pop_back();
+				__atomic_add_fetch(&current_.used, block, __ATOMIC_RELAXED);
+				return reused;
+			}
+		}
+
+		bool reserved;
+
+		if (void *carved = carve(block, reserved)) {
+			return carved;
+		}
+
+		if (void *split = this->split(index)) {
+			return split;
+		}
+
+		if (reserved) {
+			__atomic_add_fetch(&misses_, 1, __ATOMIC_RELAXED);
+			CORE_LOG_WARN_EVERY(BufferArena, "The buffer arena is full, allocating " << bytes << " bytes from the heap");
+		}
+	}
+
+	return ::operator new(bytes);
+}
+
+void BufferArena::deallocate(void *block, size_t bytes)
+{
+	size_t index;
+	char *address = static_cast<char *>(block);
+
+	if (spans(address) and sizeClass(bytes, index)) {
+		size_t blockSize = size_t(ARENA_MIN_BLOCK) << index;
+
+		{
+			boost::mutex::scoped_lock guard(classes_[index].lock);
+
+			if (current_.contains(address)) {
+				classes_[index].free.push_back(block);
+				__atomic_sub_fetch(&current_.used, blockSize, __ATOMIC_RELAXED);
+				return;
+			}
+		}
+
+		boost::mutex::scoped_lock guard(lock_);
+
+		for (std::vector<Region>::iterator i = retired_.begin(); i != retired_.end(); ++i) {
+			if (i->contains(address)) {
+				if ((i->used -= blockSize) == 0) {
+					unmapRegion(*i);
+					retired_.erase(i);
+					updateSpan();
+				}
+
+				return;
+			}
+		}
+	}
+
+	::operator delete(block);
+}
+
+size_t BufferArena::used()
+{
+	return __atomic_load_n(&current_.used, __ATOMIC_RELAXED);
+}
+
+size_t BufferArena::misses()
+{
+	return __atomic_load_n(&misses_, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,187 @@
+#ifndef BUFFERARENA_H_
+#define BUFFERARENA_H_
+
+#include <stddef.h>
+#include <limits>
+#include <new>
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+
+// Allocations smaller than this always come from the heap
+#define ARENA_MIN_BLOCK 4096
+
+// Block sizes are powers of two from ARENA_MIN_BLOCK up to 2^(12+ARENA_CLASSES-1)
+#define ARENA_CLASSES 24
+
+// Explicit huge pages are this size
+#define ARENA_HUGE_PAGE (2 * 1024 * 1024)
+
+/*
+ * How the memory of the arena is backed
+ */
+enum ArenaPages {
+	// Ordinary pages
+	ARENA_PAGES_NORMAL,
+	// Transparent huge pages, where the kernel allows them
+	ARENA_PAGES_TRANSPARENT,
+	// Huge pages reserved through vm.nr_hugepages, falling back
+	// to transparent huge pages when none are free
+	ARENA_PAGES_EXPLICIT
+};
+
+inline bool parseArenaPages(const std::string &name, ArenaPages &pages)
+{
+	if (name == "normal") {
+		pages = ARENA_PAGES_NORMAL;
+	} else if (name == "transparent") {
+		pages = ARENA_PAGES_TRANSPARENT;
+	} else if (name == "explicit") {
+		pages = ARENA_PAGES_EXPLICIT;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Memory for the buffers of the data path, mapped and faulted in
+ * up front so the first packets don't stall on page faults.
+ * Blocks are handed out in power of two sizes and kept on a free
+ * list per size when released, so the same pages are reused
+ * from packet to packet.  When a size has no free block and the
+ * unused end of the arena is too small, a larger free block is
+ * split.  Only when that fails too, or the arena was never
+ * reserved, do buffers come from the heap, which is counted and
+ * logged.
+ *
+ * Each size has its own lock, so the threads allocating and
+ * releasing blocks of different sizes don't contend; the arena
+ * wide lock is only taken to carve new blocks, to release
+ * blocks of a retired region and to reserve.  Whether a region
+ * is reserved, and the addresses the regions span, are read
+ * without a lock, so while no arena is reserved buffers go
+ * straight to and from the heap.
+ *
+ * Reserving again maps a new region; the old one is unmapped
+ * once the last of its buffers is released.  Thread safe
+ */
+class BufferArena
+{
+public:
+	static BufferArena &instance();
+
+	bool reserve(size_t bytes, ArenaPages pages, bool lock);
+
+	void *allocate(size_t bytes);
+	void deallocate(void *block, size_t bytes);
+
+	// Bytes of the current region handed out, and allocations that
+	// had to go to the heap because it was full
+	size_t used();
+	size_t misses();
+
+private:
+	struct Region {
+		Region() :
+			base(NULL),
+			next(0),
+			size(0),
+			used(0)
+		{}
+
+		bool contains(const char *address) const
+		{
+			return address >= base and address < base + size;
+		}
+
+		char *base;
+		size_t next;
+		size_t size;
+		size_t used;
+	};
+
+	// The free blocks of one size
+	struct SizeClass {
+		std::vector<void *> free;
+		boost::mutex lock;
+	};
+
+	BufferArena();
+	~BufferArena();
+	BufferArena(const BufferArena &copy);
+	BufferArena &operator=(const BufferArena &copy);
+
+	static bool sizeClass(size_t bytes, size_t &index);
+	static bool mapRegion(Region &region, size_t bytes, ArenaPages pages, bool lock);
+	static void unmapRegion(Region &region);
+
+	void *carve(size_t block, bool &reserved);
+	void *split(size_t index);
+	bool spans(const char *address) const;
+	void updateSpan();
+
+	SizeClass classes_[ARENA_CLASSES];
+	Region current_;
+	char *high_;
+	boost::mutex lock_;
+	char *low_;
+	size_t misses_;
+	bool reserved_;
+	std::vector<Region> retired_;
+};
+
+/*
+ * A standard allocator drawing from the buffer arena
+ */
+template<typename T>
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+	typedef T *pointer;
+	typedef const T *const_pointer;
+	typedef T &reference;
+	typedef const T &const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+
+	template<typename U>
+	struct rebind {
+		typedef ArenaAllocator<U> other;
+	};
+
+	ArenaAllocator() {}
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U> &) {}
+
+	pointer address(reference value) const { return &value; }
+	const_pointer address(const_reference value) const { return &value; }
+
+	pointer allocate(size_type count, const void * = 0)
+	{
+		return static_cast<pointer>(BufferArena::instance().allocate(count * sizeof(T)));
+	}
+
+	void deallocate(pointer block, size_type count)
+	{
+		BufferArena::instance().deallocate(block, count * sizeof(T));
+	}
+
+	size_type max_size() const { return std::numeric_limits<size_type>::max() / sizeof(T); }
+
+	void construct(pointer place, const T &value) { new (place) T(value); }
+	void destroy(pointer place) { place->~T(); }
+};
+
+template<typename T, typename U>
+inline bool operator==(const ArenaAllocator<T> &, const ArenaAllocator<U> &) { return true; }
+
+template<typename T, typename U>
+inline bool operator!=(const ArenaAllocator<T> &, const ArenaAllocator<U> &) { return false; }
+
+// The bytes of a packet on its way through the data path
+typedef std::vector<char, ArenaAllocator<char> > DataBuffer;
+
+#endif /* BUFFERARENA_H_ */
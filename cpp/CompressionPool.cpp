@@ -0,0 +1,168 @@
+#include "CompressionPool.h"
+
+#include <arpa/inet.h>
+#include <string.h>
+#include <time.h>
+#include <boost/bind.hpp>
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+bool parseCompressionType(const std::string &name, CompressionType &type)
+{
+	if (name == "none" || name == "") {
+		type = COMPRESSION_NONE;
+	} else if (name == "lz4") {
+		type = COMPRESSION_LZ4;
+	} else if (name == "zstd") {
+		type = COMPRESSION_ZSTD;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+bool compressionAvailable(CompressionType type)
+{
+	switch (type) {
+	case COMPRESSION_NONE:
+		return true;
+#ifdef HAVE_LZ4
+	case COMPRESSION_LZ4:
+		return true;
+#endif
+#ifdef HAVE_ZSTD
+	case COMPRESSION_ZSTD:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+static void writeFrameHeader(char *header, unsigned char codec, size_t rawSize, size_t payloadSize)
+{
+	uint32_t raw = htonl(rawSize);
+	uint32_t payload = htonl(payloadSize);
+
+	memcpy(header, "CSKF", 4);
+	header[4] = codec;
+	header[5] = header[6] = header[7] = 0;
+	memcpy(header + 8, &raw, 4);
+	memcpy(header + 12, &payload, 4);
+}
+
+void compressFrame(CompressionType type, const char *data, size_t size, DataBuffer &frame)
+{
+	size_t compressedSize = 0;
+
+	switch (type) {
+#ifdef HAVE_LZ4
+	case COMPRESSION_LZ4:
+		frame.resize(COMPRESSION_FRAME_HEADER_SIZE + LZ4_compressBound(size));
+		compressedSize = LZ4_compress_default(data, &frame[COMPRESSION_FRAME_HEADER_SIZE], size, frame.size() - COMPRESSION_FRAME_HEADER_SIZE);
+		break;
+#endif
+#ifdef HAVE_ZSTD
+	case COMPRESSION_ZSTD:
+		{
+			frame.resize(COMPRESSION_FRAME_HEADER_SIZE + ZSTD_compressBound(size));
+			size_t result = ZSTD_compress(&frame[COMPRESSION_FRAME_HEADER_SIZE], frame.size() - COMPRESSION_FRAME_HEADER_SIZE, data, size, 1);
+			compressedSize = ZSTD_isError(result) ? 0 : result;
+		}
+		break;
+#endif
+	default:
+		break;
+	}
+
+	// Store the data if it could not be compressed or didn't shrink
+	if (compressedSize == 0 || compressedSize >= size) {
+		frame.resize(COMPRESSION_FRAME_HEADER_SIZE + size);
+		memcpy(&frame[COMPRESSION_FRAME_HEADER_SIZE], data, size);
+		writeFrameHeader(&frame[0], 0, size, size);
+	} else {
+		frame.resize(COMPRESSION_FRAME_HEADER_SIZE + compressedSize);
+		writeFrameHeader(&frame[0], type, size, compressedSize);
+	}
+}
+
+/*
+ * Take ownership of the input data to avoid copying it
+ * between threads
+ */
+CompressionJob::CompressionJob(CompressionType type, DataBuffer &input) :
+	cpuTime_(0),
+	done_(false),
+	rawSize_(input.size()),
+	type_(type)
+{
+	input_.swap(input);
+}
+
+void CompressionJob::run()
+{
+	timespec start, end;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+	compressFrame(type_, input_.data(), input_.size(), frame_);
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+
+	// Release the input as soon as it isn't needed
+	DataBuffer().swap(input_);
+
+	boost::mutex::scoped_lock lock(doneLock_);
+	cpuTime_ = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	done_ = true;
+	doneCondition_.notify_all();
+}
+
+bool CompressionJob::done()
+{
+	boost::mutex::scoped_lock lock(doneLock_);
+	return done_;
+}
+
+bool CompressionJob::wait(const boost::posix_time::time_duration &timeout)
+{
+	boost::mutex::scoped_lock lock(doneLock_);
+
+	if (not done_) {
+		doneCondition_.timed_wait(lock, timeout);
+	}
+
+	return done_;
+}
+
+CompressionPool::CompressionPool(size_t numThreads) :
+	work_(new boost::asio::io_service::work(io_service_))
+{
+	for (size_t i = 0; i != numThreads; ++i) {
+		threads_.create_thread(boost::bind(&CompressionPool::run, this));
+	}
+}
+
+/*
+ * Let the workers finish any queued jobs, then join them
+ */
+CompressionPool::~CompressionPool()
+{
+	delete work_;
+	threads_.join_all();
+}
+
+void CompressionPool::submit(CompressionJobPtr job)
+{
+	io_service_.post(boost::bind(&CompressionJob::run, job));
+}
+
+void CompressionPool::run()
+{
+	io_service_.run();
+}
@@ -0,0 +1,112 @@
+#ifndef COMPRESSIONPOOL_H_
+#define COMPRESSIONPOOL_H_
+
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "BufferArena.h"
+
+/*
+ * Lossless compression applied to the transformed data
+ * of a connection before it is sent
+ */
+enum CompressionType {
+	COMPRESSION_NONE,
+	COMPRESSION_LZ4,
+	COMPRESSION_ZSTD
+};
+
+bool parseCompressionType(const std::string &name, CompressionType &type);
+bool compressionAvailable(CompressionType type);
+
+/*
+ * Every compressed packet is sent as a self-describing frame:
+ *
+ *   bytes 0-3    magic "CSKF"
+ *   byte  4      codec (0 = stored, 1 = lz4, 2 = zstd)
+ *   bytes 5-7    reserved, zero
+ *   bytes 8-11   uncompressed payload size, big endian
+ *   bytes 12-15  frame payload size, big endian
+ *
+ * followed by the payload.  Data that does not shrink is
+ * stored uncompressed so a frame is never much larger than
+ * its input
+ */
+const size_t COMPRESSION_FRAME_HEADER_SIZE = 16;
+
+void compressFrame(CompressionType type, const char *data, size_t size, DataBuffer &frame);
+
+/*
+ * Running totals used to report the compression ratio and
+ * CPU time of every connection sharing a compressed stream
+ */
+struct CompressionStats {
+	CompressionStats() :
+		compressedBytes(0),
+		cpuTime(0),
+		rawBytes(0)
+	{}
+
+	float ratio() const
+	{
+		return (compressedBytes > 0) ? rawBytes / compressedBytes : 1.0;
+	}
+
+	double compressedBytes;
+	double cpuTime;
+	double rawBytes;
+};
+
+/*
+ * One packet's worth of data to be compressed into a
+ * single frame by the worker pool
+ */
+class CompressionJob {
+public:
+	CompressionJob(CompressionType type, DataBuffer &input);
+
+	void run();
+	bool done();
+	bool wait(const boost::posix_time::time_duration &timeout);
+
+	double cpuTime() const { return cpuTime_; }
+	DataBuffer &frame() { return frame_; }
+	size_t rawSize() const { return rawSize_; }
+
+private:
+	double cpuTime_;
+	bool done_;
+	boost::condition_variable doneCondition_;
+	boost::mutex doneLock_;
+	DataBuffer frame_;
+	DataBuffer input_;
+	size_t rawSize_;
+	CompressionType type_;
+};
+
+typedef boost::shared_ptr<CompressionJob> CompressionJobPtr;
+
+/*
+ * A fixed set of worker threads which compress frames
+ * off of the service thread
+ */
+class CompressionPool {
+public:
+	CompressionPool(size_t numThreads);
+	~CompressionPool();
+
+	void submit(CompressionJobPtr job);
+
+private:
+	void run();
+
+	boost::asio::io_service io_service_;
+	boost::thread_group threads_;
+	boost::asio::io_service::work *work_;
+};
+
+#endif /* COMPRESSIONPOOL_H_ */
@@ -0,0 +1,220 @@
+#include "ConnectionSender.h"
+
+#include <sched.h>
+
+#include "affinity.h"
+
+// Let the other thread of a hyperthreaded core run while
+// spinning, or another thread on the same core
+static inline void relaxWhileSpinning()
+{
+#if defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#else
+	sched_yield();
+#endif
+}
+
+ConnectionSender::ConnectionSender(size_t index, size_t count, size_t queueDepth, size_t spin, const boost::shared_ptr<MemoryBudget> &budget, const boost::shared_ptr<boost::barrier> &handover) :
+	budget_(budget),
+	count_(count),
+	full_(false),
+	handover_(handover),
+	index_(index),
+	localNode_(false),
+	ring_(queueDepth),
+	sleeping_(false),
+	spin_(spin),
+	stopping_(false),
+	thread_(NULL)
+{
+	thread_ = new boost::thread(boost::bind(&ConnectionSender::run, this));
+}
+
+/*
+ * Send everything already published, then join the thread
+ */
+ConnectionSender::~ConnectionSender()
+{
+	__atomic_store_n(&stopping_, true, __ATOMIC_RELEASE);
+
+	{
+		boost::mutex::scoped_lock lock(wakeLock_);
+		wakeCondition_.notify_one();
+	}
+
+	thread_->join();
+	delete thread_;
+}
+
+/*
+ * Queue a packet for the sender, waiting for room if it has
+ * fallen a full ring behind
+ */
+void ConnectionSender::publish(const SendJobPtr &job)
+{
+	if (not ring_.push(job)) {
+		waitForRoom(job);
+	}
+
+	wake();
+}
+
+/*
+ * Sleep until the sender takes a packet off the full ring.  The
+ * fence orders the waiting flag before the next try, pairing
+ * with the one in run, so either the try finds room or the
+ * sender signals it
+ */
+void ConnectionSender::waitForRoom(const SendJobPtr &job)
+{
+	CORE_LOG_DEBUG_EVERY(ConnectionSender, "Sender " << index_ << " has " << ring_.capacity() << " packets queued, waiting for room");
+
+	boost::mutex::scoped_lock lock(roomLock_);
+
+	__atomic_store_n(&full_, true, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	while (not ring_.push(job)) {
+		roomCondition_.timed_wait(lock, boost::posix_time::milliseconds(SENDER_SLEEP_MS));
+	}
+
+	__atomic_store_n(&full_, false, __ATOMIC_RELAXED);
+}
+
+/*
+ * Only the sender that writes a connection may touch its ports.
+ * A newer request replaces one that hasn't been acted on yet
+ */
+void ConnectionSender::shed(const ConnectionSetPtr &connections, size_t index)
+{
+	boost::shared_ptr<ShedRequest> request(new ShedRequest);
+
+	request->connections = connections;
+	request->index = index;
+
+	boost::atomic_store(&shedRequest_, boost::shared_ptr<const ShedRequest>(request));
+}
+
+void ConnectionSender::statuses(std::vector<ConnectionStatus> &statuses) const
+{
+	boost::shared_ptr<const std::vector<ConnectionStatus> > latest = boost::atomic_load(&statuses_);
+
+	if (latest) {
+		statuses.insert(statuses.end(), latest->begin(), latest->end());
+	}
+}
+
+// Pin the thread, which then allocates from its own node
+bool ConnectionSender::setAffinity(const std::string &cpus)
+{
+	if (not pinThread(thread_->native_handle(), cpus)) {
+		return false;
+	}
+
+	__atomic_store_n(&localNode_, true, __ATOMIC_RELEASE);
+	wake();
+	return true;
+}
+
+std::string ConnectionSender::placement()
+{
+	return describePlacement(thread_->native_handle());
+}
+
+/*
+ * The fence orders the new tail before the check of the sleeping
+ * flag, pairing with the one in run, so either the sender sees
+ * the packet before it sleeps or it is woken up
+ */
+void ConnectionSender::wake()
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&sleeping_, __ATOMIC_RELAXED)) {
+		boost::mutex::scoped_lock lock(wakeLock_);
+		wakeCondition_.notify_one();
+	}
+}
+
+/*
+ * Send packets as they arrive.  An idle sender may spin for a
+ * while first, so a steady stream of packets doesn't pay for a
+ * wake up each time, but that only pays off when the senders
+ * have CPUs of their own
+ */
+void ConnectionSender::run()
+{
+	SendJobPtr job;
+	size_t spins = 0;
+
+	while (true) {
+		if (__atomic_exchange_n(&localNode_, false, __ATOMIC_ACQ_REL)) {
+			preferLocalNode();
+		}
+
+		if (ring_.pop(job)) {
+			__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+			if (__atomic_load_n(&full_, __ATOMIC_RELAXED)) {
+				boost::mutex::scoped_lock lock(roomLock_);
+				roomCondition_.notify_one();
+			}
+
+			if (job->newSet and count_ > 1) {
+				handover_->wait();
+			}
+
+			send(*job);
+			job.reset();
+			spins = 0;
+			continue;
+		}
+
+		if (__atomic_load_n(&stopping_, __ATOMIC_ACQUIRE)) {
+			break;
+		}
+
+		if (++spins < spin_) {
+			relaxWhileSpinning();
+			continue;
+		}
+
+		boost::mutex::scoped_lock lock(wakeLock_);
+
+		__atomic_store_n(&sleeping_, true, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+		if (ring_.empty() and not __atomic_load_n(&stopping_, __ATOMIC_ACQUIRE)) {
+			wakeCondition_.timed_wait(lock, boost::posix_time::milliseconds(SENDER_SLEEP_MS));
+		}
+
+		__atomic_store_n(&sleeping_, false, __ATOMIC_RELAXED);
+		spins = 0;
+	}
+}
+
+/*
+ * Write a packet to this sender's connections and publish the
+ * status of their ports.  A shed requested for a set the sender
+ * hasn't reached yet waits until it does
+ */
+void ConnectionSender::send(const SendJob &job)
+{
+	const std::vector<boost::shared_ptr<InternalConnection> > &connections = job.connections->connections;
+	boost::shared_ptr<std::vector<ConnectionStatus> > statuses(new std::vector<ConnectionStatus>);
+	boost::shared_ptr<const ShedRequest> request = boost::atomic_load(&shedRequest_);
+	std::vector<ConnectionStatus> returned;
+
+	if (request and request->connections == job.connections and boost::atomic_compare_exchange(&shedRequest_, &request, boost::shared_ptr<const ShedRequest>())) {
+		shedSlowest(connections, *budget_, request->index, connections.size());
+	}
+
+	for (size_t i = index_; i < connections.size(); i += count_) {
+		returned = connections[i]->writeByteSwap(job.data, *job.compressionStats);
+
+		statuses->insert(statuses->end(), returned.begin(), returned.end());
+	}
+
+	boost::atomic_store(&statuses_, boost::shared_ptr<const std::vector<ConnectionStatus> >(statuses));
+}
@@ -0,0 +1,106 @@
+#ifndef CONNECTIONSENDER_H_
+#define CONNECTIONSENDER_H_
+
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/barrier.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "SinkEngine.h"
+#include "spscring.h"
+
+// The longest an idle sender sleeps before checking again, in
+// milliseconds, in case a wake up is missed
+#define SENDER_SLEEP_MS 10
+
+/*
+ * One packet handed to the sender threads: the data of every
+ * output format and the connection set to write it to.  It
+ * is shared by every sender and never changed once published
+ */
+struct SendJob {
+	SendJob() :
+		newSet(false)
+	{}
+
+	// Shared by every packet until the statistics change
+	boost::shared_ptr<const compressionStatsMap> compressionStats;
+	ConnectionSetPtr connections;
+	outputDataMap data;
+	// The first packet for a new connection set.  The senders only
+	// start on it once all of them are done with the old one,
+	// since a copy of a connection shares its sockets with the
+	// original
+	bool newSet;
+};
+
+typedef boost::shared_ptr<const SendJob> SendJobPtr;
+
+// The connection of a set whose slowest port should be shed
+struct ShedRequest {
+	ConnectionSetPtr connections;
+	size_t index;
+};
+
+/*
+ * A thread that writes packets to every count-th connection of
+ * a set, starting at index, so the sends for different
+ * connections run in parallel.  The writing thread publishes
+ * jobs through a lock-free ring and only takes a lock to wake
+ * the sender when it has gone to sleep.  When the ring is full
+ * the writing thread sleeps until the sender makes room, which
+ * slows the input.  The senders of a data path share a barrier
+ * they meet at whenever the connection set changes.
+ *
+ * publish and the destructor may only be called from the
+ * writing thread
+ */
+class ConnectionSender
+{
+public:
+	ConnectionSender(size_t index, size_t count, size_t queueDepth, size_t spin, const boost::shared_ptr<MemoryBudget> &budget, const boost::shared_ptr<boost::barrier> &handover);
+	~ConnectionSender();
+
+	void publish(const SendJobPtr &job);
+
+	// Drop the data queued for the slowest port of a connection of
+	// the set before the next packet for that set is written
+	void shed(const ConnectionSetPtr &connections, size_t index);
+
+	// The status of each port as of the last packet sent
+	void statuses(std::vector<ConnectionStatus> &statuses) const;
+
+	bool setAffinity(const std::string &cpus);
+	std::string placement();
+
+private:
+	ConnectionSender(const ConnectionSender &copy);
+	ConnectionSender &operator=(const ConnectionSender &copy);
+
+	void run();
+	void send(const SendJob &job);
+	void wake();
+	void waitForRoom(const SendJobPtr &job);
+
+	boost::shared_ptr<MemoryBudget> budget_;
+	size_t count_;
+	bool full_;
+	boost::shared_ptr<boost::barrier> handover_;
+	size_t index_;
+	bool localNode_;
+	SpscRing<SendJobPtr> ring_;
+	boost::condition_variable roomCondition_;
+	boost::mutex roomLock_;
+	boost::shared_ptr<const ShedRequest> shedRequest_;
+	bool sleeping_;
+	size_t spin_;
+	boost::shared_ptr<const std::vector<ConnectionStatus> > statuses_;
+	bool stopping_;
+	boost::thread *thread_;
+	boost::condition_variable wakeCondition_;
+	boost::mutex wakeLock_;
+};
+
+#endif /* CONNECTIONSENDER_H_ */
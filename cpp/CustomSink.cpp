@@ -8,38 +8,172 @@
 **************************************************************************/
 
 #include "CustomSink.h"
-#include "vectorswap.h"
-#include <sstream>
+#include "batch.h"
 
-// Because the vector of internal connections must store pointers to avoid
-// reconnecting whenever the vector is resized, this operator must be
-// defined to search the vector.  In C++, move semantics could be used
-// and the pointers would be unnecessary
-bool operator==(const InternalConnection *lhs, const Connection_struct &rhs)
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+
+PREPARE_LOGGING(CustomSink_i)
+
+// A paced replay sleeps at most this long per service call
+#define REPLAY_MAX_SLEEP 0.01
+
+// While the input is throttled, each service call waits at most
+// this long for the sockets to drain
+#define THROTTLE_WAIT 0.1
+
+/*
+ * Pass messages from the core library to the component's logger
+ */
+static void logCoreMessage(CoreLogLevel level, const char *logger, const std::string &message)
 {
-	return (*lhs) == rhs;
+	switch (level) {
+	case CORE_LOG_TRACE:
+		LOG_TRACE(CustomSink_i, logger << ": " << message);
+		break;
+	case CORE_LOG_DEBUG:
+		LOG_DEBUG(CustomSink_i, logger << ": " << message);
+		break;
+	case CORE_LOG_INFO:
+		LOG_INFO(CustomSink_i, logger << ": " << message);
+		break;
+	case CORE_LOG_WARN:
+		LOG_WARN(CustomSink_i, logger << ": " << message);
+		break;
+	default:
+		LOG_ERROR(CustomSink_i, logger << ": " << message);
+		break;
+	}
 }
 
-PREPARE_LOGGING(CustomSink_i)
+static ConnectionConfig toConfig(const Connection_struct &connection)
+{
+	ConnectionConfig config;
+
+	config.connection_type = connection.connection_type;
+	config.ip_address = connection.ip_address;
+	config.byte_swap = connection.byte_swap;
+	config.ports = connection.ports;
+	config.output_format = connection.output_format;
+	config.scale_factor = connection.scale_factor;
+	config.compression = connection.compression;
+	config.rate_limit = connection.rate_limit;
+	config.burst_size = connection.burst_size;
+	config.distribution = connection.distribution;
+	config.stripe_size = connection.stripe_size;
+	config.inbound_mode = connection.inbound_mode;
+	config.inbound_buffer_size = connection.inbound_buffer_size;
+	config.read_chunk_size = connection.read_chunk_size;
+	config.port_ranges = connection.port_ranges;
+	config.connect_timeout = connection.connect_timeout;
+	config.coalesce_bytes = connection.coalesce_bytes;
+	config.coalesce_delay = connection.coalesce_delay;
+	config.slow_consumer_lag = connection.slow_consumer_lag;
+	config.slow_consumer_bytes = connection.slow_consumer_bytes;
+	config.slow_consumer_action = connection.slow_consumer_action;
+
+	return config;
+}
+
+static Connection_struct toStruct(const ConnectionConfig &config)
+{
+	Connection_struct connection;
+
+	connection.connection_type = config.connection_type;
+	connection.ip_address = config.ip_address;
+	connection.byte_swap = config.byte_swap;
+	connection.ports = config.ports;
+	connection.output_format = config.output_format;
+	connection.scale_factor = config.scale_factor;
+	connection.compression = config.compression;
+	connection.rate_limit = config.rate_limit;
+	connection.burst_size = config.burst_size;
+	connection.distribution = config.distribution;
+	connection.stripe_size = config.stripe_size;
+	connection.inbound_mode = config.inbound_mode;
+	connection.inbound_buffer_size = config.inbound_buffer_size;
+	connection.read_chunk_size = config.read_chunk_size;
+	connection.port_ranges = config.port_ranges;
+	connection.connect_timeout = config.connect_timeout;
+	connection.coalesce_bytes = config.coalesce_bytes;
+	connection.coalesce_delay = config.coalesce_delay;
+	connection.slow_consumer_lag = config.slow_consumer_lag;
+	connection.slow_consumer_bytes = config.slow_consumer_bytes;
+	connection.slow_consumer_action = config.slow_consumer_action;
+
+	return connection;
+}
+
+/*
+ * Convert the status of every port to the property type.  The
+ * strings are swapped out of the statuses to avoid copying them
+ */
+static void toStats(std::vector<ConnectionStatus> &statuses, std::vector<ConnectionStat_struct> &stats)
+{
+	stats.resize(statuses.size());
+
+	for (size_t i = 0; i < statuses.size(); ++i) {
+		ConnectionStatus &status = statuses[i];
+		ConnectionStat_struct &stat = stats[i];
+
+		stat.ip_address.swap(status.ip_address);
+		stat.port = status.port;
+		stat.status.swap(status.status);
+		stat.bytes_per_second = status.bytes_per_second;
+		stat.bytes_sent = status.bytes_sent;
+		stat.compression_ratio = status.compression_ratio;
+		stat.compression_cpu_time = status.compression_cpu_time;
+		stat.pacing_delay = status.pacing_delay;
+		stat.bytes_dropped = status.bytes_dropped;
+		stat.packets_dropped = status.packets_dropped;
+		stat.slow_consumers = status.slow_consumers;
+	}
+}
+
+static double monotonicNow()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Convert a stage's cycle counts to a total in seconds and an
+ * average and maximum in microseconds
+ */
+static void stageTimes(const StageCounter &counter, double secondsPerCycle, double &total, double &average, double &maximum)
+{
+	total = counter.cycles * secondsPerCycle;
+	average = counter.count ? total * 1e6 / counter.count : 0;
+	maximum = counter.maxCycles * secondsPerCycle * 1e6;
+}
 
 CustomSink_i::CustomSink_i(const char *uuid, const char *label) :
     CustomSink_base(uuid, label)
 {
 	bytesPerSecTemp = 0;
 	bytes_per_sec = 0;
-	onlyByteSwaps = false;
-	performByteSwap = false;
+	resetRequested = false;
+	serviceThread = pthread_t();
+	servicePlacement = "not started";
 	totalBytesTemp = 0;
 	total_bytes = 0;
+
+	setCoreLogHandler(logCoreMessage, CORE_LOG_DEBUG);
 }
 
 CustomSink_i::~CustomSink_i()
 {
-	boost::recursive_mutex::scoped_lock lock(socketsLock_);
-
-	for (std::vector<InternalConnection *>::iterator i = internalConnections.begin(); i != internalConnections.end(); ++i) {
-		delete *i;
-	}
+	dropHeldPacket(dataOctet_in);
+	dropHeldPacket(dataChar_in);
+	dropHeldPacket(dataShort_in);
+	dropHeldPacket(dataUshort_in);
+	dropHeldPacket(dataLong_in);
+	dropHeldPacket(dataUlong_in);
+	dropHeldPacket(dataFloat_in);
+	dropHeldPacket(dataDouble_in);
 }
 
 void CustomSink_i::constructor()
@@ -49,244 +183,377 @@ void CustomSink_i::constructor()
     ***********************************************************************************/
 	ConnectionsChanged(NULL,&Connections); // apply initial property configuration
 	addPropertyChangeListener("Connections", this, &CustomSink_i::ConnectionsChanged);
+	addPropertyChangeListener("reset_performance_counters", this, &CustomSink_i::resetPerformanceCountersChanged);
+
+	memoryBudgetPolicyChanged(NULL, &memory_budget_policy);
+	addPropertyChangeListener("memory_budget", this, &CustomSink_i::memoryBudgetChanged);
+	addPropertyChangeListener("memory_budget_policy", this, &CustomSink_i::memoryBudgetPolicyChanged);
+
+	losslessChanged(NULL, &lossless);
+	addPropertyChangeListener("lossless", this, &CustomSink_i::losslessChanged);
+	addPropertyChangeListener("backpressure_high_watermark", this, &CustomSink_i::watermarkChanged);
+	addPropertyChangeListener("backpressure_low_watermark", this, &CustomSink_i::watermarkChanged);
+
+	serviceCpusChanged(NULL, &service_cpus);
+	addPropertyChangeListener("service_cpus", this, &CustomSink_i::serviceCpusChanged);
+	ioCpusChanged(NULL, &io_cpus);
+	addPropertyChangeListener("io_cpus", this, &CustomSink_i::ioCpusChanged);
+	senderThreadsChanged(NULL, &sender_threads);
+	addPropertyChangeListener("sender_threads", this, &CustomSink_i::senderThreadsChanged);
+	addPropertyChangeListener("sender_queue_depth", this, &CustomSink_i::senderThreadsChanged);
+	addPropertyChangeListener("sender_spin", this, &CustomSink_i::senderThreadsChanged);
+	addPropertyChangeListener("sender_cpus", this, &CustomSink_i::senderCpusChanged);
+
+	captureFileChanged(NULL, &capture_file);
+	addPropertyChangeListener("capture_file", this, &CustomSink_i::captureFileChanged);
+	replayFileChanged(NULL, &replay_file);
+	addPropertyChangeListener("replay_file", this, &CustomSink_i::replayFileChanged);
 }
 
-template<typename T, typename U>
-void CustomSink_i::createByteSwappedVector(const std::vector<T, U> &original, unsigned short byteSwap) {
-	unsigned int numSwap = byteSwap;
-	size_t dataSize = sizeof(T);
+/*
+ * The buffer arena is mapped and faulted in by the service
+ * thread, once it is pinned, before it takes the first packet.
+ * That way its pages come from the thread's own node, and the
+ * first packets still see steady state latency
+ */
+void CustomSink_i::start() throw (CF::Resource::StartError, CORBA::SystemException)
+{
+	ArenaRequest *request = new ArenaRequest;
 
-	// If 1 is requested, use the word size associated with the data
-	if (numSwap == 1) {
-		numSwap = dataSize;
+	if (not parseArenaPages(buffer_arena_pages, request->pages)) {
+		LOG_WARN(CustomSink_i, "Unknown buffer arena pages \"" << buffer_arena_pages << "\", using transparent");
+		request->pages = ARENA_PAGES_TRANSPARENT;
 	}
 
-	size_t numBytes = original.size() * dataSize;
-	size_t oldLeftoverSize = leftovers[typeid(T).name()][byteSwap].size();
-	size_t totalSize = numBytes + oldLeftoverSize;
-	size_t newLeftoverSize;
+	request->bytes = size_t(std::max(buffer_arena_size, 0.0));
+	request->lock = buffer_arena_lock;
+
+	boost::atomic_store(&arenaRequest, boost::shared_ptr<const ArenaRequest>(request));
 
-	// Create the vector to hold the swapped data
-	std::vector<char> newData;
+	CustomSink_base::start();
+}
 
-	// Make sure to send an exact multiple of numSwap if it's greater than 1
-	if (numSwap > 1) {
-		newLeftoverSize = totalSize % numSwap;
+void CustomSink_i::ConnectionsChanged(const std::vector<Connection_struct> *oldValue, const std::vector<Connection_struct> *newValue)
+{
+	std::vector<ConnectionConfig> requested;
+	std::vector<ConnectionConfig> applied;
+	std::vector<ConnectionStatus> statuses;
 
-		if (numSwap != dataSize) {
-			LOG_WARN(CustomSink_i, "Data size of " << dataSize << " is not equal to byte swap size  of " << numSwap <<".");
-		}
-	} else {
-		newLeftoverSize = 0;
+	for (std::vector<Connection_struct>::const_iterator i = newValue->begin(); i != newValue->end(); ++i) {
+		requested.push_back(toConfig(*i));
 	}
 
-	//Don't have to deal with leftover data.  This should be the typical case
-	if (newLeftoverSize == 0 && oldLeftoverSize == 0) {
-		if (numSwap > 1) {
-			newData.resize(numBytes);
-			vectorSwap(reinterpret_cast<const char *>(original.data()), newData, numSwap);
-			byteSwapped[typeid(T).name()][byteSwap] = newData;
-		}
+	engine.configure(requested, applied, statuses);
+
+	// Set the property to match the clean and duplicate free version
+	std::vector<Connection_struct> connections;
+
+	for (std::vector<ConnectionConfig>::const_iterator i = applied.begin(); i != applied.end(); ++i) {
+		connections.push_back(toStruct(*i));
 	}
-	else
-	{
-		LOG_WARN(CustomSink_i, "Byte swapping and packet sizes are not compatible.  Swapping bytes over adjacent packets");
 
-		newData.reserve(totalSize - newLeftoverSize);
-		newData.insert(newData.begin(), leftovers[typeid(T).name()][byteSwap].begin(), leftovers[typeid(T).name()][byteSwap].end());
-		newData.insert(newData.begin() + oldLeftoverSize, reinterpret_cast<const char *>(original.data()), reinterpret_cast<const char *>(original.data()) + numBytes - newLeftoverSize);
+	Connections = connections;
 
-		if (numSwap > 1) {
-			vectorSwap(newData, numSwap);
-		}
+	std::vector<ConnectionStat_struct> stats;
+	toStats(statuses, stats);
 
-		byteSwapped[typeid(T).name()][byteSwap] = newData;
-		leftovers[typeid(T).name()][byteSwap].clear();
+	{
+		boost::mutex::scoped_lock statisticsLock(statisticsLock_);
 
-		// If we have new leftovers, populate it now
-		if (newLeftoverSize != 0) {
-			leftovers[typeid(T).name()][byteSwap].insert(leftovers[typeid(T).name()][byteSwap].begin(), reinterpret_cast<const char *>(original.data()) + numBytes - newLeftoverSize, reinterpret_cast<const char *>(original.data()) + numBytes);
-		}
+		ConnectionStats.swap(stats);
 	}
+
+	publishPlacement();
 }
 
-void CustomSink_i::ConnectionsChanged(const std::vector<Connection_struct> *oldValue, const std::vector<Connection_struct> *newValue)
+/*
+ * The counters belong to the service thread, so it is asked to
+ * clear them the next time it publishes
+ */
+void CustomSink_i::resetPerformanceCountersChanged(const bool *oldValue, const bool *newValue)
 {
-	// First, clear out any server IP addresses and make sure the byte
-	// swap and port lists are the same size
-	std::vector<Connection_struct> cleanList;
+	if (*newValue) {
+		__atomic_store_n(&resetRequested, true, __ATOMIC_RELEASE);
+		reset_performance_counters = false;
+	}
+}
 
-	for (std::vector<Connection_struct>::const_iterator i = newValue->begin(); i != newValue->end(); ++i) {
-		Connection_struct cleaned = *i;
+void CustomSink_i::memoryBudgetChanged(const double *oldValue, const double *newValue)
+{
+	memoryBudgetPolicyChanged(NULL, &memory_budget_policy);
+}
 
-		// Adjust the byte swap size to match the number of ports
-		if (cleaned.ports.size() != cleaned.byte_swap.size()) {
-			LOG_WARN(CustomSink_i, "Port list and Byte Swap list differ in size, resizing");
+void CustomSink_i::memoryBudgetPolicyChanged(const std::string *oldValue, const std::string *newValue)
+{
+	BudgetPolicy policy;
 
-			cleaned.byte_swap.resize(cleaned.ports.size(), 0);
-		}
+	if (not parseBudgetPolicy(*newValue, policy)) {
+		LOG_WARN(CustomSink_i, "Unknown memory budget policy \"" << *newValue << "\", using shed_slowest");
+		policy = BUDGET_SHED_SLOWEST;
+	}
 
-		// Remove the IP address for a server connection
-		if (cleaned.connection_type == "server" && cleaned.ip_address != "") {
-			LOG_WARN(CustomSink_i, "IP Address specified for server connection, removing");
+	engine.setMemoryBudget(size_t(std::max(memory_budget, 0.0)), policy);
+}
 
-			cleaned.ip_address = "";
-		}
+void CustomSink_i::losslessChanged(const bool *oldValue, const bool *newValue)
+{
+	double high = std::max(backpressure_high_watermark, 0.0);
+	double low = std::max(backpressure_low_watermark, 0.0);
+
+	if (*newValue and high == 0) {
+		LOG_WARN(CustomSink_i, "Lossless mode has no high watermark, so the input is never throttled");
+	}
 
-		cleanList.push_back(cleaned);
+	if (*newValue and low > high) {
+		LOG_WARN(CustomSink_i, "The low watermark is above the high watermark, using " << high);
 	}
 
-	// Now coalesce any servers or clients with duplicate information
-	std::vector<Connection_struct> duplicateFree;
+	engine.setFlowControl(*newValue, size_t(high), size_t(low));
+}
 
-	for (std::vector<Connection_struct>::const_iterator i = cleanList.begin(); i != cleanList.end(); ++i) {
-		bool found = false;
-		std::vector<Connection_struct>::iterator j;
+void CustomSink_i::watermarkChanged(const double *oldValue, const double *newValue)
+{
+	losslessChanged(NULL, &lossless);
+}
 
-		// Check if the duplicate list already contains an entry with
-		// a matching connection type and IP
-		for (j = duplicateFree.begin(); j != duplicateFree.end(); ++j) {
-			if (i->connection_type == j->connection_type && i->ip_address == j->ip_address) {
-				found = true;
-				break;
-			}
+/*
+ * A thread can only be pinned by itself, so the service thread
+ * picks up the new CPUs the next time it runs
+ */
+void CustomSink_i::serviceCpusChanged(const std::string *oldValue, const std::string *newValue)
+{
+	boost::atomic_store(&serviceCpus, boost::shared_ptr<const std::string>(new std::string(*newValue)));
+}
+
+void CustomSink_i::ioCpusChanged(const std::string *oldValue, const std::string *newValue)
+{
+	engine.setIoCpus(*newValue);
+	publishPlacement();
+}
+
+/*
+ * The service thread restarts the senders with the new settings
+ * before its next packet
+ */
+void CustomSink_i::senderThreadsChanged(const CORBA::ULong *oldValue, const CORBA::ULong *newValue)
+{
+	engine.setSenders(sender_threads, sender_queue_depth, sender_spin, sender_cpus);
+}
+
+void CustomSink_i::senderCpusChanged(const std::string *oldValue, const std::string *newValue)
+{
+	senderThreadsChanged(NULL, &sender_threads);
+}
+
+/*
+ * Start a new capture, or stop capturing.  The service thread
+ * finishes any packet it is writing to the old capture, which
+ * is closed when it lets go of it
+ */
+void CustomSink_i::captureFileChanged(const std::string *oldValue, const std::string *newValue)
+{
+	boost::shared_ptr<CaptureWriter> writer;
+
+	if (not newValue->empty()) {
+		writer.reset(new CaptureWriter());
+
+		if (writer->open(*newValue, capture_max_bytes)) {
+			LOG_INFO(CustomSink_i, "Capturing packets to " << *newValue);
+		} else {
+			writer.reset();
 		}
+	}
 
-		// Augment the existing entry to contain the new data
-		if (found) {
-			Connection_struct combined;
-
-			combined.connection_type = j->connection_type;
-			combined.ip_address = j->ip_address;
-
-			// Vectors used for combining and preserving the order
-			// of the ports and byte swaps lists
-			std::vector<unsigned short> newPorts;
-			std::vector<unsigned short> oldPorts;
-			std::vector<unsigned short> newByteSwaps;
-			std::vector<unsigned short> oldByteSwaps;
-
-			oldPorts.insert(oldPorts.end(), i->ports.begin(), i->ports.end());
-			oldPorts.insert(oldPorts.end(), j->ports.begin(), j->ports.end());
-			oldByteSwaps.insert(oldByteSwaps.end(), i->byte_swap.begin(), i->byte_swap.end());
-			oldByteSwaps.insert(oldByteSwaps.end(), j->byte_swap.begin(), j->byte_swap.end());
-
-			while (oldPorts.size() != 0) {
-				int counter = 0;
-				unsigned int minSoFar = 65536;
-				std::vector<unsigned short>::iterator minPort;
-				std::vector<unsigned short>::iterator correspondingByteSwap;
-
-				// Search for the minimum port in the current list and
-				// make note of its position and the position of its
-				// corresponding byte_swap value
-				for (std::vector<unsigned short>::iterator i = oldPorts.begin(); i != oldPorts.end(); ++i, ++counter) {
-					if (*i < minSoFar) {
-						minSoFar = *i;
-						minPort = i;
-						correspondingByteSwap = oldByteSwaps.begin() + counter;
-					}
-				}
-
-				// Add the port and byte swap values to the new vectors
-				newPorts.insert(newPorts.end(), *minPort);
-				newByteSwaps.insert(newByteSwaps.end(), *correspondingByteSwap);
-
-				// Remove the port and byte swap values from the old vectors
-				oldPorts.erase(minPort);
-				oldByteSwaps.erase(correspondingByteSwap);
-			}
+	boost::atomic_store(&captureWriter, writer);
+}
 
-			// Set the entry's values
-			combined.ports = newPorts;
-			combined.byte_swap = newByteSwaps;
+void CustomSink_i::replayFileChanged(const std::string *oldValue, const std::string *newValue)
+{
+	boost::shared_ptr<Replay> replaying;
 
-			*j = combined;
+	if (not newValue->empty()) {
+		replaying.reset(new Replay());
+		replaying->paced = replay_paced;
+
+		if (replaying->reader.open(*newValue)) {
+			LOG_INFO(CustomSink_i, "Replaying " << *newValue << (replaying->paced ? " at the captured pace" : " as fast as possible"));
 		} else {
-			// A matching entry wasn't found, add it to the back of the list
-			duplicateFree.push_back(*i);
+			replaying.reset();
 		}
 	}
 
-	// Set the property to match the clean and duplicate free version
-	Connections = duplicateFree;
+	boost::atomic_store(&replay, replaying);
+}
 
-	boost::recursive_mutex::scoped_lock lock(socketsLock_);
+/*
+ * Send compressed frames that finished after their packet was
+ * processed.  Called when no new data arrived so the tail of
+ * a stream isn't held back until the next packet
+ */
+int CustomSink_i::sendCompressedFrames()
+{
+	std::vector<ConnectionStatus> statuses;
 
-	// Reinitialize the onlyByteSwaps and performByteSwap members
-	// and then set them appropriately
-	onlyByteSwaps = true;
-	performByteSwap = false;
+	if (engine.flush(statuses)) {
+		publishStatistics(statuses);
+	}
 
-	// Keep a list of stats to populate the ConnectionStats property
-	std::vector<ConnectionStat_struct> stats;
-	std::vector<ConnectionStat_struct> returned;
+	return engine.framesPending() ? NORMAL : NOOP;
+}
 
-	// Add and update the current connections
-	for (std::vector<Connection_struct>::const_iterator i = duplicateFree.begin(); i != duplicateFree.end(); ++i) {
-		std::vector<InternalConnection *>::iterator found = find(internalConnections.begin(), internalConnections.end(), *i);
+/*
+ * Pin the service thread when the CPUs change, or when a restart
+ * brings up a new thread, and have it allocate the swap and queue
+ * buffers from its own node.  An empty list leaves the thread's
+ * placement and memory policy alone, unless it was pinned here
+ * before, in which case that is undone
+ */
+void CustomSink_i::pinServiceThread()
+{
+	boost::shared_ptr<const std::string> cpus = boost::atomic_load(&serviceCpus);
+	bool sameThread = pthread_equal(serviceThread, pthread_self());
 
-		// This is a brand new connection
-		if (found == internalConnections.end()) {
-			LOG_DEBUG(CustomSink_i, "Adding new internal connection");
-			internalConnections.push_back(new InternalConnection());
+	if (not cpus or (cpus == serviceCpusApplied and sameThread)) {
+		return;
+	}
 
-			returned = internalConnections.back()->setConnection(*i);
-		} else {
-			LOG_DEBUG(CustomSink_i, "Updating existing internal connection");
-			// A connection with this same connection type and IP exists
-			// so only update the relevant information to preserve
-			// existing connections
-			returned = (*found)->setConnection(*i);
-		}
+	bool pinnedHere = sameThread and serviceCpusApplied and not serviceCpusApplied->empty();
 
-		stats.insert(stats.end(), returned.begin(), returned.end());
+	serviceCpusApplied = cpus;
+	serviceThread = pthread_self();
 
-		// Set the onlyByteSwaps flag if necessary
-		if (onlyByteSwaps) {
-			for (std::vector<unsigned short>::const_iterator j = i->byte_swap.begin(); j != i->byte_swap.end(); ++j) {
-				if (not (onlyByteSwaps &= (*j != 0))) {
-					break;
-				}
-			}
+	if (not cpus->empty()) {
+		if (pinThread(serviceThread, *cpus)) {
+			preferLocalNode();
 		}
-
-		// Set the performByteSwap flag if necessary
-		if (not performByteSwap) {
-			for (std::vector<unsigned short>::const_iterator j = i->byte_swap.begin(); j != i->byte_swap.end(); ++j) {
-				if ((performByteSwap |= (*j != 0))) {
-					break;
-				}
-			}
+	} else if (pinnedHere) {
+		if (pinThread(serviceThread, *cpus)) {
+			resetMemoryPolicy();
 		}
 	}
 
-	ConnectionStats = stats;
+	{
+		boost::mutex::scoped_lock lock(statisticsLock_);
+		servicePlacement = describePlacement(serviceThread);
+	}
+
+	publishPlacement();
+}
 
-	// Remove from the current connections
-	if (oldValue != NULL){
-		for (std::vector<Connection_struct>::const_iterator i = oldValue->begin(); i != oldValue->end(); ++i) {
-			// If the value exists in the old property but not in the duplicate
-			// free version, it has been removed
-			if (find(duplicateFree.begin(), duplicateFree.end(), *i) == duplicateFree.end()) {
-				std::vector<InternalConnection *>::iterator found = find(internalConnections.begin(), internalConnections.end(), *i);
+// Reserve the buffer arena start() asked for, if it hasn't been
+void CustomSink_i::reserveArena()
+{
+	boost::shared_ptr<const ArenaRequest> request = boost::atomic_exchange(&arenaRequest, boost::shared_ptr<const ArenaRequest>());
 
-				// If found, delete and remove the entry
-				if (found != internalConnections.end()) {
-					delete *found;
-					internalConnections.erase(found);
-				} else {
-					LOG_ERROR(CustomSink_i, "Unable to find connection data for removal");
-				}
-			}
-		}
+	if (not request) {
+		return;
+	}
+
+	if (BufferArena::instance().reserve(request->bytes, request->pages, request->lock) and request->bytes) {
+		LOG_INFO(CustomSink_i, "Reserved a " << request->bytes << " byte buffer arena");
+	}
+}
+
+void CustomSink_i::publishPlacement()
+{
+	std::vector<std::string> placement;
+
+	engine.ioPlacement(placement);
+
+	boost::mutex::scoped_lock lock(statisticsLock_);
+
+	placement.insert(placement.begin(), "service: " + servicePlacement);
+	thread_placement.swap(placement);
+}
+
+/*
+ * Update the properties from the statistics of every connection.
+ * The statistics are swapped into the property, so the lock is
+ * only held for a moment however many ports there are
+ */
+void CustomSink_i::publishStatistics(std::vector<ConnectionStatus> &statuses)
+{
+	unsigned long long start = readCycles();
+	std::vector<ConnectionStat_struct> stats;
+	PerformanceCounters_struct counters;
+
+	bytesPerSecTemp = 0;
+	totalBytesTemp = 0;
+
+	for (std::vector<ConnectionStatus>::const_iterator i = statuses.begin(); i != statuses.end(); ++i) {
+		bytesPerSecTemp += i->bytes_per_second;
+		totalBytesTemp += i->bytes_sent;
+	}
+
+	toStats(statuses, stats);
+
+	if (__atomic_exchange_n(&resetRequested, false, __ATOMIC_ACQ_REL)) {
+		engine.resetCounters();
+		ingestTime.reset();
+		statsTime.reset();
+	}
+
+	double arenaMisses = BufferArena::instance().misses();
+	double arenaUsed = BufferArena::instance().used();
+	double memoryHighWater = engine.memoryHighWater();
+	double memoryUsed = engine.memoryUsed();
+	double secondsPerCycle = cycleClock.secondsPerCycle();
+
+	counters.packets = ingestTime.count;
+	stageTimes(ingestTime, secondsPerCycle, counters.ingest_total, counters.ingest_average, counters.ingest_max);
+	stageTimes(engine.swapCounter(), secondsPerCycle, counters.swap_total, counters.swap_average, counters.swap_max);
+	stageTimes(engine.sendCounter(), secondsPerCycle, counters.send_total, counters.send_average, counters.send_max);
+	stageTimes(statsTime, secondsPerCycle, counters.stats_total, counters.stats_average, counters.stats_max);
+
+	{
+		boost::mutex::scoped_lock lock(statisticsLock_);
+
+		buffer_arena_misses = arenaMisses;
+		buffer_arena_used = arenaUsed;
+		bytes_per_sec = bytesPerSecTemp;
+		ConnectionStats.swap(stats);
+		PerformanceCounters = counters;
+		memory_high_water = memoryHighWater;
+		memory_used = memoryUsed;
+		throttled = engine.throttled();
+		total_bytes = totalBytesTemp;
 	}
+
+	statsTime.add(readCycles() - start);
 }
 
 int CustomSink_i::serviceFunction()
 {
 	  int ret = 0;
 
+	  pinServiceThread();
+	  reserveArena();
+
+	  if (engine.applySenders())
+	  {
+		  publishPlacement();
+	  }
+
+	  // In lossless mode the packets wait upstream while the
+	  // sockets catch up
+	  if (not engine.readyForPacket(THROTTLE_WAIT))
+	  {
+		  boost::mutex::scoped_lock lock(statisticsLock_);
+		  memory_used = engine.memoryUsed();
+		  throttled = true;
+		  lock.unlock();
+
+		  return engine.framesPending() ? sendCompressedFrames() : NORMAL;
+	  }
+
+	  // A replay takes the place of the input ports until it finishes
+	  boost::shared_ptr<Replay> replaying = boost::atomic_load(&replay);
+
+	  if (replaying && not replaying->finished)
+	  {
+		  return replayPacket(*replaying);
+	  }
+
 	  ret += serviceFunctionT(dataOctet_in);
 	  ret += serviceFunctionT(dataChar_in);
 	  ret += serviceFunctionT(dataShort_in);
@@ -298,111 +565,258 @@ int CustomSink_i::serviceFunction()
 
 	  if (ret > 1)
 	  {
-		  LOG_WARN(CustomSink_i, "More than one data port received data");
+		  CORE_LOG_WARN_EVERY(CustomSink_i, "More than one data port received data");
 	  	  return NORMAL;
 	  }
 
+	  if (ret == NOOP && engine.framesPending())
+	  {
+		  return sendCompressedFrames();
+	  }
+
 	  return ret;
 }
 
+/*
+ * Feed the next packet of a replay through the data path, once
+ * it is due
+ */
+int CustomSink_i::replayPacket(Replay &replaying)
+{
+	if (not replaying.havePacket) {
+		if (not replaying.reader.next(replaying.packet)) {
+			LOG_INFO(CustomSink_i, "Replay finished");
+			replaying.finished = true;
+			return NOOP;
+		}
+
+		if (replaying.start == 0) {
+			replaying.start = monotonicNow() - replaying.packet.arrival;
+		}
+
+		replaying.havePacket = true;
+	}
+
+	if (replaying.paced) {
+		double wait = replaying.start + replaying.packet.arrival - monotonicNow();
+
+		if (wait > 0) {
+			usleep(long(std::min(wait, REPLAY_MAX_SLEEP) * 1e6));
+
+			if (wait > REPLAY_MAX_SLEEP) {
+				return NORMAL;
+			}
+		}
+	}
+
+	replaying.havePacket = false;
+
+	switch (replaying.packet.type) {
+	case CAPTURE_OCTET:
+		replayAs<unsigned char>(replaying.packet);
+		break;
+	case CAPTURE_CHAR:
+		replayAs<char>(replaying.packet);
+		break;
+	case CAPTURE_SHORT:
+		replayAs<int16_t>(replaying.packet);
+		break;
+	case CAPTURE_USHORT:
+		replayAs<uint16_t>(replaying.packet);
+		break;
+	case CAPTURE_LONG:
+		replayAs<int32_t>(replaying.packet);
+		break;
+	case CAPTURE_ULONG:
+		replayAs<uint32_t>(replaying.packet);
+		break;
+	case CAPTURE_FLOAT:
+		replayAs<float>(replaying.packet);
+		break;
+	case CAPTURE_DOUBLE:
+		replayAs<double>(replaying.packet);
+		break;
+	}
+
+	return NORMAL;
+}
+
+template<typename T>
+void CustomSink_i::replayAs(const CapturedPacket &packet)
+{
+	unsigned long long start = readCycles();
+	std::vector<T> data(packet.size / sizeof(T));
+
+	memcpy(data.data(), packet.data, data.size() * sizeof(T));
+
+	SINK_PROBE3(packet_arrival, packet.size, packet.streamID.c_str(), sizeof(T));
+
+	if (packet.flags & CAPTURE_QUEUE_FLUSHED) {
+		CORE_LOG_WARN_EVERY(CustomSink_i, "Input Queue Flushed");
+	}
+
+	processPacket(data, packet.streamID, start);
+}
+
+/*
+ * Record a packet if a capture is running
+ */
+template<typename T, typename U, typename P>
+void CustomSink_i::capturePacket(const std::vector<T, U> &data, const P &packet)
+{
+	boost::shared_ptr<CaptureWriter> writer = boost::atomic_load(&captureWriter);
+
+	if (not writer) {
+		return;
+	}
+
+	CapturedPacket captured;
+
+	captured.data = reinterpret_cast<const char *>(data.data());
+	captured.flags = (packet.EOS ? CAPTURE_EOS : 0) | (packet.inputQueueFlushed ? CAPTURE_QUEUE_FLUSHED : 0);
+	captured.size = data.size() * sizeof(T);
+	captured.streamID = packet.streamID;
+	captured.type = captureDataType<T>();
+
+	captured.time.tcmode = packet.T.tcmode;
+	captured.time.tcstatus = packet.T.tcstatus;
+	captured.time.toff = packet.T.toff;
+	captured.time.twsec = packet.T.twsec;
+	captured.time.tfsec = packet.T.tfsec;
+
+	if (packet.sriChanged) {
+		captured.flags |= CAPTURE_SRI_CHANGED | CAPTURE_HAS_SRI;
+	}
+
+	captured.sri.hversion = packet.SRI.hversion;
+	captured.sri.xstart = packet.SRI.xstart;
+	captured.sri.xdelta = packet.SRI.xdelta;
+	captured.sri.xunits = packet.SRI.xunits;
+	captured.sri.subsize = packet.SRI.subsize;
+	captured.sri.ystart = packet.SRI.ystart;
+	captured.sri.ydelta = packet.SRI.ydelta;
+	captured.sri.yunits = packet.SRI.yunits;
+	captured.sri.mode = packet.SRI.mode;
+	captured.sri.blocking = packet.SRI.blocking;
+
+	writer->write(captured);
+}
+
+/*
+ * Write one packet, or a batch of packets joined together, to
+ * every connection and publish the results.  start is when the
+ * first packet was seen, for the ingest time
+ */
+template<typename T, typename U>
+void CustomSink_i::processPacket(std::vector<T, U> &data, const std::string &streamID, unsigned long long start, size_t packets)
+{
+	// Keep a list of stats to populate the ConnectionStats property
+	std::vector<ConnectionStatus> statuses;
+
+	ingestTime.add(readCycles() - start, packets);
+	engine.write(data, statuses, streamID);
+
+	// Update the properties
+	publishStatistics(statuses);
+}
+
 template<typename T>
 int CustomSink_i::serviceFunctionT(T* inputPort)
 {
 	LOG_TRACE(CustomSink_i, __PRETTY_FUNCTION__);
-	//typename T::dataTransfer *packet = inputPort->getPacket(0.0);
-	typename T::dataTransfer *packet = (typename T::dataTransfer *)"Hello i am SigGen....!";
-        LOG_INFO(CustomSink_i, "Data Received" << packet);
+	unsigned long long start = readCycles();
+	typename T::dataTransfer *packet = takeHeldPacket(inputPort);
 
 	if (not packet) {
-        	LOG_INFO(CustomSink_i, "DEBUG 1");
-		return NOOP;
+		packet = inputPort->getPacket(0.0);
 	}
 
-	if (packet->inputQueueFlushed) {
-        	LOG_INFO(CustomSink_i, "DEBUG 2");
-		LOG_WARN(CustomSink_i, "Input Queue Flushed");
+	if (not packet) {
+		return NOOP;
 	}
 
-	boost::recursive_mutex::scoped_lock lock(socketsLock_);
+	// Drain whatever else is already queued, up to the batch
+	// limits, onto the end of the first packet.  The output is the
+	// same byte stream as sending them one at a time, with one
+	// write per connection and one statistics update.  A packet
+	// that can't join the batch is held for the next call, so the
+	// other ports and the flow control checks get their turn
+	// between batches
+	std::vector<typename T::dataTransfer *> batch(1, packet);
+	size_t bytes = packet->dataBuffer.size() * sizeof(packet->dataBuffer[0]);
 
-	// Keep a list of stats to populate the ConnectionStats property
-	std::vector<ConnectionStat_struct> stats;
-	std::vector<ConnectionStat_struct> returned;
-
-	// Avoid unnecessary processing and allocation if no byte swaps
-	// are being performed
-        LOG_INFO(CustomSink_i, "DEBUG 3");
-	if (performByteSwap) {
-		// Use the data type as the key into the byteSwapped and
-		// leftovers member maps
-		std::string byteSwapKey = typeid(packet->dataBuffer[0]).name();
-
-        	LOG_INFO(CustomSink_i, "DEBUG 4");
-		// This copy isn't necessary if all of the connections require
-		// byte swaps
-		if (not onlyByteSwaps) {
-        		LOG_INFO(CustomSink_i, "DEBUG 5");
-			byteSwapped[byteSwapKey][0] = std::vector<char>(reinterpret_cast<char *>(packet->dataBuffer.data()),reinterpret_cast<char *>(packet->dataBuffer.data()) + packet->dataBuffer.size() * sizeof(packet->dataBuffer[0]));
-		}
+	receivePacket(*packet);
 
-		// Iterate through the internal connections, building the byte
-		// swapped vectors as necessary.  This should prevent multiple
-		// byte swaps for the same byte swap values from being performed
-		// in the same service function call
-        	LOG_INFO(CustomSink_i, "DEBUG 6");
-		for (std::vector<InternalConnection *>::iterator i = internalConnections.begin(); i != internalConnections.end(); ++i) {
-			std::vector<unsigned short> byteSwaps = (*i)->getByteSwaps();
-
-        		LOG_INFO(CustomSink_i, "DEBUG 7");
-			for (std::vector<unsigned short>::iterator j = byteSwaps.begin(); j != byteSwaps.end(); ++j) {
-        			LOG_INFO(CustomSink_i, "DEBUG 8");
-				if (*j != 0) {
-        				LOG_INFO(CustomSink_i, "DEBUG 9");
-					if (byteSwapped[byteSwapKey].find(*j) == byteSwapped[byteSwapKey].end()) {
-        					LOG_INFO(CustomSink_i, "DEBUG 9");
-						createByteSwappedVector(packet->dataBuffer, *j);
-					}
-				}
-			}
+	while (batch.size() < batch_max_packets and bytes < batch_max_bytes and engine.roomForBatch(bytes) and not batch.back()->EOS) {
+		typename T::dataTransfer *next = inputPort->getPacket(0.0);
 
-			returned = (*i)->writeByteSwap(byteSwapped[byteSwapKey]);
+		if (not next) {
+			break;
+		}
 
-			stats.insert(stats.end(), returned.begin(), returned.end());
+		if (not joinable(*batch.back(), *next)) {
+			heldPackets[inputPort] = next;
+			break;
 		}
 
-		byteSwapped[byteSwapKey].clear();
-	} else {
-		// Iterate through the internal connections and write the data buffer
-        	LOG_INFO(CustomSink_i, "DEBUG 10");
-		for (std::vector<InternalConnection *>::iterator i = internalConnections.begin(); i != internalConnections.end(); ++i) {
-			returned = (*i)->write(packet->dataBuffer);
-        		LOG_INFO(CustomSink_i, "DEBUG 11");
+		receivePacket(*next);
+		bytes += next->dataBuffer.size() * sizeof(next->dataBuffer[0]);
+		batch.push_back(next);
+	}
 
-			stats.insert(stats.end(), returned.begin(), returned.end());
-		}
+	joinPackets(batch);
+	processPacket(batch[0]->dataBuffer, batch[0]->streamID, start, batch.size());
+
+	for (size_t i = 0; i != batch.size(); ++i) {
+		delete batch[i];
 	}
 
-	// Update the properties
-	bytesPerSecTemp = 0;
-	totalBytesTemp = 0;
+	return NORMAL;
+}
 
-        LOG_INFO(CustomSink_i, "DEBUG 12");
-	for (std::vector<ConnectionStat_struct>::const_iterator i = stats.begin(); i != stats.end(); ++i) {
-        	LOG_INFO(CustomSink_i, "DEBUG 13");
-		bytesPerSecTemp += i->bytes_per_second;
-		totalBytesTemp += i->bytes_sent;
+/*
+ * The packet a port gave up at the end of the last batch, if
+ * any.  The caller takes ownership
+ */
+template<typename T>
+typename T::dataTransfer *CustomSink_i::takeHeldPacket(T *inputPort)
+{
+	std::map<const void *, void *>::iterator held = heldPackets.find(inputPort);
+
+	if (held == heldPackets.end()) {
+		return NULL;
 	}
 
-	bytes_per_sec = bytesPerSecTemp;
-	ConnectionStats = stats;
-	total_bytes = totalBytesTemp;
+	typename T::dataTransfer *packet = static_cast<typename T::dataTransfer *>(held->second);
+
+	heldPackets.erase(held);
+	return packet;
+}
+
+template<typename T>
+void CustomSink_i::dropHeldPacket(T *inputPort)
+{
+	delete takeHeldPacket(inputPort);
+}
+
+/*
+ * Everything done for each packet as it is taken from its port,
+ * whether or not it is batched with others
+ */
+template<typename P>
+void CustomSink_i::receivePacket(const P &packet)
+{
+	SINK_PROBE3(packet_arrival, packet.dataBuffer.size() * sizeof(packet.dataBuffer[0]), packet.streamID.c_str(), sizeof(packet.dataBuffer[0]));
 
-	if (packet) {
-        	LOG_INFO(CustomSink_i, "DEBUG 14");
-		packet = NULL;
-		//delete packet;
+	capturePacket(packet.dataBuffer, packet);
+
+	if (packet.inputQueueFlushed) {
+		CORE_LOG_WARN_EVERY(CustomSink_i, "Input Queue Flushed");
 	}
 
-        LOG_INFO(CustomSink_i, "DEBUG 15");
-	return NORMAL;
+	// Bulkio only holds up the producer of a blocking stream; the
+	// queue of any other stream is still flushed when it fills
+	if (lossless and not packet.SRI.blocking) {
+		CORE_LOG_WARN_EVERY(CustomSink_i, "Stream " << packet.streamID << " is not blocking, so lossless mode can't hold up its producer");
+	}
 }
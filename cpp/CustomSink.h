@@ -2,11 +2,10 @@
 #define SINKSOCKET_IMPL_H
 
 #include "CustomSink_base.h"
-#include "BoostClient.h"
-#include "BoostServer.h"
-#include "InternalConnection.h"
-#include "quickstats.h"
+#include "PacketCapture.h"
+#include "SinkEngine.h"
 
+#include <map>
 #include <vector>
 
 class CustomSink_i;
@@ -18,12 +17,66 @@ public:
 	CustomSink_i(const char *uuid, const char *label);
     void constructor();
 	~CustomSink_i();
+	void start() throw (CF::Resource::StartError, CORBA::SystemException);
 	int serviceFunction();
 	template<typename T>
 	int serviceFunctionT(T* inputPort);
 private:
+	/*
+	 * A capture being replayed by the service thread.  The next
+	 * packet is held until it is due when the replay is paced
+	 */
+	struct Replay {
+		Replay() :
+			finished(false),
+			havePacket(false),
+			paced(true),
+			start(0)
+		{}
+
+		bool finished;
+		bool havePacket;
+		CapturedPacket packet;
+		bool paced;
+		CaptureReader reader;
+		double start;
+	};
+
+	/*
+	 * The buffer arena asked for by start(), for the service
+	 * thread to reserve
+	 */
+	struct ArenaRequest {
+		size_t bytes;
+		bool lock;
+		ArenaPages pages;
+	};
+
+	void pinServiceThread();
+	void reserveArena();
+	void publishPlacement();
+	void publishStatistics(std::vector<ConnectionStatus> &statuses);
+	int sendCompressedFrames();
+
+	template<typename T, typename U, typename P>
+	void capturePacket(const std::vector<T, U> &data, const P &packet);
+
 	template<typename T, typename U>
-	void createByteSwappedVector(const std::vector<T, U> &original, unsigned short byteSwap);
+	void processPacket(std::vector<T, U> &data, const std::string &streamID, unsigned long long start, size_t packets = 1);
+
+	template<typename P>
+	void receivePacket(const P &packet);
+
+	template<typename T>
+	typename T::dataTransfer *takeHeldPacket(T *inputPort);
+
+	template<typename T>
+	void dropHeldPacket(T *inputPort);
+
+	int replayPacket(Replay &replaying);
+
+	template<typename T>
+	void replayAs(const CapturedPacket &packet);
 
 	template<typename T, typename U>
 	void sendData(std::vector<T, U>& outData);
@@ -31,17 +84,41 @@ private:
 	template<typename T, typename U>
 	void newData(std::vector<T, U>& newData);
 
+	// The data path lives in the engine, which is only written to
+	// by the service thread.  statisticsLock_ guards the statistic
+	// properties
+	boost::shared_ptr<const ArenaRequest> arenaRequest;
 	float bytesPerSecTemp;
-	std::map<std::string, std::map<unsigned short, std::vector<char> > > byteSwapped;
-	std::vector<InternalConnection *> internalConnections;
-	std::map<std::string, std::map<unsigned short, std::vector<char> > > leftovers;
-	bool onlyByteSwaps;
-	bool performByteSwap;
-	boost::recursive_mutex socketsLock_;
+	boost::shared_ptr<CaptureWriter> captureWriter;
+	CycleClock cycleClock;
+	SinkEngine engine;
+	// The packet each port gave up that couldn't join the batch
+	// before it, keyed by port, which starts the next batch
+	std::map<const void *, void *> heldPackets;
+	StageCounter ingestTime;
+	boost::shared_ptr<Replay> replay;
+	bool resetRequested;
+	boost::shared_ptr<const std::string> serviceCpus;
+	boost::shared_ptr<const std::string> serviceCpusApplied;
+	pthread_t serviceThread;
+	std::string servicePlacement;
+	boost::mutex statisticsLock_;
+	StageCounter statsTime;
 	double totalBytesTemp;
 
 	//Property Change Listener
 	void ConnectionsChanged(const std::vector<Connection_struct> *oldValue, const std::vector<Connection_struct> *newValue);
+	void resetPerformanceCountersChanged(const bool *oldValue, const bool *newValue);
+	void memoryBudgetChanged(const double *oldValue, const double *newValue);
+	void memoryBudgetPolicyChanged(const std::string *oldValue, const std::string *newValue);
+	void losslessChanged(const bool *oldValue, const bool *newValue);
+	void watermarkChanged(const double *oldValue, const double *newValue);
+	void serviceCpusChanged(const std::string *oldValue, const std::string *newValue);
+	void ioCpusChanged(const std::string *oldValue, const std::string *newValue);
+	void senderThreadsChanged(const CORBA::ULong *oldValue, const CORBA::ULong *newValue);
+	void senderCpusChanged(const std::string *oldValue, const std::string *newValue);
+	void captureFileChanged(const std::string *oldValue, const std::string *newValue);
+	void replayFileChanged(const std::string *oldValue, const std::string *newValue);
 };
 
 #endif
@@ -120,6 +120,257 @@ void CustomSink_base::loadProperties()
                 "external",
                 "property");
 
+    addProperty(reset_performance_counters,
+                false,
+                "reset_performance_counters",
+                "",
+                "readwrite",
+                "",
+                "external",
+                "property");
+
+    addProperty(capture_file,
+                "",
+                "capture_file",
+                "",
+                "readwrite",
+                "",
+                "external",
+                "property");
+
+    addProperty(capture_max_bytes,
+                1073741824,
+                "capture_max_bytes",
+                "",
+                "readwrite",
+                "B",
+                "external",
+                "property");
+
+    addProperty(replay_file,
+                "",
+                "replay_file",
+                "",
+                "readwrite",
+                "",
+                "external",
+                "property");
+
+    addProperty(replay_paced,
+                true,
+                "replay_paced",
+                "",
+                "readwrite",
+                "",
+                "external",
+                "property");
+
+    addProperty(memory_budget,
+                0,
+                "memory_budget",
+                "",
+                "readwrite",
+                "B",
+                "external",
+                "property");
+
+    addProperty(memory_budget_policy,
+                "shed_slowest",
+                "memory_budget_policy",
+                "",
+                "readwrite",
+                "",
+                "external",
+                "property");
+
+    addProperty(memory_used,
+                0,
+                "memory_used",
+                "",
+                "readonly",
+                "B",
+                "external",
+                "property");
+
+    addProperty(memory_high_water,
+                0,
+                "memory_high_water",
+                "",
+                "readonly",
+                "B",
+                "external",
+                "property");
+
+    addProperty(lossless,
+                false,
+                "lossless",
+                "",
+                "readwrite",
+                "",
+                "external",
+                "property");
+
+    addProperty(backpressure_high_watermark,
+                67108864,
+                "backpressure_high_watermark",
+                "",
+                "readwrite",
+                "B",
+                "external",
+                "property");
+
+    addProperty(backpressure_low_watermark,
+                16777216,
+                "backpressure_low_watermark",
+                "",
+                "readwrite",
+                "B",
+                "external",
+                "property");
+
+    addProperty(throttled,
+                false,
+                "throttled",
+                "",
+                "readonly",
+                "",
+                "external",
+                "property");
+
+    addProperty(batch_max_packets,
+                1,
+                "batch_max_packets",
+                "",
+                "readwrite",
+                "",
+                "external",
+                "property");
+
+    addProperty(batch_max_bytes,
+                1048576,
+                "batch_max_bytes",
+                "",
+                "readwrite",
+                "B",
+                "external",
+                "property");
+
+    addProperty(service_cpus,
+                "",
+                "service_cpus",
+                "",
+                "readwrite",
+                "",
+                "external",
+                "property");
+
+    addProperty(io_cpus,
+                "",
+                "io_cpus",
+                "",
+                "readwrite",
+                "",
+                "external",
+                "property");
+
+    addProperty(sender_threads,
+                0,
+                "sender_threads",
+                "",
+                "readwrite",
+                "",
+                "external",
+                "property");
+
+    addProperty(sender_queue_depth,
+                256,
+                "sender_queue_depth",
+                "",
+                "readwrite",
+                "",
+                "external",
+                "property");
+
+    addProperty(sender_spin,
+                0,
+                "sender_spin",
+                "",
+                "readwrite",
+                "",
+                "external",
+                "property");
+
+    addProperty(sender_cpus,
+                "",
+                "sender_cpus",
+                "",
+                "readwrite",
+                "",
+                "external",
+                "property");
+
+    addProperty(thread_placement,
+                "thread_placement",
+                "",
+                "readonly",
+                "",
+                "external",
+                "property");
+
+    addProperty(buffer_arena_size,
+                0,
+                "buffer_arena_size",
+                "",
+                "readwrite",
+                "B",
+                "external",
+                "property");
+
+    addProperty(buffer_arena_pages,
+                "transparent",
+                "buffer_arena_pages",
+                "",
+                "readwrite",
+                "",
+                "external",
+                "property");
+
+    addProperty(buffer_arena_lock,
+                false,
+                "buffer_arena_lock",
+                "",
+                "readwrite",
+                "",
+                "external",
+                "property");
+
+    addProperty(buffer_arena_used,
+                0,
+                "buffer_arena_used",
+                "",
+                "readonly",
+                "B",
+                "external",
+                "property");
+
+    addProperty(buffer_arena_misses,
+                0,
+                "buffer_arena_misses",
+                "",
+                "readonly",
+                "",
+                "external",
+                "property");
+
+    addProperty(PerformanceCounters,
+                PerformanceCounters_struct(),
+                "PerformanceCounters",
+                "",
+                "readonly",
+                "",
+                "external",
+                "property");
+
 }
 
 
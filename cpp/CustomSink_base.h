@@ -32,6 +32,62 @@ class CustomSink_base : public Component, protected ThreadedComponent
         std::vector<Connection_struct> Connections;
         /// Property: ConnectionStats
         std::vector<ConnectionStat_struct> ConnectionStats;
+        /// Property: reset_performance_counters
+        bool reset_performance_counters;
+        /// Property: capture_file
+        std::string capture_file;
+        /// Property: capture_max_bytes
+        double capture_max_bytes;
+        /// Property: replay_file
+        std::string replay_file;
+        /// Property: replay_paced
+        bool replay_paced;
+        /// Property: memory_budget
+        double memory_budget;
+        /// Property: memory_budget_policy
+        std::string memory_budget_policy;
+        /// Property: memory_used
+        double memory_used;
+        /// Property: memory_high_water
+        double memory_high_water;
+        /// Property: lossless
+        bool lossless;
+        /// Property: backpressure_high_watermark
+        double backpressure_high_watermark;
+        /// Property: backpressure_low_watermark
+        double backpressure_low_watermark;
+        /// Property: throttled
+        bool throttled;
+        /// Property: batch_max_packets
+        CORBA::ULong batch_max_packets;
+        /// Property: batch_max_bytes
+        double batch_max_bytes;
+        /// Property: service_cpus
+        std::string service_cpus;
+        /// Property: io_cpus
+        std::string io_cpus;
+        /// Property: sender_threads
+        CORBA::ULong sender_threads;
+        /// Property: sender_queue_depth
+        CORBA::ULong sender_queue_depth;
+        /// Property: sender_spin
+        CORBA::ULong sender_spin;
+        /// Property: sender_cpus
+        std::string sender_cpus;
+        /// Property: thread_placement
+        std::vector<std::string> thread_placement;
+        /// Property: buffer_arena_size
+        double buffer_arena_size;
+        /// Property: buffer_arena_pages
+        std::string buffer_arena_pages;
+        /// Property: buffer_arena_lock
+        bool buffer_arena_lock;
+        /// Property: buffer_arena_used
+        double buffer_arena_used;
+        /// Property: buffer_arena_misses
+        double buffer_arena_misses;
+        /// Property: PerformanceCounters
+        PerformanceCounters_struct PerformanceCounters;
 
         // Ports
         /// Port: dataOctet_in
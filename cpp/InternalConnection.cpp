@@ -1,6 +1,6 @@
 #include "InternalConnection.h"
-
-PREPARE_LOGGING(InternalConnection)
+#include <set>
+#include <sstream>
 
 /*
  * Initialize the stored connection type to
@@ -10,22 +10,32 @@ PREPARE_LOGGING(InternalConnection)
  */
 InternalConnection::InternalConnection() :
 	clients(NULL),
-	servers(NULL)
+	compression(COMPRESSION_NONE),
+	distribution(DISTRIBUTION_COPY),
+	outputFormat(FORMAT_NATIVE),
+	servers(NULL),
+	stripeNext(0),
+	stripeSequence(new uint32_t(0))
 {
-	LOG_TRACE(InternalConnection, __PRETTY_FUNCTION__);
+	CORE_LOG_TRACE(InternalConnection, __PRETTY_FUNCTION__);
 
 	connectionInfo.connection_type = "";
 }
 
 /*
- * Given a Connection_struct, initialize the
+ * Given a ConnectionConfig, initialize the
  * list of servers or clients
  */
-InternalConnection::InternalConnection(const Connection_struct &connection) :
+InternalConnection::InternalConnection(const ConnectionConfig &connection) :
 	clients(NULL),
-	servers(NULL)
+	compression(COMPRESSION_NONE),
+	distribution(DISTRIBUTION_COPY),
+	outputFormat(FORMAT_NATIVE),
+	servers(NULL),
+	stripeNext(0),
+	stripeSequence(new uint32_t(0))
 {
-	LOG_TRACE(InternalConnection, __PRETTY_FUNCTION__);
+	CORE_LOG_TRACE(InternalConnection, __PRETTY_FUNCTION__);
 
 	connectionInfo.connection_type = "";
 
@@ -33,47 +43,56 @@ InternalConnection::InternalConnection(const Connection_struct &connection) :
 }
 
 /*
- * Erase the byteSent counters and delete and
- * erase the bytesPerSec objects, client objects,
- * and/or server objects
+ * Share the ports of another connection.  The maps are
+ * copied, the clients, servers and counters they point
+ * to are not.  The original may be sending meanwhile; it
+ * only reads the maps, and the stripe rotation is read
+ * atomically
  */
-void InternalConnection::cleanUp()
+InternalConnection::InternalConnection(const InternalConnection &copy) :
+	byteSwaps(copy.byteSwaps),
+	clients(copy.clients ? new portClientMap(*copy.clients) : NULL),
+	compression(copy.compression),
+	connectionInfo(copy.connectionInfo),
+	counters(copy.counters),
+	distribution(copy.distribution),
+	ioCpus(copy.ioCpus),
+	memoryBudget(copy.memoryBudget),
+	outputFormat(copy.outputFormat),
+	servers(copy.servers ? new portServerMap(*copy.servers) : NULL),
+	stripeNext(__atomic_load_n(&copy.stripeNext, __ATOMIC_RELAXED)),
+	stripeSequence(copy.stripeSequence)
 {
-	LOG_TRACE(InternalConnection, __PRETTY_FUNCTION__);
-
-	// Erase all byte total mappings
-	bytesSent.clear();
+	CORE_LOG_TRACE(InternalConnection, __PRETTY_FUNCTION__);
+}
 
-	// Delete and erase all statistics mappings
-	for (portStatsMap::iterator i = bytesPerSec.begin(); i != bytesPerSec.end(); ++i) {
-		delete i->second;
-	}
+/*
+ * Release the counters, client objects and/or server
+ * objects.  Sockets shared with a copy of this
+ * connection stay open until the copy lets go of them
+ */
+void InternalConnection::cleanUp()
+{
+	CORE_LOG_TRACE(InternalConnection, __PRETTY_FUNCTION__);
 
-	bytesPerSec.clear();
+	// Erase all counter mappings
+	counters.clear();
 
 	byteSwaps.clear();
 
-	// If the clients exist, delete and erase all client mappings,
-	// and the map itself
+	// If the clients exist, erase all client mappings and the
+	// map itself
 	if (clients) {
-		LOG_DEBUG(InternalConnection, "Deleting client maps");
-
-		for (portClientMap::iterator i = clients->begin(); i != clients->end(); ++i) {
-			delete i->second;
-		}
+		CORE_LOG_DEBUG(InternalConnection, "Deleting client maps");
 
 		delete clients;
 		clients = NULL;
 	}
 
-	// If the servers exist, delete and erase all server mappings,
-	// and the map itself
+	// If the servers exist, erase all server mappings and the
+	// map itself
 	if (servers) {
-		LOG_DEBUG(InternalConnection, "Deleting server map");
-
-		for (portServerMap::iterator i = servers->begin(); i != servers->end(); ++i) {
-			delete i->second;
-		}
+		CORE_LOG_DEBUG(InternalConnection, "Deleting server map");
 
 		delete servers;
 		servers = NULL;
@@ -84,45 +103,44 @@ void InternalConnection::cleanUp()
  * Given a port and IP address, create a client
  * object and initialize the relevant information
  * for that object, while returning the statistic
- * information
+ * information.  The client connects in the
+ * background, so it starts out connecting
  */
-ConnectionStat_struct InternalConnection::createClientConnection(const unsigned short &port, const std::string &ip)
+ConnectionStatus InternalConnection::createClientConnection(const unsigned short &port, const std::string &ip, double connectTimeout)
 {
-	LOG_TRACE(InternalConnection, __PRETTY_FUNCTION__);
-	LOG_INFO(InternalConnection, "Creating client connection to " << ip << ":" << port);
+	CORE_LOG_TRACE(InternalConnection, __PRETTY_FUNCTION__);
+	CORE_LOG_INFO(InternalConnection, "Creating client connection to " << ip << ":" << port);
 
-	client *newClient = NULL;
+	boost::shared_ptr<client> newClient;
 
 	// Populate the statistic struct with initial values appropriate
 	// for a client
-	ConnectionStat_struct statistic;
+	ConnectionStatus statistic;
 	statistic.bytes_per_second = 0;
 	statistic.bytes_sent = 0;
+	statistic.compression_ratio = 1.0;
+	statistic.compression_cpu_time = 0;
+	statistic.pacing_delay = 0;
+	statistic.bytes_dropped = 0;
+	statistic.packets_dropped = 0;
 	statistic.ip_address = ip;
 	statistic.port = port;
 	statistic.status = "startup";
 
 	try {
 		// Instantiate a client
-		newClient = new client(port, ip);
+		newClient = client::create(port, ip);
 
-		// Try to connect the client and save the status
-		if (newClient->connect()) {
-			statistic.status = "connected";
-		} else {
-			statistic.status = "not_connected";
-		}
+		// Start connecting the client without waiting for it
+		newClient->connect(connectTimeout);
 
-		// Make a new QuickStats pair, bytesSent pair, and clients pair
-		bytesPerSec.insert(std::make_pair(port, new QuickStats));
-		bytesSent.insert(std::make_pair(port, 0));
+		statistic.status = "connecting";
+
+		// Make a new counters pair and clients pair
+		counters.insert(std::make_pair(port, boost::shared_ptr<PortCounters>(new PortCounters)));
 		clients->insert(std::make_pair(port, newClient));
 	} catch(std::exception &e) {
-		LOG_ERROR(InternalConnection, "Unable to create client connection to " << ip << ":" << port);
-
-		if (newClient) {
-			delete newClient;
-		}
+		CORE_LOG_ERROR(InternalConnection, "Unable to create client connection to " << ip << ":" << port);
 
 		statistic.status = "error";
 	}
@@ -135,25 +153,30 @@ ConnectionStat_struct InternalConnection::createClientConnection(const unsigned
  * the relevant information for that object, while
  * returning the statistic information
  */
-ConnectionStat_struct InternalConnection::createServerConnection(const unsigned short &port)
+ConnectionStatus InternalConnection::createServerConnection(const unsigned short &port)
 {
-	LOG_TRACE(InternalConnection, __PRETTY_FUNCTION__);
-	LOG_INFO(InternalConnection, "Creating server listening on port " << port);
+	CORE_LOG_TRACE(InternalConnection, __PRETTY_FUNCTION__);
+	CORE_LOG_INFO(InternalConnection, "Creating server listening on port " << port);
 
-	server *newServer = NULL;
+	boost::shared_ptr<server> newServer;
 
 	// Populate the statistic struct with initial values appropriate
 	// for a server
-	ConnectionStat_struct statistic;
+	ConnectionStatus statistic;
 	statistic.bytes_per_second = 0;
 	statistic.bytes_sent = 0;
+	statistic.compression_ratio = 1.0;
+	statistic.compression_cpu_time = 0;
+	statistic.pacing_delay = 0;
+	statistic.bytes_dropped = 0;
+	statistic.packets_dropped = 0;
 	statistic.ip_address = "";
 	statistic.port = port;
 	statistic.status = "startup";
 
 	try {
 		// Instantiate a server
-		newServer = new server(port);
+		newServer.reset(new server(port));
 
 		// Check if the server has a connection and save the status
 		if (newServer->is_connected()) {
@@ -162,16 +185,11 @@ ConnectionStat_struct InternalConnection::createServerConnection(const unsigned
 			statistic.status = "not_connected";
 		}
 
-		// Make a new QuickStats pair, bytesSent pair, and servers pair
-		bytesPerSec.insert(std::make_pair(port, new QuickStats));
-		bytesSent.insert(std::make_pair(port, 0));
+		// Make a new counters pair and servers pair
+		counters.insert(std::make_pair(port, boost::shared_ptr<PortCounters>(new PortCounters)));
 		servers->insert(std::make_pair(port, newServer));
 	} catch(std::exception &e) {
-		LOG_ERROR(InternalConnection, "Unable to create server listening on port " << port);
-
-		if (newServer) {
-			delete newServer;
-		}
+		CORE_LOG_ERROR(InternalConnection, "Unable to create server listening on port " << port);
 
 		statistic.status = "error";
 	}
@@ -179,37 +197,80 @@ ConnectionStat_struct InternalConnection::createServerConnection(const unsigned
 	return statistic;
 }
 
-std::vector<unsigned short> InternalConnection::getByteSwaps() const
+/*
+ * Return the settings this connection was last
+ * configured with
+ */
+const ConnectionConfig &InternalConnection::getConnection() const
+{
+	return connectionInfo;
+}
+
+/*
+ * Return the output format of each port, which determines
+ * which transformed data buffers need to be created
+ */
+std::vector<OutputFormat> InternalConnection::getOutputFormats() const
+{
+	std::vector<OutputFormat> formats;
+
+	for (portByteSwapMap::const_iterator i = byteSwaps.begin(); i != byteSwaps.end(); ++i) {
+		formats.push_back(OutputFormat(i->second, outputFormat, connectionInfo.scale_factor, compression));
+	}
+
+	return formats;
+}
+
+/*
+ * Given a port, return the format its data should be
+ * sent in
+ */
+// Only looks the port up, so a copy can be made while sending
+OutputFormat InternalConnection::getOutputFormat(const unsigned short &port)
 {
-	return connectionInfo.byte_swap;
+	portByteSwapMap::const_iterator byteSwap = byteSwaps.find(port);
+
+	return OutputFormat((byteSwap != byteSwaps.end()) ? byteSwap->second : 0, outputFormat, connectionInfo.scale_factor, compression);
 }
 
 /*
  * A custom equals operator for comparing an Internal
- * Connection to a Connection_struct, which only
- * checks for equality of the connection type and
- * IP address
+ * Connection to a ConnectionConfig, which is true
+ * only when every setting matches, so the connection
+ * can be reused as is.  See sharesEndpoints for a
+ * match on the connection type and IP address
  */
-bool InternalConnection::operator==(const Connection_struct &connection) const
+bool InternalConnection::operator==(const ConnectionConfig &connection) const
 {
 	return (connectionInfo == connection);
 }
 
+/*
+ * True if the connection has the same type and IP
+ * address, so reconfiguring a copy of this one into
+ * it keeps any ports they have in common open
+ */
+bool InternalConnection::sharesEndpoints(const ConnectionConfig &connection) const
+{
+	return connectionInfo.connection_type == connection.connection_type && connectionInfo.ip_address == connection.ip_address;
+}
+
 /*
  * Given a Connection, iterate over all of the ports
  * and create client connections with the specified
  * port, IP address, and byte swap value, while
  * returning the statistic information for each
- * created connection
+ * created connection.  Every client connects at
+ * the same time, so this doesn't wait on any of them
  */
-std::vector<ConnectionStat_struct> InternalConnection::populateClientMap(const Connection_struct &connection)
+std::vector<ConnectionStatus> InternalConnection::populateClientMap(const ConnectionConfig &connection)
 {
-	LOG_TRACE(InternalConnection, __PRETTY_FUNCTION__);
+	CORE_LOG_TRACE(InternalConnection, __PRETTY_FUNCTION__);
 
-	std::vector<ConnectionStat_struct> statistics;
+	std::vector<ConnectionStatus> statistics;
 
 	for (std::vector<unsigned short>::const_iterator i = connection.ports.begin(); i != connection.ports.end(); ++i) {
-		statistics.push_back(createClientConnection(*i, connection.ip_address));
+		statistics.push_back(createClientConnection(*i, connection.ip_address, connection.connect_timeout));
 	}
 
 	return statistics;
@@ -221,11 +282,11 @@ std::vector<ConnectionStat_struct> InternalConnection::populateClientMap(const C
  * port and byte swap value, while returning the
  * statistic information for each created connection
  */
-std::vector<ConnectionStat_struct> InternalConnection::populateServerMap(const Connection_struct &connection)
+std::vector<ConnectionStatus> InternalConnection::populateServerMap(const ConnectionConfig &connection)
 {
-	LOG_TRACE(InternalConnection, __PRETTY_FUNCTION__);
+	CORE_LOG_TRACE(InternalConnection, __PRETTY_FUNCTION__);
 
-	std::vector<ConnectionStat_struct> statistics;
+	std::vector<ConnectionStatus> statistics;
 
 	for (std::vector<unsigned short>::const_iterator i = connection.ports.begin(); i != connection.ports.end(); ++i) {
 		statistics.push_back(createServerConnection(*i));
@@ -239,16 +300,16 @@ std::vector<ConnectionStat_struct> InternalConnection::populateServerMap(const C
  * connection (client/server) to create or manage
  * an existing connection
  */
-std::vector<ConnectionStat_struct> InternalConnection::setConnection(const Connection_struct &connection)
+std::vector<ConnectionStatus> InternalConnection::setConnection(const ConnectionConfig &connection)
 {
-	LOG_TRACE(InternalConnection, __PRETTY_FUNCTION__);
+	CORE_LOG_TRACE(InternalConnection, __PRETTY_FUNCTION__);
 
 	// Make a vector of Connection Statistics to return
-	std::vector<ConnectionStat_struct> statistics;
+	std::vector<ConnectionStatus> statistics;
 
 	// Guard against an invalid connection type
 	if (connection.connection_type != "client" && connection.connection_type != "server") {
-		LOG_ERROR(InternalConnection, "Attempted to set connection type to \"" << connection.connection_type << "\"");
+		CORE_LOG_ERROR(InternalConnection, "Attempted to set connection type to \"" << connection.connection_type << "\"");
 
 		return statistics;
 	}
@@ -257,12 +318,12 @@ std::vector<ConnectionStat_struct> InternalConnection::setConnection(const Conne
 	// deleted and created from scratch.  Otherwise, only update
 	// the parts that have changed
 	if (connectionInfo.connection_type != connection.connection_type ) {
-		LOG_INFO(InternalConnection, "Connection type has changed, deleting old connections");
+		CORE_LOG_INFO(InternalConnection, "Connection type has changed, deleting old connections");
 
 		cleanUp();
 
 		if (connection.connection_type == "client") {
-			LOG_DEBUG(InternalConnection, "Creating client map");
+			CORE_LOG_DEBUG(InternalConnection, "Creating client map");
 
 			clients = new portClientMap();
 
@@ -271,7 +332,7 @@ std::vector<ConnectionStat_struct> InternalConnection::setConnection(const Conne
 			// Save the connection information for later
 			connectionInfo = connection;
 		} else {
-			LOG_DEBUG(InternalConnection, "Creating server map");
+			CORE_LOG_DEBUG(InternalConnection, "Creating server map");
 
 			servers = new portServerMap();
 
@@ -295,24 +356,23 @@ std::vector<ConnectionStat_struct> InternalConnection::setConnection(const Conne
 			// If the ports have changed, some connections may stay the
 			// same
 			else if (connectionInfo.ports != connection.ports) {
-				// Keep track of which byte swap value to use
-				int counter = 0;
+				// Sets of the old and new ports, so a large port list
+				// isn't searched once per port
+				std::set<unsigned short> oldPorts(connectionInfo.ports.begin(), connectionInfo.ports.end());
+				std::set<unsigned short> newPorts(connection.ports.begin(), connection.ports.end());
 
 				// Check for added ports
-				for (std::vector<unsigned short>::const_iterator i = connection.ports.begin(); i != connection.ports.end(); ++i, ++counter) {
-					if (find(connectionInfo.ports.begin(), connectionInfo.ports.end(), *i) == connectionInfo.ports.end()) {
-						statistics.push_back(createClientConnection(*i, connection.ip_address));
+				for (std::vector<unsigned short>::const_iterator i = connection.ports.begin(); i != connection.ports.end(); ++i) {
+					if (oldPorts.insert(*i).second) {
+						statistics.push_back(createClientConnection(*i, connection.ip_address, connection.connect_timeout));
 					}
 				}
 
 				// Check for removed ports
 				for (std::vector<unsigned short>::const_iterator i = connectionInfo.ports.begin(); i != connectionInfo.ports.end(); ++i) {
-					if (find(connection.ports.begin(), connection.ports.end(), *i) == connection.ports.end()) {
-						delete bytesPerSec.at(*i);
-						bytesPerSec.erase(*i);
-						bytesSent.erase(*i);
+					if (not newPorts.count(*i)) {
+						counters.erase(*i);
 						byteSwaps.erase(*i);
-						delete clients->at(*i);
 						clients->erase(*i);
 					}
 				}
@@ -324,23 +384,22 @@ std::vector<ConnectionStat_struct> InternalConnection::setConnection(const Conne
 			// If the ports have changed, some connections may stay the
 			// same
 			if (connectionInfo.ports != connection.ports) {
-				// Keep track of which byte swap value to use
-				int counter = 0;
+				// Sets of the old and new ports, so a large port list
+				// isn't searched once per port
+				std::set<unsigned short> oldPorts(connectionInfo.ports.begin(), connectionInfo.ports.end());
+				std::set<unsigned short> newPorts(connection.ports.begin(), connection.ports.end());
 
 				// Check for added ports
-				for (std::vector<unsigned short>::const_iterator i = connection.ports.begin(); i != connection.ports.end(); ++i, ++counter) {
-					if (find(connectionInfo.ports.begin(), connectionInfo.ports.end(), *i) == connectionInfo.ports.end()) {
+				for (std::vector<unsigned short>::const_iterator i = connection.ports.begin(); i != connection.ports.end(); ++i) {
+					if (oldPorts.insert(*i).second) {
 						statistics.push_back(createServerConnection(*i));
 					}
 				}
 
 				// Check for removed ports
 				for (std::vector<unsigned short>::const_iterator i = connectionInfo.ports.begin(); i != connectionInfo.ports.end(); ++i) {
-					if (find(connection.ports.begin(), connection.ports.end(), *i) == connection.ports.end()) {
-						delete bytesPerSec.at(*i);
-						bytesPerSec.erase(*i);
-						bytesSent.erase(*i);
-						delete servers->at(*i);
+					if (not newPorts.count(*i)) {
+						counters.erase(*i);
 						servers->erase(*i);
 					}
 				}
@@ -362,37 +421,124 @@ std::vector<ConnectionStat_struct> InternalConnection::setConnection(const Conne
 		byteSwaps[*i] = connection.byte_swap[counter];
 	}
 
+	// Catch all for the output format changed
+	if (not parseSampleFormat(connection.output_format, outputFormat)) {
+		CORE_LOG_ERROR(InternalConnection, "Unknown output format \"" << connection.output_format << "\", sending native samples");
+
+		outputFormat = FORMAT_NATIVE;
+	}
+
+	// Catch all for the compression changed
+	if (not parseCompressionType(connection.compression, compression) || not compressionAvailable(compression)) {
+		CORE_LOG_ERROR(InternalConnection, "Compression \"" << connection.compression << "\" is not available, sending uncompressed data");
+
+		compression = COMPRESSION_NONE;
+	}
+
+	// Catch all for the distribution changed
+	if (not parseDistributionMode(connection.distribution, distribution)) {
+		CORE_LOG_ERROR(InternalConnection, "Unknown distribution \"" << connection.distribution << "\", sending every port a copy");
+
+		distribution = DISTRIBUTION_COPY;
+	}
+
+	// Catch all for the rate limit changed
+	if (clients) {
+		for (portClientMap::iterator i = clients->begin(); i != clients->end(); ++i) {
+			i->second->setRateLimit(connection.rate_limit, connection.burst_size);
+			i->second->setCoalescing(connection.coalesce_bytes, connection.coalesce_delay);
+			i->second->setConnectTimeout(connection.connect_timeout);
+			i->second->setMemoryBudget(memoryBudget);
+		}
+	}
+
+	// Catch all for the inbound handling changed
+	if (servers) {
+		for (portServerMap::iterator i = servers->begin(); i != servers->end(); ++i) {
+			i->second->setRateLimit(connection.rate_limit, connection.burst_size);
+			i->second->setCoalescing(connection.coalesce_bytes, connection.coalesce_delay);
+			i->second->configureInbound(connection.read_chunk_size, connection.inbound_buffer_size, connection.inbound_mode == "discard");
+			i->second->setSlowConsumerLimit(connection.slow_consumer_lag, connection.slow_consumer_bytes, connection.slow_consumer_action == "drop");
+			i->second->setMemoryBudget(memoryBudget);
+		}
+	}
+
 	return statistics;
 }
 
-std::vector<ConnectionStat_struct> InternalConnection::writeByteSwap(std::map<unsigned short, std::vector<char> > &dataMap)
+/*
+ * Given the transformed data for each output format, write
+ * the appropriate data to each port.  Compressed formats
+ * may not have a frame ready, in which case nothing is
+ * written to those ports, and their rate is reported without
+ * counting a packet that never went out
+ */
+std::vector<ConnectionStatus> InternalConnection::writeByteSwap(const outputDataMap &dataMap, const compressionStatsMap &compressionStats)
 {
-	LOG_TRACE(InternalConnection, __PRETTY_FUNCTION__);
+	CORE_LOG_TRACE(InternalConnection, __PRETTY_FUNCTION__);
+
+	// Striped ports all share the format of the first port
+	if (distribution != DISTRIBUTION_COPY && not byteSwaps.empty()) {
+		OutputFormat format = getOutputFormat(byteSwaps.begin()->first);
+		outputDataMap::const_iterator data = dataMap.find(format);
+		compressionStatsMap::const_iterator compressed = compressionStats.find(format);
+
+		return writeStriped((data != dataMap.end()) ? data->second.data() : NULL,
+				(data != dataMap.end()) ? data->second.size() : 0,
+				(compressed != compressionStats.end()) ? &compressed->second : NULL);
+	}
 
 	// Make a vector of Connection Statistics to return
-	std::vector<ConnectionStat_struct> statistics;
+	std::vector<ConnectionStatus> statistics;
+
+	sharedDataMap sharedData;
 
 	if (connectionInfo.connection_type == "client" && clients) {
 		statistics.reserve(clients->size());
 
 		for (portClientMap::iterator i = clients->begin(); i != clients->end(); ++i) {
-			ConnectionStat_struct statistic;
+			ConnectionStatus statistic;
 
 			statistic.ip_address = connectionInfo.ip_address;
 			statistic.port = i->first;
 
+			OutputFormat format = getOutputFormat(i->first);
+			outputDataMap::const_iterator data = dataMap.find(format);
+			compressionStatsMap::const_iterator compressed = compressionStats.find(format);
+			bool hasData = (data != dataMap.end() && not data->second.empty());
+
+			statistic.compression_ratio = (compressed != compressionStats.end()) ? compressed->second.ratio() : 1.0;
+			statistic.compression_cpu_time = (compressed != compressionStats.end()) ? compressed->second.cpuTime : 0;
+			statistic.pacing_delay = i->second->pacingDelay();
+
 			if (i->second->connect_if_necessary()) {
 				statistic.status = "connected";
 
-				i->second->write(dataMap[byteSwaps[i->first]]);
+				size_t pktSize = 0;
+
+				if (hasData) {
+					SharedBuffer &buffer = sharedData[format];
 
-				size_t pktSize = dataMap[byteSwaps[i->first]].size();
+					// Copy each format once, every port shares the copy
+					if (not buffer) {
+						buffer = makeSharedBuffer(data->second);
+					}
+
+					i->second->write(buffer);
+
+					pktSize = data->second.size();
+				}
+
+				statistic.bytes_per_second = hasData ? counters[i->first]->bytesPerSec.newPacket(pktSize) : counters[i->first]->bytesPerSec.rate();
+				statistic.bytes_sent = (counters[i->first]->bytesSent += pktSize);
 
-				statistic.bytes_per_second = bytesPerSec[i->first]->newPacket(pktSize);
-				statistic.bytes_sent = (bytesSent[i->first] += pktSize);
+				countDrops(statistic, 0);
 			} else {
-				statistic.status = "not_connected";
-				statistic.bytes_per_second = bytesPerSec[i->first]->newPacket(0);
+				statistic.status = disconnectedStatus(i->second);
+				statistic.bytes_per_second = hasData ? counters[i->first]->bytesPerSec.newPacket(0) : counters[i->first]->bytesPerSec.rate();
+				statistic.bytes_sent = counters[i->first]->bytesSent;
+
+				countDrops(statistic, (data != dataMap.end()) ? data->second.size() : 0);
 			}
 
 			statistics.push_back(statistic);
@@ -401,38 +547,251 @@ std::vector<ConnectionStat_struct> InternalConnection::writeByteSwap(std::map<un
 		statistics.reserve(servers->size());
 
 		for (portServerMap::iterator i = servers->begin(); i != servers->end(); ++i) {
-			ConnectionStat_struct statistic;
+			ConnectionStatus statistic;
 
 			statistic.ip_address = "";
 			statistic.port = i->first;
 
+			OutputFormat format = getOutputFormat(i->first);
+			outputDataMap::const_iterator data = dataMap.find(format);
+			compressionStatsMap::const_iterator compressed = compressionStats.find(format);
+			bool hasData = (data != dataMap.end() && not data->second.empty());
+
+			statistic.compression_ratio = (compressed != compressionStats.end()) ? compressed->second.ratio() : 1.0;
+			statistic.compression_cpu_time = (compressed != compressionStats.end()) ? compressed->second.cpuTime : 0;
+			statistic.pacing_delay = i->second->pacingDelay();
+
 			if (i->second->is_connected()) {
 				statistic.status = "connected";
 
-				i->second->write(dataMap[byteSwaps[i->first]]);
+				size_t pktSize = 0;
+
+				if (hasData) {
+					SharedBuffer &buffer = sharedData[format];
+
+					// Copy each format once, every port shares the copy
+					if (not buffer) {
+						buffer = makeSharedBuffer(data->second);
+					}
+
+					i->second->write(buffer);
 
-				size_t pktSize = dataMap[byteSwaps[i->first]].size();
+					pktSize = data->second.size();
+				}
+
+				statistic.bytes_per_second = hasData ? counters[i->first]->bytesPerSec.newPacket(pktSize) : counters[i->first]->bytesPerSec.rate();
+				statistic.bytes_sent = (counters[i->first]->bytesSent += pktSize);
 
-				statistic.bytes_per_second = bytesPerSec[i->first]->newPacket(pktSize);
-				statistic.bytes_sent = (bytesSent[i->first] += pktSize);
+				countDrops(statistic, 0);
 			} else {
-				statistic.status = "not_connected";
-				statistic.bytes_per_second = bytesPerSec[i->first]->newPacket(0);
+				statistic.status = disconnectedStatus(i->second);
+				statistic.bytes_per_second = hasData ? counters[i->first]->bytesPerSec.newPacket(0) : counters[i->first]->bytesPerSec.rate();
+				statistic.bytes_sent = counters[i->first]->bytesSent;
+
+				countDrops(statistic, (data != dataMap.end()) ? data->second.size() : 0);
 			}
 
 			statistics.push_back(statistic);
 		}
 	} else {
-		LOG_ERROR(InternalConnection, "Invalid conditions for writing data");
+		CORE_LOG_ERROR_EVERY(InternalConnection, "Invalid conditions for writing data");
 	}
 
 	return statistics;
 }
 
+/*
+ * Spread the data across the ports of the connection rather
+ * than sending each port a copy
+ */
+std::vector<ConnectionStatus> InternalConnection::writeStriped(const char *data, size_t size, const CompressionStats *compressed)
+{
+	CORE_LOG_TRACE(InternalConnection, __PRETTY_FUNCTION__);
+
+	if (connectionInfo.connection_type == "client" && clients) {
+		return stripeTo(*clients, connectionInfo.ip_address, data, size, compressed);
+	} else if (connectionInfo.connection_type == "server" && servers) {
+		return stripeTo(*servers, "", data, size, compressed);
+	}
+
+	CORE_LOG_ERROR_EVERY(InternalConnection, "Invalid conditions for writing data");
+
+	return std::vector<ConnectionStatus>();
+}
+
+bool InternalConnection::isConnected(const boost::shared_ptr<client> &endpoint)
+{
+	return endpoint->connect_if_necessary();
+}
+
+bool InternalConnection::isConnected(const boost::shared_ptr<server> &endpoint)
+{
+	return endpoint->is_connected();
+}
+
+/*
+ * The status of a port that isn't connected.  A client
+ * is connecting until its first attempt finishes
+ */
+const char *InternalConnection::disconnectedStatus(const boost::shared_ptr<client> &endpoint)
+{
+	return endpoint->is_connecting() ? "connecting" : "not_connected";
+}
+
+const char *InternalConnection::disconnectedStatus(const boost::shared_ptr<server> &)
+{
+	return "not_connected";
+}
+
+/*
+ * Count the queued data of every port against a budget.
+ * Takes effect for the existing ports the next time the
+ * connection is set
+ */
+void InternalConnection::setMemoryBudget(const boost::shared_ptr<MemoryBudget> &budget)
+{
+	memoryBudget = budget;
+}
+
+/*
+ * Find the port with the most data waiting to be sent,
+ * returning how much.  For a server this is its slowest
+ * session
+ */
+size_t InternalConnection::slowestPort(unsigned short &port)
+{
+	size_t slowest = 0;
+
+	if (clients) {
+		for (portClientMap::iterator i = clients->begin(); i != clients->end(); ++i) {
+			size_t queued = i->second->queuedBytes();
+
+			if (queued > slowest) {
+				slowest = queued;
+				port = i->first;
+			}
+		}
+	}
+
+	if (servers) {
+		for (portServerMap::iterator i = servers->begin(); i != servers->end(); ++i) {
+			size_t queued = i->second->queuedBytes();
+
+			if (queued > slowest) {
+				slowest = queued;
+				port = i->first;
+			}
+		}
+	}
+
+	return slowest;
+}
+
+/*
+ * Drop the data waiting to be sent on a port, or to the
+ * slowest session of a server, counting it as dropped
+ */
+size_t InternalConnection::shedPort(unsigned short port)
+{
+	size_t shed = 0;
+
+	if (clients && clients->count(port)) {
+		shed = (*clients)[port]->shed();
+	} else if (servers && servers->count(port)) {
+		shed = (*servers)[port]->shedSlowest();
+	}
+
+	if (shed) {
+		PortCounters &counter = *counters[port];
+
+		counter.bytesDropped += shed;
+		++counter.packetsDropped;
+	}
+
+	return shed;
+}
+
+/*
+ * Count the data that couldn't be sent to a port because
+ * it wasn't connected, along with what a server dropped from
+ * its slow consumers, and report the totals
+ */
+void InternalConnection::countDrops(ConnectionStatus &statistic, size_t droppedBytes)
+{
+	PortCounters &counter = *counters[statistic.port];
+
+	if (droppedBytes) {
+		counter.bytesDropped += droppedBytes;
+		++counter.packetsDropped;
+	}
+
+	if (servers) {
+		portServerMap::iterator server = servers->find(statistic.port);
+
+		if (server != servers->end()) {
+			size_t slowDropped = 0;
+
+			counter.slowConsumers += server->second->takeSlowConsumers(slowDropped);
+
+			if (slowDropped) {
+				counter.bytesDropped += slowDropped;
+				++counter.packetsDropped;
+			}
+		}
+	}
+
+	statistic.bytes_dropped = counter.bytesDropped;
+	statistic.packets_dropped = counter.packetsDropped;
+	statistic.slow_consumers = counter.slowConsumers;
+}
+
 InternalConnection::~InternalConnection()
 {
-	LOG_TRACE(InternalConnection, __PRETTY_FUNCTION__);
+	CORE_LOG_TRACE(InternalConnection, __PRETTY_FUNCTION__);
 
 	cleanUp();
 }
 
+
+/*
+ * Pin the I/O thread of every port to a list of CPUs, or
+ * unpin them with an empty list
+ */
+void InternalConnection::setIoCpus(const std::string &cpus)
+{
+	ioCpus = cpus;
+
+	if (clients) {
+		for (portClientMap::iterator i = clients->begin(); i != clients->end(); ++i) {
+			i->second->setAffinity(ioCpus);
+		}
+	}
+
+	if (servers) {
+		for (portServerMap::iterator i = servers->begin(); i != servers->end(); ++i) {
+			i->second->setAffinity(ioCpus);
+		}
+	}
+}
+
+// Where the I/O thread of each port runs
+void InternalConnection::placement(std::vector<std::string> &placements)
+{
+	std::ostringstream placement;
+
+	if (clients) {
+		for (portClientMap::iterator i = clients->begin(); i != clients->end(); ++i) {
+			placement.str("");
+			placement << "io " << connectionInfo.ip_address << ":" << i->first << ": " << i->second->placement();
+			placements.push_back(placement.str());
+		}
+	}
+
+	if (servers) {
+		for (portServerMap::iterator i = servers->begin(); i != servers->end(); ++i) {
+			placement.str("");
+			placement << "io port " << i->first << ": " << i->second->placement();
+			placements.push_back(placement.str());
+		}
+	}
+}
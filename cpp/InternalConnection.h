@@ -3,62 +3,110 @@
 
 #include "BoostClient.h"
 #include "BoostServer.h"
+#include "corelog.h"
+#include "outputformat.h"
 #include "quickstats.h"
-#include "struct_props.h"
+#include "SinkConfig.h"
+#include "stripe.h"
 
 
-typedef std::map<unsigned short, double> portBytesMap;
+/*
+ * The running totals of a port, shared by every
+ * configuration the port is part of
+ */
+struct PortCounters {
+	PortCounters() :
+		bytesDropped(0),
+		bytesSent(0),
+		packetsDropped(0),
+		slowConsumers(0)
+	{}
+
+	double bytesDropped;
+	QuickStats bytesPerSec;
+	double bytesSent;
+	unsigned int packetsDropped;
+	unsigned int slowConsumers;
+};
+
 typedef std::map<unsigned short, unsigned short> portByteSwapMap;
-typedef std::map<unsigned short, client *> portClientMap;
-typedef std::map<unsigned short, server *> portServerMap;
-typedef std::map<unsigned short, QuickStats *> portStatsMap;
+typedef std::map<unsigned short, boost::shared_ptr<client> > portClientMap;
+typedef std::map<unsigned short, boost::shared_ptr<PortCounters> > portCountersMap;
+typedef std::map<unsigned short, boost::shared_ptr<server> > portServerMap;
+typedef std::map<OutputFormat, SharedBuffer> sharedDataMap;
 
 /*
  * This class manages server or client connections
- * based on a Connection_struct, returning
- * ConnectionStat_struct(s) to notify the owner of
- * an object of this type's current status
+ * based on a ConnectionConfig, returning
+ * ConnectionStatus(es) to notify the owner of
+ * an object of this type's current status.
+ *
+ * A copy shares the sockets and counters of every
+ * port with the original, so the copy can be
+ * reconfigured while the original is still sending.
+ * Only one of them may be written to at a time
  */
 class InternalConnection {
-	ENABLE_LOGGING
 public:
 	InternalConnection();
-	InternalConnection(const Connection_struct &connection);
+	InternalConnection(const ConnectionConfig &connection);
+	InternalConnection(const InternalConnection &copy);
 	virtual ~InternalConnection();
 
 private:
-	/* Make the copy constructor private so that it
-	 * can't be called by anyone else.  The internal
-	 * pointers require move semantics as opposed to
-	 * copy semantics
-	 */
-	InternalConnection(const InternalConnection &copy);
+	InternalConnection &operator=(const InternalConnection &copy);
 
 public:
-	std::vector<unsigned short> getByteSwaps() const;
+	const ConnectionConfig &getConnection() const;
+	std::vector<OutputFormat> getOutputFormats() const;
 
-	bool operator==(const Connection_struct &connection) const;
-	std::vector<ConnectionStat_struct> setConnection(const Connection_struct &connection);
+	bool operator==(const ConnectionConfig &connection) const;
+	bool sharesEndpoints(const ConnectionConfig &connection) const;
+	std::vector<ConnectionStatus> setConnection(const ConnectionConfig &connection);
 
 	template <typename T, typename U>
-	std::vector<ConnectionStat_struct> write(std::vector<T, U> &data);
+	std::vector<ConnectionStatus> write(std::vector<T, U> &data);
+
+	std::vector<ConnectionStatus> writeByteSwap(const outputDataMap &dataMap, const compressionStatsMap &compressionStats);
+
+	void setMemoryBudget(const boost::shared_ptr<MemoryBudget> &budget);
+	size_t slowestPort(unsigned short &port);
+	size_t shedPort(unsigned short port);
 
-	std::vector<ConnectionStat_struct> writeByteSwap(std::map<unsigned short, std::vector<char> > &dataMap);
+	void setIoCpus(const std::string &cpus);
+	void placement(std::vector<std::string> &placements);
 
 private:
 	void cleanUp();
-	ConnectionStat_struct createClientConnection(const unsigned short &port, const std::string &ip);
-	ConnectionStat_struct createServerConnection(const unsigned short &port);
-	std::vector<ConnectionStat_struct> populateClientMap(const Connection_struct &connection);
-	std::vector<ConnectionStat_struct> populateServerMap(const Connection_struct &connection);
+	void countDrops(ConnectionStatus &statistic, size_t droppedBytes);
+	ConnectionStatus createClientConnection(const unsigned short &port, const std::string &ip, double connectTimeout);
+	ConnectionStatus createServerConnection(const unsigned short &port);
+	OutputFormat getOutputFormat(const unsigned short &port);
+	std::vector<ConnectionStatus> writeStriped(const char *data, size_t size, const CompressionStats *compressed);
+	template <typename M>
+	std::vector<ConnectionStatus> stripeTo(M &endpoints, const std::string &ip, const char *data, size_t size, const CompressionStats *compressed);
+	template <typename I>
+	I nextStripePort(const std::vector<I> &connected);
+	static bool isConnected(const boost::shared_ptr<client> &endpoint);
+	static bool isConnected(const boost::shared_ptr<server> &endpoint);
+	static const char *disconnectedStatus(const boost::shared_ptr<client> &endpoint);
+	static const char *disconnectedStatus(const boost::shared_ptr<server> &endpoint);
+	std::vector<ConnectionStatus> populateClientMap(const ConnectionConfig &connection);
+	std::vector<ConnectionStatus> populateServerMap(const ConnectionConfig &connection);
 
 private:
-	portStatsMap bytesPerSec;
 	portByteSwapMap byteSwaps;
-	portBytesMap bytesSent;
 	portClientMap *clients;
-	Connection_struct connectionInfo;
+	CompressionType compression;
+	ConnectionConfig connectionInfo;
+	portCountersMap counters;
+	DistributionMode distribution;
+	std::string ioCpus;
+	boost::shared_ptr<MemoryBudget> memoryBudget;
+	SampleFormat outputFormat;
 	portServerMap *servers;
+	size_t stripeNext;
+	boost::shared_ptr<uint32_t> stripeSequence;
 };
 
 #include "InternalConnectionTemplate.h"
@@ -4,32 +4,47 @@
 #include "InternalConnection.h"
 
 template <typename T, typename U>
-std::vector<ConnectionStat_struct> InternalConnection::write(std::vector<T, U> &data)
+std::vector<ConnectionStatus> InternalConnection::write(std::vector<T, U> &data)
 {
-	LOG_TRACE(InternalConnection, __PRETTY_FUNCTION__);
+	CORE_LOG_TRACE(InternalConnection, __PRETTY_FUNCTION__);
 
 	// Make a vector of Connection Statistics to return
-	std::vector<ConnectionStat_struct> statistics;
+	std::vector<ConnectionStatus> statistics;
+
+	if (distribution != DISTRIBUTION_COPY) {
+		return writeStriped(reinterpret_cast<const char *>(data.data()), data.size() * sizeof(T), NULL);
+	}
+
+	// Every port shares a single copy of the data
+	SharedBuffer buffer = makeSharedBuffer(data);
 
 	if (connectionInfo.connection_type == "client" && clients) {
 		for (portClientMap::iterator i = clients->begin(); i != clients->end(); ++i) {
-			ConnectionStat_struct statistic;
+			ConnectionStatus statistic;
 
 			statistic.ip_address = connectionInfo.ip_address;
 			statistic.port = i->first;
+			statistic.compression_ratio = 1.0;
+			statistic.compression_cpu_time = 0;
+			statistic.pacing_delay = i->second->pacingDelay();
 
 			if (i->second->connect_if_necessary()) {
 				statistic.status = "connected";
 
-				i->second->write(data);
+				i->second->write(buffer);
 
 				size_t pktSize = data.size() * sizeof(T);
 
-				statistic.bytes_per_second = bytesPerSec[i->first]->newPacket(pktSize);
-				statistic.bytes_sent = (bytesSent[i->first] += pktSize);
+				statistic.bytes_per_second = counters[i->first]->bytesPerSec.newPacket(pktSize);
+				statistic.bytes_sent = (counters[i->first]->bytesSent += pktSize);
+
+				countDrops(statistic, 0);
 			} else {
-				statistic.status = "not_connected";
-				statistic.bytes_per_second = bytesPerSec[i->first]->newPacket(0);
+				statistic.status = disconnectedStatus(i->second);
+				statistic.bytes_per_second = counters[i->first]->bytesPerSec.newPacket(0);
+				statistic.bytes_sent = counters[i->first]->bytesSent;
+
+				countDrops(statistic, data.size() * sizeof(T));
 			}
 
 			statistics.push_back(statistic);
@@ -37,32 +52,139 @@ std::vector<ConnectionStat_struct> InternalConnection::write(std::vector<T, U> &
 	} else if (connectionInfo.connection_type == "server" && servers) {
 
 		for (portServerMap::iterator i = servers->begin(); i != servers->end(); ++i) {
-			ConnectionStat_struct statistic;
+			ConnectionStatus statistic;
 
 			statistic.ip_address = "";
 			statistic.port = i->first;
+			statistic.compression_ratio = 1.0;
+			statistic.compression_cpu_time = 0;
+			statistic.pacing_delay = i->second->pacingDelay();
 
 			if (i->second->is_connected()) {
 				statistic.status = "connected";
 
-				i->second->write(data);
+				i->second->write(buffer);
 
 				size_t pktSize = data.size() * sizeof(T);
 
-				statistic.bytes_per_second = bytesPerSec[i->first]->newPacket(pktSize);
-				statistic.bytes_sent = (bytesSent[i->first] += pktSize);
+				statistic.bytes_per_second = counters[i->first]->bytesPerSec.newPacket(pktSize);
+				statistic.bytes_sent = (counters[i->first]->bytesSent += pktSize);
+
+				countDrops(statistic, 0);
 			} else {
-				statistic.status = "not_connected";
-				statistic.bytes_per_second = bytesPerSec[i->first]->newPacket(0);
+				statistic.status = disconnectedStatus(i->second);
+				statistic.bytes_per_second = counters[i->first]->bytesPerSec.newPacket(0);
+				statistic.bytes_sent = counters[i->first]->bytesSent;
+
+				countDrops(statistic, data.size() * sizeof(T));
 			}
 
 			statistics.push_back(statistic);
 		}
 	} else {
-		LOG_ERROR(InternalConnection, "Invalid conditions for writing data");
+		CORE_LOG_ERROR_EVERY(InternalConnection, "Invalid conditions for writing data");
+	}
+
+	return statistics;
+}
+
+/*
+ * Split the data into stripes of stripe_size bytes, or whole
+ * packets if it is zero, and write each one to a single connected
+ * port.  Every stripe carries a header so the receiver can put
+ * the packets back together in order
+ */
+template <typename M>
+std::vector<ConnectionStatus> InternalConnection::stripeTo(M &endpoints, const std::string &ip, const char *data, size_t size, const CompressionStats *compressed)
+{
+	std::vector<ConnectionStatus> statistics;
+	std::vector<typename M::iterator> connected;
+	std::map<unsigned short, size_t> pktSizes;
+
+	for (typename M::iterator i = endpoints.begin(); i != endpoints.end(); ++i) {
+		if (isConnected(i->second)) {
+			connected.push_back(i);
+			pktSizes[i->first] = 0;
+		}
+	}
+
+	if (size != 0 && not connected.empty()) {
+		size_t stripeSize = connectionInfo.stripe_size ? connectionInfo.stripe_size : size;
+
+		for (size_t offset = 0; offset < size; offset += stripeSize) {
+			typename M::iterator endpoint = nextStripePort(connected);
+			SharedBuffer stripe = makeStripe(*stripeSequence, data, size, offset, std::min(stripeSize, size - offset));
+
+			endpoint->second->write(stripe);
+
+			pktSizes[endpoint->first] += stripe->size();
+		}
+
+		++*stripeSequence;
+	}
+
+	statistics.reserve(endpoints.size());
+
+	for (typename M::iterator i = endpoints.begin(); i != endpoints.end(); ++i) {
+		ConnectionStatus statistic;
+
+		statistic.ip_address = ip;
+		statistic.port = i->first;
+		statistic.compression_ratio = compressed ? compressed->ratio() : 1.0;
+		statistic.compression_cpu_time = compressed ? compressed->cpuTime : 0;
+		statistic.pacing_delay = i->second->pacingDelay();
+
+		std::map<unsigned short, size_t>::iterator pktSize = pktSizes.find(i->first);
+
+		if (pktSize != pktSizes.end()) {
+			statistic.status = "connected";
+			statistic.bytes_per_second = (size != 0) ? counters[i->first]->bytesPerSec.newPacket(pktSize->second) : counters[i->first]->bytesPerSec.rate();
+			statistic.bytes_sent = (counters[i->first]->bytesSent += pktSize->second);
+
+			countDrops(statistic, 0);
+		} else {
+			statistic.status = disconnectedStatus(i->second);
+			statistic.bytes_per_second = (size != 0) ? counters[i->first]->bytesPerSec.newPacket(0) : counters[i->first]->bytesPerSec.rate();
+			statistic.bytes_sent = counters[i->first]->bytesSent;
+
+			// With nowhere to send it, the packet counts against the
+			// first port
+			countDrops(statistic, (connected.empty() && i == endpoints.begin()) ? size : 0);
+		}
+
+		statistics.push_back(statistic);
 	}
 
 	return statistics;
 }
 
+/*
+ * Pick the port for the next stripe, either in turn or the
+ * connected port with the least data waiting to be written
+ */
+template <typename I>
+I InternalConnection::nextStripePort(const std::vector<I> &connected)
+{
+	size_t start = __atomic_fetch_add(&stripeNext, 1, __ATOMIC_RELAXED) % connected.size();
+
+	if (distribution != DISTRIBUTION_LEAST_LOADED) {
+		return connected[start];
+	}
+
+	I best = connected[start];
+	size_t bestQueued = best->second->queuedBytes();
+
+	for (size_t i = 1; i < connected.size() && bestQueued != 0; ++i) {
+		I candidate = connected[(start + i) % connected.size()];
+		size_t queued = candidate->second->queuedBytes();
+
+		if (queued < bestQueued) {
+			best = candidate;
+			bestQueued = queued;
+		}
+	}
+
+	return best;
+}
+
 #endif /* INTERNALCONNECTIONTEMPLATE_H_ */
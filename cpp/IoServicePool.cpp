@@ -0,0 +1,71 @@
+#include "IoServicePool.h"
+
+#include <algorithm>
+#include <boost/bind.hpp>
+
+#include "affinity.h"
+
+IoThread::IoThread() :
+	pinned_(false),
+	thread_(NULL),
+	work_(service_)
+{
+	thread_ = new boost::thread(boost::bind(&boost::asio::io_service::run, &service_));
+}
+
+IoThread::~IoThread()
+{
+	service_.stop();
+	thread_->join();
+	delete thread_;
+}
+
+boost::asio::io_service &IoThread::service()
+{
+	return service_;
+}
+
+bool IoThread::setAffinity(const std::string &cpus)
+{
+	boost::mutex::scoped_lock lock(pinLock_);
+
+	if (pinned_ ? cpus == cpus_ : cpus.empty()) {
+		return true;
+	}
+
+	if (not pinThread(thread_->native_handle(), cpus)) {
+		return false;
+	}
+
+	cpus_ = cpus;
+	pinned_ = not cpus.empty();
+	service_.post(boost::bind(pinned_ ? &preferLocalNode : &resetMemoryPolicy));
+	return true;
+}
+
+std::string IoThread::placement()
+{
+	return describePlacement(thread_->native_handle());
+}
+
+IoServicePool::IoServicePool(size_t threads) :
+	next_(0)
+{
+	for (size_t i = 0; i != std::max(threads, size_t(1)); ++i) {
+		threads_.push_back(boost::shared_ptr<IoThread>(new IoThread));
+	}
+}
+
+// Never destroyed, since clients may still be released by other
+// threads while the process exits
+IoServicePool &IoServicePool::clients()
+{
+	static IoServicePool *pool = new IoServicePool(std::min(size_t(IO_POOL_MAX_THREADS), size_t(boost::thread::hardware_concurrency() / 2)));
+	return *pool;
+}
+
+boost::shared_ptr<IoThread> IoServicePool::next()
+{
+	boost::mutex::scoped_lock lock(nextLock_);
+	return threads_[next_++ % threads_.size()];
+}
@@ -0,0 +1,68 @@
+#ifndef IOSERVICEPOOL_H_
+#define IOSERVICEPOOL_H_
+
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+// The most threads the client connections share
+#define IO_POOL_MAX_THREADS 4
+
+/*
+ * One thread running an io_service, shared by every socket
+ * handed to it.  The handlers of one io_service never run
+ * at the same time
+ */
+class IoThread
+{
+public:
+	IoThread();
+	~IoThread();
+
+	boost::asio::io_service &service();
+
+	// Pin the thread, which then allocates from its own node.
+	// Pinning it to the same CPUs again does nothing, as does an
+	// empty list unless the thread was pinned before
+	bool setAffinity(const std::string &cpus);
+	std::string placement();
+
+private:
+	IoThread(const IoThread &copy);
+	IoThread &operator=(const IoThread &copy);
+
+	std::string cpus_;
+	bool pinned_;
+	boost::mutex pinLock_;
+	boost::asio::io_service service_;
+	boost::thread *thread_;
+	boost::asio::io_service::work work_;
+};
+
+/*
+ * A small, fixed set of I/O threads that sockets are spread
+ * across in turn, so a connection with thousands of ports
+ * doesn't start thousands of threads.  Thread safe
+ */
+class IoServicePool
+{
+public:
+	explicit IoServicePool(size_t threads);
+
+	// The pool every client connection runs on
+	static IoServicePool &clients();
+
+	boost::shared_ptr<IoThread> next();
+
+private:
+	IoServicePool(const IoServicePool &copy);
+	IoServicePool &operator=(const IoServicePool &copy);
+
+	size_t next_;
+	boost::mutex nextLock_;
+	std::vector<boost::shared_ptr<IoThread> > threads_;
+};
+
+#endif /* IOSERVICEPOOL_H_ */
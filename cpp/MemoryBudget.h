@@ -0,0 +1,149 @@
+#ifndef MEMORYBUDGET_H_
+#define MEMORYBUDGET_H_
+
+#include <stddef.h>
+#include <string>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/*
+ * What to do when the data queued for every socket together
+ * exceeds the budget
+ */
+enum BudgetPolicy {
+	// Drop the data queued for the sockets furthest behind
+	BUDGET_SHED_SLOWEST,
+	// Stop taking packets until the sockets drain, so the input
+	// queues fill and slow the producer down
+	BUDGET_BACKPRESSURE
+};
+
+inline bool parseBudgetPolicy(const std::string &name, BudgetPolicy &policy)
+{
+	if (name == "shed_slowest") {
+		policy = BUDGET_SHED_SLOWEST;
+	} else if (name == "backpressure") {
+		policy = BUDGET_BACKPRESSURE;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+// Backpressure waits this many seconds for the sockets to drain
+// before shedding data anyway
+#define BUDGET_MAX_WAIT 1.0
+
+/*
+ * The bytes queued for every outgoing socket of the sink,
+ * against a limit shared by all of them.  Each send queue
+ * adds what it queues and releases what it writes or drops.
+ * A limit of zero means no limit.  Thread safe; adding and
+ * releasing are lock free, the lock is only taken to wake a
+ * thread waiting for the queues to drain
+ */
+class MemoryBudget
+{
+public:
+	MemoryBudget() :
+		highWater_(0),
+		limit_(0),
+		used_(0),
+		waitFor_(0),
+		waiting_(false)
+	{}
+
+	void setLimit(size_t bytes)
+	{
+		__atomic_store_n(&limit_, bytes, __ATOMIC_SEQ_CST);
+
+		boost::mutex::scoped_lock lock(lock_);
+		drained_.notify_all();
+	}
+
+	void add(size_t bytes)
+	{
+		size_t used = __atomic_add_fetch(&used_, bytes, __ATOMIC_SEQ_CST);
+		size_t highWater = __atomic_load_n(&highWater_, __ATOMIC_RELAXED);
+
+		while (used > highWater && not __atomic_compare_exchange_n(&highWater_, &highWater, used, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			;
+	}
+
+	void release(size_t bytes)
+	{
+		size_t used = __atomic_sub_fetch(&used_, bytes, __ATOMIC_SEQ_CST);
+
+		// Pairs with the waiter storing waiting_ before it reads
+		// used_, so one of the two sees the other
+		if (__atomic_load_n(&waiting_, __ATOMIC_SEQ_CST) && used <= __atomic_load_n(&waitFor_, __ATOMIC_RELAXED))
+		{
+			boost::mutex::scoped_lock lock(lock_);
+			drained_.notify_all();
+		}
+	}
+
+	bool exceeded() const
+	{
+		size_t limit = __atomic_load_n(&limit_, __ATOMIC_RELAXED);
+
+		return limit && __atomic_load_n(&used_, __ATOMIC_RELAXED) > limit;
+	}
+
+	// Wait up to timeout seconds for the usage to fall within the
+	// limit, returning whether it did
+	bool waitWithinLimit(double timeout)
+	{
+		size_t limit = __atomic_load_n(&limit_, __ATOMIC_RELAXED);
+
+		if (not limit)
+			return true;
+
+		return waitUntilAtMost(limit, timeout);
+	}
+
+	// Wait up to timeout seconds for the usage to fall to bytes or
+	// less, returning whether it did.  Only one thread may wait
+	bool waitUntilAtMost(size_t bytes, double timeout)
+	{
+		if (used() <= bytes)
+			return true;
+
+		boost::mutex::scoped_lock lock(lock_);
+		boost::system_time deadline = boost::get_system_time() + boost::posix_time::microseconds(long(timeout * 1e6));
+
+		__atomic_store_n(&waitFor_, bytes, __ATOMIC_RELAXED);
+		__atomic_store_n(&waiting_, true, __ATOMIC_SEQ_CST);
+
+		while (used() > bytes)
+		{
+			if (not drained_.timed_wait(lock, deadline))
+				break;
+		}
+
+		__atomic_store_n(&waiting_, false, __ATOMIC_RELAXED);
+		return used() <= bytes;
+	}
+
+	size_t used() const
+	{
+		return __atomic_load_n(&used_, __ATOMIC_SEQ_CST);
+	}
+
+	size_t highWater() const
+	{
+		return __atomic_load_n(&highWater_, __ATOMIC_RELAXED);
+	}
+
+private:
+	boost::condition_variable drained_;
+	size_t highWater_;
+	size_t limit_;
+	boost::mutex lock_;
+	size_t used_;
+	size_t waitFor_;
+	bool waiting_;
+};
+
+#endif /* MEMORYBUDGET_H_ */
@@ -0,0 +1,281 @@
+#include "PacketCapture.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "corelog.h"
+
+static double monotonicNow()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t padded(size_t size)
+{
+	return (size + 7) & ~size_t(7);
+}
+
+CaptureWriter::CaptureWriter() :
+	fd_(-1),
+	full_(false),
+	map_(NULL),
+	mapped_(0),
+	maxBytes_(0),
+	start_(0),
+	used_(0)
+{
+}
+
+CaptureWriter::~CaptureWriter()
+{
+	close();
+}
+
+bool CaptureWriter::open(const std::string &path, double maxBytes)
+{
+	close();
+
+	fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	if (fd_ < 0) {
+		CORE_LOG_ERROR(CaptureWriter, "Unable to create capture file " << path << ": " << strerror(errno));
+		return false;
+	}
+
+	full_ = false;
+	maxBytes_ = maxBytes;
+	streams_.clear();
+	path_ = path;
+	start_ = monotonicNow();
+	used_ = 0;
+
+	if (not grow(CAPTURE_MAGIC_SIZE)) {
+		close();
+		return false;
+	}
+
+	memcpy(map_, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE);
+	used_ = CAPTURE_MAGIC_SIZE;
+
+	return true;
+}
+
+/*
+ * Unmap the file and cut it down to what was written
+ */
+void CaptureWriter::close()
+{
+	if (map_) {
+		munmap(map_, mapped_);
+		map_ = NULL;
+		mapped_ = 0;
+	}
+
+	if (fd_ >= 0) {
+		if (ftruncate(fd_, used_) != 0) {
+			CORE_LOG_ERROR(CaptureWriter, "Unable to trim capture file " << path_ << ": " << strerror(errno));
+		}
+
+		::close(fd_);
+		fd_ = -1;
+	}
+}
+
+bool CaptureWriter::grow(size_t needed)
+{
+	if (used_ + needed <= mapped_) {
+		return true;
+	}
+
+	size_t size = mapped_;
+
+	while (size < used_ + needed) {
+		size += CAPTURE_GROW_SIZE;
+	}
+
+	if (map_) {
+		munmap(map_, mapped_);
+		map_ = NULL;
+		mapped_ = 0;
+	}
+
+	if (ftruncate(fd_, size) != 0) {
+		CORE_LOG_ERROR(CaptureWriter, "Unable to extend capture file " << path_ << ": " << strerror(errno));
+		return false;
+	}
+
+	void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+
+	if (map == MAP_FAILED) {
+		CORE_LOG_ERROR(CaptureWriter, "Unable to map capture file " << path_ << ": " << strerror(errno));
+		return false;
+	}
+
+	map_ = static_cast<char *>(map);
+	mapped_ = size;
+
+	return true;
+}
+
+bool CaptureWriter::write(const CapturedPacket &packet)
+{
+	if (fd_ < 0 or full_) {
+		return false;
+	}
+
+	size_t recordSize = padded(sizeof(CaptureRecordHeader) + packet.streamID.size() + packet.size);
+
+	if (maxBytes_ > 0 and used_ + recordSize > maxBytes_) {
+		CORE_LOG_WARN(CaptureWriter, "Capture file " << path_ << " is full, no longer capturing");
+		full_ = true;
+		return false;
+	}
+
+	if (not grow(recordSize)) {
+		full_ = true;
+		return false;
+	}
+
+	CaptureRecordHeader header;
+	memset(&header, 0, sizeof(header));
+
+	header.recordSize = recordSize;
+	header.type = packet.type;
+	header.flags = packet.flags;
+	header.streamIDSize = packet.streamID.size();
+	header.dataSize = packet.size;
+	header.arrival = monotonicNow() - start_;
+	header.time = packet.time;
+
+	if (streams_.insert(packet.streamID).second) {
+		header.flags |= CAPTURE_HAS_SRI;
+	}
+
+	if (header.flags & CAPTURE_HAS_SRI) {
+		header.sri = packet.sri;
+	}
+
+	char *record = map_ + used_;
+
+	memcpy(record, &header, sizeof(header));
+	memcpy(record + sizeof(header), packet.streamID.data(), packet.streamID.size());
+	memcpy(record + sizeof(header) + packet.streamID.size(), packet.data, packet.size);
+
+	used_ += recordSize;
+
+	return true;
+}
+
+CaptureReader::CaptureReader() :
+	fd_(-1),
+	map_(NULL),
+	offset_(0),
+	size_(0)
+{
+}
+
+CaptureReader::~CaptureReader()
+{
+	close();
+}
+
+bool CaptureReader::open(const std::string &path)
+{
+	close();
+
+	fd_ = ::open(path.c_str(), O_RDONLY);
+
+	if (fd_ < 0) {
+		CORE_LOG_ERROR(CaptureReader, "Unable to open capture file " << path << ": " << strerror(errno));
+		return false;
+	}
+
+	struct stat info;
+
+	if (fstat(fd_, &info) != 0 or size_t(info.st_size) < CAPTURE_MAGIC_SIZE) {
+		CORE_LOG_ERROR(CaptureReader, path << " is not a capture file");
+		close();
+		return false;
+	}
+
+	void *map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd_, 0);
+
+	if (map == MAP_FAILED) {
+		CORE_LOG_ERROR(CaptureReader, "Unable to map capture file " << path << ": " << strerror(errno));
+		close();
+		return false;
+	}
+
+	map_ = static_cast<const char *>(map);
+	size_ = info.st_size;
+
+	if (memcmp(map_, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE) != 0) {
+		CORE_LOG_ERROR(CaptureReader, path << " is not a capture file");
+		close();
+		return false;
+	}
+
+	// The records are read in order, so let the kernel read ahead
+	madvise(const_cast<char *>(map_), size_, MADV_SEQUENTIAL);
+	rewind();
+
+	return true;
+}
+
+void CaptureReader::close()
+{
+	if (map_) {
+		munmap(const_cast<char *>(map_), size_);
+		map_ = NULL;
+		size_ = 0;
+	}
+
+	if (fd_ >= 0) {
+		::close(fd_);
+		fd_ = -1;
+	}
+}
+
+bool CaptureReader::next(CapturedPacket &packet)
+{
+	if (not map_ or offset_ + sizeof(CaptureRecordHeader) > size_) {
+		return false;
+	}
+
+	CaptureRecordHeader header;
+	memcpy(&header, map_ + offset_, sizeof(header));
+
+	if (header.recordSize < sizeof(header) + header.streamIDSize + header.dataSize or
+			offset_ + header.recordSize > size_ or header.type > CAPTURE_DOUBLE) {
+		CORE_LOG_ERROR(CaptureReader, "Damaged capture record at offset " << offset_);
+		offset_ = size_;
+		return false;
+	}
+
+	const char *record = map_ + offset_;
+
+	packet.arrival = header.arrival;
+	packet.data = record + sizeof(header) + header.streamIDSize;
+	packet.flags = header.flags;
+	packet.sri = header.sri;
+	packet.size = header.dataSize;
+	packet.streamID.assign(record + sizeof(header), header.streamIDSize);
+	packet.time = header.time;
+	packet.type = CaptureDataType(header.type);
+
+	offset_ += header.recordSize;
+
+	return true;
+}
+
+void CaptureReader::rewind()
+{
+	offset_ = CAPTURE_MAGIC_SIZE;
+}
@@ -0,0 +1,181 @@
+#ifndef PACKETCAPTURE_H_
+#define PACKETCAPTURE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <set>
+#include <string>
+
+/*
+ * Captures of the packets arriving at the sink, so a problem
+ * seen with real traffic can be replayed later.  A capture
+ * file is
+ *
+ *   bytes 0-7    magic "CSKCAP01"
+ *
+ * followed by one record per packet, each starting with a
+ * CaptureRecordHeader and then the stream ID and the samples,
+ * padded to a multiple of 8 bytes.  The SRI is only kept in
+ * the first record of each stream and the records where it
+ * changed.  Everything is in the byte order of the machine
+ * that captured it
+ */
+#define CAPTURE_MAGIC "CSKCAP01"
+#define CAPTURE_MAGIC_SIZE 8
+
+// The capture file grows by this much at a time
+#define CAPTURE_GROW_SIZE (64 * 1024 * 1024)
+
+enum CaptureDataType {
+	CAPTURE_OCTET,
+	CAPTURE_CHAR,
+	CAPTURE_SHORT,
+	CAPTURE_USHORT,
+	CAPTURE_LONG,
+	CAPTURE_ULONG,
+	CAPTURE_FLOAT,
+	CAPTURE_DOUBLE
+};
+
+template<typename T> CaptureDataType captureDataType();
+template<> inline CaptureDataType captureDataType<unsigned char>() { return CAPTURE_OCTET; }
+template<> inline CaptureDataType captureDataType<char>() { return CAPTURE_CHAR; }
+template<> inline CaptureDataType captureDataType<signed char>() { return CAPTURE_CHAR; }
+template<> inline CaptureDataType captureDataType<int16_t>() { return CAPTURE_SHORT; }
+template<> inline CaptureDataType captureDataType<uint16_t>() { return CAPTURE_USHORT; }
+template<> inline CaptureDataType captureDataType<int32_t>() { return CAPTURE_LONG; }
+template<> inline CaptureDataType captureDataType<uint32_t>() { return CAPTURE_ULONG; }
+template<> inline CaptureDataType captureDataType<float>() { return CAPTURE_FLOAT; }
+template<> inline CaptureDataType captureDataType<double>() { return CAPTURE_DOUBLE; }
+
+// Packet flags
+#define CAPTURE_EOS 0x01
+#define CAPTURE_SRI_CHANGED 0x02
+#define CAPTURE_QUEUE_FLUSHED 0x04
+#define CAPTURE_HAS_SRI 0x08
+
+// The fields of BULKIO::PrecisionUTCTime
+struct CaptureTime {
+	double toff;
+	double twsec;
+	double tfsec;
+	int16_t tcmode;
+	int16_t tcstatus;
+	uint32_t reserved;
+};
+
+// The fields of BULKIO::StreamSRI, other than the keywords
+struct CaptureSRI {
+	double xstart;
+	double xdelta;
+	double ystart;
+	double ydelta;
+	int32_t hversion;
+	int32_t subsize;
+	int16_t xunits;
+	int16_t yunits;
+	int16_t mode;
+	uint8_t blocking;
+	uint8_t reserved;
+};
+
+struct CaptureRecordHeader {
+	uint32_t recordSize;
+	uint8_t type;
+	uint8_t flags;
+	uint16_t streamIDSize;
+	uint64_t dataSize;
+	double arrival;
+	CaptureTime time;
+	CaptureSRI sri;
+};
+
+/*
+ * One packet, as captured or replayed.  When read back, data
+ * points into the mapped file and is valid until the reader
+ * is closed
+ */
+struct CapturedPacket {
+	CapturedPacket() :
+		arrival(0),
+		data(NULL),
+		flags(0),
+		size(0),
+		type(CAPTURE_OCTET)
+	{}
+
+	double arrival;
+	const char *data;
+	uint8_t flags;
+	CaptureSRI sri;
+	size_t size;
+	std::string streamID;
+	CaptureTime time;
+	CaptureDataType type;
+};
+
+/*
+ * Appends packets to a capture file through a shared mapping,
+ * growing the file as it goes and trimming it when closed.
+ * Capturing stops once the file would exceed maxBytes, when
+ * it isn't zero.  Not thread safe
+ */
+class CaptureWriter
+{
+public:
+	CaptureWriter();
+	~CaptureWriter();
+
+	bool open(const std::string &path, double maxBytes);
+	void close();
+
+	// Returns false once the capture is full
+	bool write(const CapturedPacket &packet);
+
+	size_t bytesWritten() const { return used_; }
+
+private:
+	CaptureWriter(const CaptureWriter &copy);
+	CaptureWriter &operator=(const CaptureWriter &copy);
+
+	bool grow(size_t needed);
+
+	int fd_;
+	bool full_;
+	char *map_;
+	size_t mapped_;
+	double maxBytes_;
+	std::string path_;
+	double start_;
+	std::set<std::string> streams_;
+	size_t used_;
+};
+
+/*
+ * Reads a capture file back in order through a read only
+ * mapping
+ */
+class CaptureReader
+{
+public:
+	CaptureReader();
+	~CaptureReader();
+
+	bool open(const std::string &path);
+	void close();
+
+	// Returns false at the end of the file or at a damaged record
+	bool next(CapturedPacket &packet);
+	void rewind();
+
+private:
+	CaptureReader(const CaptureReader &copy);
+	CaptureReader &operator=(const CaptureReader &copy);
+
+	int fd_;
+	const char *map_;
+	size_t offset_;
+	size_t size_;
+};
+
+#endif /* PACKETCAPTURE_H_ */
@@ -0,0 +1,369 @@
+#ifndef SENDQUEUE_H_
+#define SENDQUEUE_H_
+
+#include <deque>
+#include <vector>
+#include <boost/asio/buffer.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "BufferArena.h"
+#include "MemoryBudget.h"
+#include "tokenbucket.h"
+
+/*
+ * Packet data and a count of the send queues holding it, so
+ * that data sent to several sockets is counted against the
+ * memory budget once, until the last of them lets it go.
+ * Every queue a buffer is pushed to must share one budget
+ */
+class SendBuffer : public DataBuffer
+{
+public:
+	explicit SendBuffer(size_t size) :
+		DataBuffer(size),
+		queued_(0)
+	{}
+
+	SendBuffer(const char *first, const char *last) :
+		DataBuffer(first, last),
+		queued_(0)
+	{}
+
+	// Count another queue holding the buffer, returning true if
+	// it is the first
+	bool hold() const
+	{
+		return __atomic_fetch_add(&queued_, 1, __ATOMIC_ACQ_REL) == 0;
+	}
+
+	// Count a queue letting the buffer go, returning true if it
+	// was the last
+	bool letGo() const
+	{
+		return __atomic_sub_fetch(&queued_, 1, __ATOMIC_ACQ_REL) == 0;
+	}
+
+private:
+	SendBuffer(const SendBuffer &);
+	SendBuffer &operator=(const SendBuffer &);
+
+	mutable size_t queued_;
+};
+
+// Packet data shared, without copying, by every socket it is sent to
+typedef boost::shared_ptr<const SendBuffer> SharedBuffer;
+
+template<typename T, typename U>
+SharedBuffer makeSharedBuffer(const std::vector<T, U> &data)
+{
+	const char *bytes = reinterpret_cast<const char *>(data.data());
+
+	return SharedBuffer(new SendBuffer(bytes, bytes + data.size() * sizeof(T)));
+}
+
+// The most buffers gathered into one write
+#define SEND_MAX_GATHER 64
+
+/*
+ * The outgoing data of a single socket.  Buffers are written
+ * in order, several at a time with a vectored write.  When a
+ * rate limit is set the writes are no larger than the burst
+ * size and next() returns how long to wait before each one, so
+ * the output is paced instead of being written in bursts.
+ *
+ * When coalescing, next() also holds data back until enough of
+ * it is queued or the oldest buffer has waited long enough, so
+ * small packets share a system call.
+ *
+ * When a budget is set, the queued buffers are counted against
+ * it, each buffer once however many queues hold it.
+ *
+ * Each buffer is stamped when it is queued, so the owner can
+ * tell how far behind the reader of the socket has fallen.
+ *
+ * This class is not thread safe, the owner must serialize
+ * access to it
+ */
+class SendQueue
+{
+public:
+	SendQueue() :
+		coalesceBytes_(0),
+		coalesceDelay_(0),
+		drainedBytes_(0),
+		holding_(false),
+		inFlight_(0),
+		offset_(0),
+		pacingDelay_(0),
+		pacingSince_(0),
+		queuedBytes_(0),
+		waiting_(false),
+		writing_(false)
+	{}
+
+	~SendQueue()
+	{
+		letGo(0, buffers_.size());
+	}
+
+	// Move the queued buffers over to a new budget
+	void setBudget(const boost::shared_ptr<MemoryBudget> &budget)
+	{
+		if (budget == budget_)
+			return;
+
+		letGo(0, buffers_.size());
+		budget_ = budget;
+
+		for (size_t i = 0; i != buffers_.size(); ++i)
+			hold(*buffers_[i]);
+	}
+
+	void setRateLimit(double bytesPerSecond, size_t burstSize)
+	{
+		bucket_.configure(bytesPerSecond, burstSize);
+	}
+
+	// Hold writes back until bytes are queued or the oldest
+	// buffer has waited maxDelay seconds.  0 bytes turns it off
+	void setCoalescing(size_t bytes, double maxDelay)
+	{
+		coalesceBytes_ = bytes;
+		coalesceDelay_ = maxDelay;
+	}
+
+	// Queue a buffer, returning true if the caller needs to
+	// start writing.  That includes when enough data has built
+	// up while writes were being held back, in which case the
+	// caller abandons its wait for the deadline
+	bool push(const SharedBuffer &buffer)
+	{
+		if (buffer->empty())
+			return false;
+
+		buffers_.push_back(buffer);
+		queuedAt_.push_back(TokenBucket::now());
+		queuedBytes_ += buffer->size();
+		hold(*buffer);
+
+		if (holding_ && queuedBytes_ >= coalesceBytes_)
+		{
+			holding_ = false;
+			return true;
+		}
+
+		if (writing_)
+			return false;
+
+		writing_ = true;
+		return true;
+	}
+
+	// True while next() is holding writes back to coalesce them
+	bool holding() const
+	{
+		return holding_;
+	}
+
+	// Gather the next buffers to write, returning false if there
+	// is nothing left.  If delay is non-zero they must not be
+	// written until delay seconds have passed and next() is called
+	// again
+	bool next(std::vector<boost::asio::const_buffer> &chunks, double &delay)
+	{
+		chunks.clear();
+		inFlight_ = 0;
+
+		if (buffers_.empty())
+		{
+			holding_ = false;
+			writing_ = false;
+			return false;
+		}
+
+		if (coalesceBytes_ && queuedBytes_ < coalesceBytes_)
+		{
+			delay = queuedAt_.front() + coalesceDelay_ - TokenBucket::now();
+
+			if (delay > 0)
+			{
+				holding_ = true;
+				return true;
+			}
+		}
+
+		holding_ = false;
+
+		size_t limit = bucket_.limited() ? bucket_.burst() : size_t(-1);
+		size_t size = 0;
+
+		for (size_t i = 0; i != buffers_.size() && chunks.size() != SEND_MAX_GATHER && size < limit; ++i)
+		{
+			const DataBuffer &data = *buffers_[i];
+			size_t start = (i == 0) ? offset_ : 0;
+			size_t length = std::min(data.size() - start, limit - size);
+
+			chunks.push_back(boost::asio::buffer(&data[start], length));
+			size += length;
+		}
+
+		delay = bucket_.acquire(size);
+
+		// Measure the time actually spent waiting on the rate limit
+		if (delay > 0 && not waiting_)
+		{
+			waiting_ = true;
+			pacingSince_ = TokenBucket::now();
+		}
+		else if (delay == 0 && waiting_)
+		{
+			waiting_ = false;
+			pacingDelay_ += TokenBucket::now() - pacingSince_;
+		}
+
+		if (delay == 0)
+			inFlight_ = chunks.size();
+
+		return true;
+	}
+
+	// Mark bytes as written, returning true if there is more to
+	// write
+	bool consume(size_t bytes)
+	{
+		queuedBytes_ -= bytes;
+		drainedBytes_ += bytes;
+		inFlight_ = 0;
+
+		while (bytes)
+		{
+			size_t left = buffers_.front()->size() - offset_;
+
+			if (bytes < left)
+			{
+				offset_ += bytes;
+				break;
+			}
+
+			bytes -= left;
+			letGo(0, 1);
+			buffers_.pop_front();
+			queuedAt_.pop_front();
+			offset_ = 0;
+		}
+
+		writing_ = not buffers_.empty();
+		return writing_;
+	}
+
+	// Drop everything queued, such as when the socket is closed
+	void clear()
+	{
+		letGo(0, buffers_.size());
+		buffers_.clear();
+		queuedAt_.clear();
+		holding_ = false;
+		inFlight_ = 0;
+		offset_ = 0;
+		queuedBytes_ = 0;
+		waiting_ = false;
+		writing_ = false;
+	}
+
+	// Drop everything that isn't being written, returning the
+	// number of bytes dropped.  The buffers a write is using are
+	// kept, as is the one at the front during a wait
+	size_t shed()
+	{
+		size_t kept = writingBuffers();
+		size_t dropped = 0;
+
+		for (size_t i = kept; i != buffers_.size(); ++i)
+			dropped += buffers_[i]->size() - ((i == 0) ? offset_ : 0);
+
+		letGo(kept, buffers_.size());
+		buffers_.resize(kept);
+		queuedAt_.resize(kept);
+		queuedBytes_ -= dropped;
+
+		if (kept == 0)
+			offset_ = 0;
+
+		return dropped;
+	}
+
+	// Total seconds spent waiting on the rate limit
+	double pacingDelay() const
+	{
+		return pacingDelay_;
+	}
+
+	size_t queuedBytes() const
+	{
+		return queuedBytes_;
+	}
+
+	// Seconds the oldest data that isn't being written has been
+	// queued.  What a write is using is left out, since it can't
+	// be shed; otherwise a session that was just shed would still
+	// look behind
+	double lag() const
+	{
+		size_t writing = writingBuffers();
+
+		return queuedAt_.size() <= writing ? 0 : TokenBucket::now() - queuedAt_[writing];
+	}
+
+	// Total bytes written to the socket
+	double drainedBytes() const
+	{
+		return drainedBytes_;
+	}
+
+private:
+	// The buffers at the front that a write is using, or that the
+	// next one is waiting to use
+	size_t writingBuffers() const
+	{
+		if (not writing_ || buffers_.empty())
+			return 0;
+
+		return std::min(std::max(inFlight_, size_t(1)), buffers_.size());
+	}
+
+	// Charge a buffer to the budget when the first queue takes it
+	void hold(const SendBuffer &buffer)
+	{
+		if (buffer.hold() && budget_)
+			budget_->add(buffer.size());
+	}
+
+	// Release the buffers from first to last from the budget once
+	// no other queue holds them
+	void letGo(size_t first, size_t last)
+	{
+		for (size_t i = first; i != last; ++i)
+		{
+			if (buffers_[i]->letGo() && budget_)
+				budget_->release(buffers_[i]->size());
+		}
+	}
+
+	TokenBucket bucket_;
+	boost::shared_ptr<MemoryBudget> budget_;
+	std::deque<SharedBuffer> buffers_;
+	size_t coalesceBytes_;
+	double coalesceDelay_;
+	double drainedBytes_;
+	bool holding_;
+	size_t inFlight_;
+	size_t offset_;
+	double pacingDelay_;
+	double pacingSince_;
+	std::deque<double> queuedAt_;
+	size_t queuedBytes_;
+	bool waiting_;
+	bool writing_;
+};
+
+#endif /* SENDQUEUE_H_ */
@@ -0,0 +1,108 @@
+#ifndef SINKCONFIG_H_
+#define SINKCONFIG_H_
+
+#include <string>
+#include <vector>
+
+/*
+ * The settings of one connection.  This mirrors the
+ * Connection property, field for field, without depending
+ * on the framework, and has the same defaults
+ */
+struct ConnectionConfig {
+	ConnectionConfig() :
+		connection_type("server"),
+		byte_swap(1, 0),
+		ports(1, 32191),
+		output_format("native"),
+		scale_factor(1.0),
+		compression("none"),
+		rate_limit(0),
+		burst_size(65536),
+		distribution("copy"),
+		stripe_size(0),
+		inbound_mode("buffer"),
+		inbound_buffer_size(1048576),
+		read_chunk_size(65536),
+		connect_timeout(5.0),
+		coalesce_bytes(0),
+		coalesce_delay(0.001),
+		slow_consumer_lag(0),
+		slow_consumer_bytes(0),
+		slow_consumer_action("disconnect")
+	{}
+
+	std::string connection_type;
+	std::string ip_address;
+	std::vector<unsigned short> byte_swap;
+	std::vector<unsigned short> ports;
+	std::string output_format;
+	float scale_factor;
+	std::string compression;
+	double rate_limit;
+	unsigned int burst_size;
+	std::string distribution;
+	unsigned int stripe_size;
+	std::string inbound_mode;
+	unsigned int inbound_buffer_size;
+	unsigned int read_chunk_size;
+	std::string port_ranges;
+	double connect_timeout;
+	unsigned int coalesce_bytes;
+	double coalesce_delay;
+	double slow_consumer_lag;
+	unsigned int slow_consumer_bytes;
+	std::string slow_consumer_action;
+};
+
+inline bool operator==(const ConnectionConfig &lhs, const ConnectionConfig &rhs)
+{
+	return lhs.connection_type == rhs.connection_type && lhs.ip_address == rhs.ip_address &&
+			lhs.byte_swap == rhs.byte_swap && lhs.ports == rhs.ports &&
+			lhs.output_format == rhs.output_format && lhs.scale_factor == rhs.scale_factor &&
+			lhs.compression == rhs.compression && lhs.rate_limit == rhs.rate_limit &&
+			lhs.burst_size == rhs.burst_size && lhs.distribution == rhs.distribution &&
+			lhs.stripe_size == rhs.stripe_size && lhs.inbound_mode == rhs.inbound_mode &&
+			lhs.inbound_buffer_size == rhs.inbound_buffer_size && lhs.read_chunk_size == rhs.read_chunk_size &&
+			lhs.port_ranges == rhs.port_ranges && lhs.connect_timeout == rhs.connect_timeout &&
+			lhs.coalesce_bytes == rhs.coalesce_bytes && lhs.coalesce_delay == rhs.coalesce_delay &&
+			lhs.slow_consumer_lag == rhs.slow_consumer_lag && lhs.slow_consumer_bytes == rhs.slow_consumer_bytes &&
+			lhs.slow_consumer_action == rhs.slow_consumer_action;
+}
+
+inline bool operator!=(const ConnectionConfig &lhs, const ConnectionConfig &rhs)
+{
+	return not (lhs == rhs);
+}
+
+/*
+ * The status of one port of a connection, mirroring the
+ * ConnectionStats property
+ */
+struct ConnectionStatus {
+	ConnectionStatus() :
+		port(0),
+		bytes_per_second(0),
+		bytes_sent(0),
+		compression_ratio(1.0),
+		compression_cpu_time(0),
+		pacing_delay(0),
+		bytes_dropped(0),
+		packets_dropped(0),
+		slow_consumers(0)
+	{}
+
+	std::string ip_address;
+	unsigned short port;
+	std::string status;
+	float bytes_per_second;
+	double bytes_sent;
+	float compression_ratio;
+	double compression_cpu_time;
+	double pacing_delay;
+	double bytes_dropped;
+	unsigned int packets_dropped;
+	unsigned int slow_consumers;
+};
+
+#endif /* SINKCONFIG_H_ */
@@ -0,0 +1,765 @@
+#include "SinkEngine.h"
+#include "ConnectionSender.h"
+#include "portrange.h"
+#include <algorithm>
+#include <set>
+
+/*
+ * Orders connections by every setting except their
+ * ports and byte swaps, so entries that only differ
+ * in their ports compare equal and can be combined
+ */
+struct ConnectionSettingsLess
+{
+	bool operator()(const ConnectionConfig *lhs, const ConnectionConfig *rhs) const
+	{
+		if (lhs->connection_type != rhs->connection_type)
+			return lhs->connection_type < rhs->connection_type;
+		if (lhs->ip_address != rhs->ip_address)
+			return lhs->ip_address < rhs->ip_address;
+		if (lhs->output_format != rhs->output_format)
+			return lhs->output_format < rhs->output_format;
+		if (lhs->scale_factor != rhs->scale_factor)
+			return lhs->scale_factor < rhs->scale_factor;
+		if (lhs->compression != rhs->compression)
+			return lhs->compression < rhs->compression;
+		if (lhs->rate_limit != rhs->rate_limit)
+			return lhs->rate_limit < rhs->rate_limit;
+		if (lhs->burst_size != rhs->burst_size)
+			return lhs->burst_size < rhs->burst_size;
+		if (lhs->distribution != rhs->distribution)
+			return lhs->distribution < rhs->distribution;
+		if (lhs->stripe_size != rhs->stripe_size)
+			return lhs->stripe_size < rhs->stripe_size;
+		if (lhs->inbound_mode != rhs->inbound_mode)
+			return lhs->inbound_mode < rhs->inbound_mode;
+		if (lhs->inbound_buffer_size != rhs->inbound_buffer_size)
+			return lhs->inbound_buffer_size < rhs->inbound_buffer_size;
+		if (lhs->read_chunk_size != rhs->read_chunk_size)
+			return lhs->read_chunk_size < rhs->read_chunk_size;
+		if (lhs->connect_timeout != rhs->connect_timeout)
+			return lhs->connect_timeout < rhs->connect_timeout;
+		if (lhs->coalesce_bytes != rhs->coalesce_bytes)
+			return lhs->coalesce_bytes < rhs->coalesce_bytes;
+		if (lhs->coalesce_delay != rhs->coalesce_delay)
+			return lhs->coalesce_delay < rhs->coalesce_delay;
+		if (lhs->slow_consumer_lag != rhs->slow_consumer_lag)
+			return lhs->slow_consumer_lag < rhs->slow_consumer_lag;
+		if (lhs->slow_consumer_bytes != rhs->slow_consumer_bytes)
+			return lhs->slow_consumer_bytes < rhs->slow_consumer_bytes;
+		return lhs->slow_consumer_action < rhs->slow_consumer_action;
+	}
+};
+
+typedef std::pair<unsigned short, unsigned short> PortByteSwap;
+
+static bool portLess(const PortByteSwap &lhs, const PortByteSwap &rhs)
+{
+	return lhs.first < rhs.first;
+}
+
+/*
+ * Remove repeated ports from a connection, keeping the
+ * byte swap of the first one.  Combined entries are also
+ * sorted by port.  Returns the number of ports removed
+ */
+static size_t removeDuplicatePorts(ConnectionConfig &connection, bool sortPorts)
+{
+	std::vector<PortByteSwap> pairs;
+
+	pairs.reserve(connection.ports.size());
+
+	for (size_t i = 0; i < connection.ports.size(); ++i) {
+		pairs.push_back(PortByteSwap(connection.ports[i], connection.byte_swap[i]));
+	}
+
+	if (sortPorts) {
+		std::stable_sort(pairs.begin(), pairs.end(), portLess);
+	}
+
+	std::set<unsigned short> seen;
+
+	connection.ports.clear();
+	connection.byte_swap.clear();
+
+	for (std::vector<PortByteSwap>::const_iterator i = pairs.begin(); i != pairs.end(); ++i) {
+		if (seen.insert(i->first).second) {
+			connection.ports.push_back(i->first);
+			connection.byte_swap.push_back(i->second);
+		}
+	}
+
+	return pairs.size() - connection.ports.size();
+}
+
+SinkEngine::SinkEngine() :
+	budgetPolicy(BUDGET_SHED_SLOWEST),
+	connectionSet(new ConnectionSet),
+	highWatermark(0),
+	lossless(false),
+	lowWatermark(0),
+	memoryBudget(new MemoryBudget),
+	throttling(false)
+{
+}
+
+SinkEngine::~SinkEngine()
+{
+	senders.clear();
+	boost::atomic_store(&connectionSet, ConnectionSetPtr());
+}
+
+/*
+ * Clean up requested connection settings: fall back to
+ * defaults for anything unknown, expand the port ranges,
+ * and combine entries that only differ in their ports
+ */
+std::vector<ConnectionConfig> SinkEngine::normalize(const std::vector<ConnectionConfig> &requested)
+{
+	// First, clear out any server IP addresses and make sure the byte
+	// swap and port lists are the same size
+	std::vector<ConnectionConfig> cleanList;
+
+	for (std::vector<ConnectionConfig>::const_iterator i = requested.begin(); i != requested.end(); ++i) {
+		ConnectionConfig cleaned = *i;
+
+		// Append the ports of any ranges to the port list.  Ports
+		// without a byte swap of their own use the last one given
+		if (not cleaned.port_ranges.empty()) {
+			std::vector<unsigned short> rangePorts;
+
+			if (not parsePortRanges(cleaned.port_ranges, rangePorts)) {
+				CORE_LOG_WARN(SinkEngine, "Invalid port range in \"" << cleaned.port_ranges << "\", ignoring it");
+			}
+
+			unsigned short lastByteSwap = cleaned.byte_swap.empty() ? 0 : cleaned.byte_swap.back();
+
+			cleaned.ports.insert(cleaned.ports.end(), rangePorts.begin(), rangePorts.end());
+
+			if (cleaned.byte_swap.size() < cleaned.ports.size()) {
+				cleaned.byte_swap.resize(cleaned.ports.size(), lastByteSwap);
+			}
+
+			cleaned.port_ranges = "";
+		}
+
+		// Adjust the byte swap size to match the number of ports
+		if (cleaned.ports.size() != cleaned.byte_swap.size()) {
+			CORE_LOG_WARN(SinkEngine, "Port list and Byte Swap list differ in size, resizing");
+
+			cleaned.byte_swap.resize(cleaned.ports.size(), 0);
+		}
+
+		// Fall back to native samples for an unknown output format
+		SampleFormat format;
+
+		if (not parseSampleFormat(cleaned.output_format, format)) {
+			CORE_LOG_WARN(SinkEngine, "Unknown output format \"" << cleaned.output_format << "\", using native");
+
+			cleaned.output_format = "native";
+		}
+
+		// Fall back to uncompressed data for an unknown or unavailable
+		// compression
+		CompressionType compression;
+
+		if (not parseCompressionType(cleaned.compression, compression) || not compressionAvailable(compression)) {
+			CORE_LOG_WARN(SinkEngine, "Compression \"" << cleaned.compression << "\" is not available, using none");
+
+			cleaned.compression = "none";
+		}
+
+		// Fall back to copying for an unknown distribution.  Striped
+		// ports carry pieces of the same stream, so they must all use
+		// the same byte swap
+		DistributionMode distribution;
+
+		if (not parseDistributionMode(cleaned.distribution, distribution)) {
+			CORE_LOG_WARN(SinkEngine, "Unknown distribution \"" << cleaned.distribution << "\", using copy");
+
+			cleaned.distribution = "copy";
+		} else if (distribution != DISTRIBUTION_COPY && not cleaned.byte_swap.empty()) {
+			if (std::count(cleaned.byte_swap.begin(), cleaned.byte_swap.end(), cleaned.byte_swap[0]) != (int) cleaned.byte_swap.size()) {
+				CORE_LOG_WARN(SinkEngine, "Striped ports must share a byte swap, using " << cleaned.byte_swap[0] << " for every port");
+
+				cleaned.byte_swap.assign(cleaned.byte_swap.size(), cleaned.byte_swap[0]);
+			}
+		}
+
+		// Fall back to buffering for an unknown inbound mode
+		if (cleaned.inbound_mode != "buffer" && cleaned.inbound_mode != "discard") {
+			CORE_LOG_WARN(SinkEngine, "Unknown inbound mode \"" << cleaned.inbound_mode << "\", using buffer");
+
+			cleaned.inbound_mode = "buffer";
+		}
+
+		// Fall back to disconnecting for an unknown slow consumer action
+		if (cleaned.slow_consumer_action != "disconnect" && cleaned.slow_consumer_action != "drop") {
+			CORE_LOG_WARN(SinkEngine, "Unknown slow consumer action \"" << cleaned.slow_consumer_action << "\", using disconnect");
+
+			cleaned.slow_consumer_action = "disconnect";
+		}
+
+		// A burst of nothing would pace the output a byte at a time,
+		// so zero means the default burst
+		if (cleaned.burst_size == 0) {
+			CORE_LOG_WARN(SinkEngine, "A burst size of 0 is not allowed, using " << ConnectionConfig().burst_size);
+
+			cleaned.burst_size = ConnectionConfig().burst_size;
+		}
+
+		// Remove the IP address for a server connection
+		if (cleaned.connection_type == "server" && cleaned.ip_address != "") {
+			CORE_LOG_WARN(SinkEngine, "IP Address specified for server connection, removing");
+
+			cleaned.ip_address = "";
+		}
+
+		cleanList.push_back(cleaned);
+	}
+
+	// Now coalesce any servers or clients with duplicate information.
+	// Entries are looked up by their settings, so this takes O(n log n)
+	// time however many entries and ports there are
+	std::vector<ConnectionConfig> duplicateFree;
+	std::vector<bool> combined;
+	std::map<const ConnectionConfig *, size_t, ConnectionSettingsLess> settingsIndex;
+
+	for (std::vector<ConnectionConfig>::const_iterator i = cleanList.begin(); i != cleanList.end(); ++i) {
+		std::pair<std::map<const ConnectionConfig *, size_t, ConnectionSettingsLess>::iterator, bool> entry = settingsIndex.insert(std::make_pair(&(*i), duplicateFree.size()));
+
+		if (entry.second) {
+			// A matching entry wasn't found, add it to the back of the list
+			duplicateFree.push_back(*i);
+			combined.push_back(false);
+		} else {
+			// Augment the existing entry to contain the new data
+			ConnectionConfig &existing = duplicateFree[entry.first->second];
+
+			existing.ports.insert(existing.ports.end(), i->ports.begin(), i->ports.end());
+			existing.byte_swap.insert(existing.byte_swap.end(), i->byte_swap.begin(), i->byte_swap.end());
+			combined[entry.first->second] = true;
+		}
+	}
+
+	// Each port may only be used once per entry
+	for (size_t i = 0; i < duplicateFree.size(); ++i) {
+		size_t removed = removeDuplicatePorts(duplicateFree[i], combined[i]);
+
+		if (removed) {
+			CORE_LOG_WARN(SinkEngine, "Removed " << removed << " duplicate port(s) from a " << duplicateFree[i].connection_type << " connection");
+		}
+	}
+
+	return duplicateFree;
+}
+
+/*
+ * Apply new connection settings.  The settings as they were
+ * applied, after cleaning up and combining entries, are
+ * returned along with the status of every new port.  Ports
+ * whose settings are unchanged keep their sockets
+ */
+void SinkEngine::configure(const std::vector<ConnectionConfig> &requested, std::vector<ConnectionConfig> &applied, std::vector<ConnectionStatus> &statuses)
+{
+	std::vector<ConnectionConfig> duplicateFree = normalize(requested);
+
+	applied = duplicateFree;
+
+	// Only one new connection set is built at a time
+	boost::mutex::scoped_lock lock(reconfigureLock_);
+
+	ConnectionSetPtr current = boost::atomic_load(&connectionSet);
+	boost::shared_ptr<ConnectionSet> next(new ConnectionSet);
+
+	// Connections from the current set that haven't been carried over,
+	// looked up by their settings and by their type and IP address
+	typedef std::map<const ConnectionConfig *, boost::shared_ptr<InternalConnection>, ConnectionSettingsLess> SettingsMap;
+	typedef std::multimap<std::pair<std::string, std::string>, boost::shared_ptr<InternalConnection> > EndpointMap;
+
+	SettingsMap unusedBySettings;
+	EndpointMap unusedByEndpoints;
+
+	for (std::vector<boost::shared_ptr<InternalConnection> >::const_iterator i = current->connections.begin(); i != current->connections.end(); ++i) {
+		const ConnectionConfig &settings = (*i)->getConnection();
+
+		unusedBySettings.insert(std::make_pair(&settings, *i));
+		unusedByEndpoints.insert(std::make_pair(std::make_pair(settings.connection_type, settings.ip_address), *i));
+	}
+
+	next->compressionPool = current->compressionPool;
+
+	// Keep a list of the status of every new port
+	std::vector<ConnectionStatus> stats;
+	std::vector<ConnectionStatus> returned;
+
+	// Build the new set, leaving the current one untouched while it is
+	// in use
+	for (std::vector<ConnectionConfig>::const_iterator i = duplicateFree.begin(); i != duplicateFree.end(); ++i) {
+		std::pair<EndpointMap::iterator, EndpointMap::iterator> endpoints = unusedByEndpoints.equal_range(std::make_pair(i->connection_type, i->ip_address));
+		SettingsMap::iterator sameSettings = unusedBySettings.find(&(*i));
+		boost::shared_ptr<InternalConnection> found;
+		boost::shared_ptr<InternalConnection> connection;
+
+		// Prefer a connection with the same settings, otherwise take
+		// any with the same type and IP, whose sockets can be shared
+		// by the new one
+		if (sameSettings != unusedBySettings.end()) {
+			found = sameSettings->second;
+		} else if (endpoints.first != endpoints.second) {
+			found = endpoints.first->second;
+		}
+
+		if (found) {
+			unusedBySettings.erase(&found->getConnection());
+
+			for (EndpointMap::iterator j = endpoints.first; j != endpoints.second; ++j) {
+				if (j->second == found) {
+					unusedByEndpoints.erase(j);
+					break;
+				}
+			}
+		}
+
+		if (found && *found == *i) {
+			CORE_LOG_DEBUG(SinkEngine, "Keeping unchanged internal connection");
+			// Nothing has changed, so the connection can be shared as is
+			connection = found;
+		} else {
+			if (found) {
+				CORE_LOG_DEBUG(SinkEngine, "Updating a copy of an existing internal connection");
+				connection.reset(new InternalConnection(*found));
+			} else {
+				CORE_LOG_DEBUG(SinkEngine, "Adding new internal connection");
+				connection.reset(new InternalConnection());
+			}
+
+			connection->setMemoryBudget(memoryBudget);
+			returned = connection->setConnection(*i);
+			connection->setIoCpus(ioCpus);
+
+			stats.insert(stats.end(), returned.begin(), returned.end());
+		}
+
+		next->connections.push_back(connection);
+
+		std::vector<OutputFormat> formats = connection->getOutputFormats();
+
+		// Start the compression workers the first time they're needed
+		for (std::vector<OutputFormat>::const_iterator j = formats.begin(); j != formats.end(); ++j) {
+			if (j->compression != COMPRESSION_NONE && not next->compressionPool) {
+				next->compressionPool.reset(new CompressionPool(std::max(1u, boost::thread::hardware_concurrency() / 2)));
+			}
+		}
+
+		// Set the onlyTransforms flag if necessary
+		if (next->onlyTransforms) {
+			for (std::vector<OutputFormat>::const_iterator j = formats.begin(); j != formats.end(); ++j) {
+				if (not (next->onlyTransforms &= not j->isNative())) {
+					break;
+				}
+			}
+		}
+
+		// Set the performTransform flag if necessary
+		if (not next->performTransform) {
+			for (std::vector<OutputFormat>::const_iterator j = formats.begin(); j != formats.end(); ++j) {
+				if ((next->performTransform |= not j->isNative())) {
+					break;
+				}
+			}
+		}
+	}
+
+	// Publish the new set.  Removed connections are closed once the
+	// data path lets go of the old one
+	boost::atomic_store(&connectionSet, ConnectionSetPtr(next));
+
+	statuses.swap(stats);
+}
+
+
+/*
+ * Move the compressed frames that are ready into the data map,
+ * preserving the order of each stream.  The oldest frame is
+ * waited on for up to timeout, or indefinitely if too many
+ * frames are in flight
+ */
+void SinkEngine::collectCompressedFrames(outputDataMap &dataMap, const boost::posix_time::time_duration &timeout)
+{
+	std::map<OutputFormat, std::deque<CompressionJobPtr> >::iterator i = pendingFrames.begin();
+
+	while (i != pendingFrames.end()) {
+		std::deque<CompressionJobPtr> &jobs = i->second;
+
+		while (not jobs.empty()) {
+			CompressionJobPtr job = jobs.front();
+
+			if (jobs.size() > MAX_PENDING_FRAMES) {
+				while (not job->wait(boost::posix_time::seconds(1))) {
+					CORE_LOG_WARN_EVERY(SinkEngine, "Waiting on compression to catch up");
+				}
+			} else if (not job->wait(timeout)) {
+				break;
+			}
+
+			DataBuffer &frames = dataMap[i->first];
+			frames.insert(frames.end(), job->frame().begin(), job->frame().end());
+
+			CompressionStats &statistics = compressionStats[i->first];
+			statistics.compressedBytes += job->frame().size();
+			statistics.cpuTime += job->cpuTime();
+			statistics.rawBytes += job->rawSize();
+			sharedCompressionStats.reset();
+
+			jobs.pop_front();
+		}
+
+		if (jobs.empty()) {
+			pendingFrames.erase(i++);
+		} else {
+			++i;
+		}
+	}
+}
+
+/*
+ * Send compressed frames that finished after their packet was
+ * written.  Called when no new data arrived so the tail of a
+ * stream isn't held back until the next packet.  Returns true
+ * if anything was sent, in which case statuses holds the
+ * status of every port
+ */
+bool SinkEngine::flush(std::vector<ConnectionStatus> &statuses)
+{
+	ConnectionSetPtr connections = boost::atomic_load(&connectionSet);
+	outputDataMap frames;
+	std::vector<ConnectionStatus> returned;
+
+	statuses.clear();
+
+	collectCompressedFrames(frames, boost::posix_time::milliseconds(10));
+
+	if (frames.empty()) {
+		return false;
+	}
+
+	enforceBudget(connections);
+
+	unsigned long long start = readCycles();
+
+	if (not senders.empty()) {
+		sendToSenders(connections, frames, statuses);
+	} else {
+		for (std::vector<boost::shared_ptr<InternalConnection> >::const_iterator i = connections->connections.begin(); i != connections->connections.end(); ++i) {
+			returned = (*i)->writeByteSwap(frames, compressionStats);
+
+			statuses.insert(statuses.end(), returned.begin(), returned.end());
+		}
+	}
+
+	sendTime.add(readCycles() - start);
+
+	return true;
+}
+
+// True while compressed frames are waiting to be sent
+bool SinkEngine::framesPending() const
+{
+	return not pendingFrames.empty();
+}
+
+void SinkEngine::setMemoryBudget(size_t bytes, BudgetPolicy policy)
+{
+	__atomic_store_n(&budgetPolicy, policy, __ATOMIC_RELAXED);
+	memoryBudget->setLimit(bytes);
+}
+
+size_t SinkEngine::memoryUsed() const
+{
+	return memoryBudget->used();
+}
+
+size_t SinkEngine::memoryHighWater() const
+{
+	return memoryBudget->highWater();
+}
+
+void SinkEngine::setFlowControl(bool lossless, size_t highWatermark, size_t lowWatermark)
+{
+	__atomic_store_n(&this->highWatermark, highWatermark, __ATOMIC_RELAXED);
+	__atomic_store_n(&this->lowWatermark, std::min(lowWatermark, highWatermark), __ATOMIC_RELAXED);
+	__atomic_store_n(&this->lossless, lossless, __ATOMIC_RELEASE);
+}
+
+/*
+ * Whether the caller should take another packet from its
+ * input.  In lossless mode, once the queued data passes the
+ * high watermark, this waits up to timeout seconds for it to
+ * fall to the low watermark and returns false if it hasn't,
+ * so the packets stay queued upstream.  The gap between the
+ * watermarks keeps the input from stopping and starting on
+ * every packet
+ */
+bool SinkEngine::readyForPacket(double timeout)
+{
+	bool lossless = __atomic_load_n(&this->lossless, __ATOMIC_ACQUIRE);
+	size_t highWatermark = __atomic_load_n(&this->highWatermark, __ATOMIC_RELAXED);
+	size_t lowWatermark = __atomic_load_n(&this->lowWatermark, __ATOMIC_RELAXED);
+
+	if (not lossless or not highWatermark) {
+		__atomic_store_n(&throttling, false, __ATOMIC_RELAXED);
+		return true;
+	}
+
+	if (not __atomic_load_n(&throttling, __ATOMIC_RELAXED)) {
+		if (memoryBudget->used() <= highWatermark) {
+			return true;
+		}
+
+		CORE_LOG_DEBUG(SinkEngine, "Outbound queues passed " << highWatermark << " bytes, throttling the input");
+		__atomic_store_n(&throttling, true, __ATOMIC_RELAXED);
+	}
+
+	if (memoryBudget->waitUntilAtMost(lowWatermark, timeout)) {
+		CORE_LOG_DEBUG(SinkEngine, "Outbound queues drained to " << lowWatermark << " bytes, resuming the input");
+		__atomic_store_n(&throttling, false, __ATOMIC_RELAXED);
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * Whether a batch that has already taken bytes of input may take
+ * another packet.  In lossless mode the batch stops once the
+ * queued data and the batch together pass the high watermark, so
+ * batching doesn't carry the queues further past it than a
+ * single packet would
+ */
+bool SinkEngine::roomForBatch(size_t bytes) const
+{
+	size_t highWatermark = __atomic_load_n(&this->highWatermark, __ATOMIC_RELAXED);
+
+	if (not __atomic_load_n(&lossless, __ATOMIC_ACQUIRE) or not highWatermark) {
+		return true;
+	}
+
+	return memoryBudget->used() + bytes <= highWatermark;
+}
+
+// True while lossless mode is holding back the input
+bool SinkEngine::throttled() const
+{
+	return __atomic_load_n(&throttling, __ATOMIC_RELAXED);
+}
+
+/*
+ * Pinning is applied to the published connections at once and
+ * to the ports of later configurations as they are created
+ */
+void SinkEngine::setIoCpus(const std::string &cpus)
+{
+	boost::mutex::scoped_lock lock(reconfigureLock_);
+	ConnectionSetPtr connections = boost::atomic_load(&connectionSet);
+
+	ioCpus = cpus;
+
+	for (std::vector<boost::shared_ptr<InternalConnection> >::const_iterator i = connections->connections.begin(); i != connections->connections.end(); ++i) {
+		(*i)->setIoCpus(ioCpus);
+	}
+}
+
+void SinkEngine::ioPlacement(std::vector<std::string> &placements)
+{
+	boost::mutex::scoped_lock lock(reconfigureLock_);
+	ConnectionSetPtr connections = boost::atomic_load(&connectionSet);
+
+	for (std::vector<boost::shared_ptr<InternalConnection> >::const_iterator i = connections->connections.begin(); i != connections->connections.end(); ++i) {
+		(*i)->placement(placements);
+	}
+
+	boost::mutex::scoped_lock placementLock(placementLock_);
+	placements.insert(placements.end(), senderPlacement.begin(), senderPlacement.end());
+}
+
+void SinkEngine::setSenders(size_t threads, size_t queueDepth, size_t spin, const std::string &cpus)
+{
+	boost::shared_ptr<SenderSettings> settings(new SenderSettings);
+
+	settings->cpus = cpus;
+	settings->queueDepth = std::max(queueDepth, size_t(1));
+	settings->spin = spin;
+	settings->threads = threads;
+
+	boost::atomic_store(&senderSettings, boost::shared_ptr<const SenderSettings>(settings));
+}
+
+/*
+ * Replace the senders with the latest settings.  The old ones
+ * send everything they were given before they stop, so no
+ * packet is lost or sent out of order
+ */
+bool SinkEngine::applySenders()
+{
+	boost::shared_ptr<const SenderSettings> settings = boost::atomic_load(&senderSettings);
+
+	if (settings == senderSettingsApplied) {
+		return false;
+	}
+
+	senderSettingsApplied = settings;
+	senders.clear();
+	sentSet.reset();
+
+	std::vector<std::string> placements;
+	boost::shared_ptr<boost::barrier> handover;
+
+	if (settings->threads != 0) {
+		handover.reset(new boost::barrier(settings->threads));
+	}
+
+	for (size_t i = 0; i != settings->threads; ++i) {
+		boost::shared_ptr<ConnectionSender> sender(new ConnectionSender(i, settings->threads, settings->queueDepth, settings->spin, memoryBudget, handover));
+		std::ostringstream placement;
+
+		if (not settings->cpus.empty()) {
+			sender->setAffinity(settings->cpus);
+		}
+
+		placement << "sender " << i << ": " << sender->placement();
+		placements.push_back(placement.str());
+		senders.push_back(sender);
+	}
+
+	if (not senders.empty()) {
+		CORE_LOG_INFO(SinkEngine, "Writing the connections from " << senders.size() << " sender thread(s)");
+	}
+
+	boost::mutex::scoped_lock lock(placementLock_);
+	senderPlacement.swap(placements);
+
+	return true;
+}
+
+/*
+ * Hand a packet to every sender and collect the latest status
+ * of their ports, as of the last packet each has sent.  A new
+ * connection set travels with its first packet, and the
+ * senders retire the old one between themselves, so the
+ * writing thread never waits for them to go idle
+ */
+void SinkEngine::sendToSenders(const ConnectionSetPtr &connections, outputDataMap &data, std::vector<ConnectionStatus> &statuses)
+{
+	boost::shared_ptr<SendJob> job(new SendJob);
+
+	if (not sharedCompressionStats) {
+		sharedCompressionStats.reset(new compressionStatsMap(compressionStats));
+	}
+
+	job->compressionStats = sharedCompressionStats;
+	job->connections = connections;
+	job->data.swap(data);
+	job->newSet = (connections != sentSet);
+	sentSet = connections;
+
+	for (std::vector<boost::shared_ptr<ConnectionSender> >::const_iterator i = senders.begin(); i != senders.end(); ++i) {
+		(*i)->publish(job);
+	}
+
+	for (std::vector<boost::shared_ptr<ConnectionSender> >::const_iterator i = senders.begin(); i != senders.end(); ++i) {
+		(*i)->statuses(statuses);
+	}
+}
+
+/*
+ * Bring the queued data back within the budget before more is
+ * written.  With backpressure the caller waits for the sockets
+ * to drain, which holds up the input ports; if they don't drain
+ * in time, or the policy is to shed, the data queued for the
+ * slowest ports is dropped until the budget is met.  Nothing
+ * is dropped in lossless mode, where the watermarks hold the
+ * input back instead
+ */
+void SinkEngine::enforceBudget(const ConnectionSetPtr &connections)
+{
+	if (__atomic_load_n(&lossless, __ATOMIC_ACQUIRE) or not memoryBudget->exceeded()) {
+		return;
+	}
+
+	if (__atomic_load_n(&budgetPolicy, __ATOMIC_RELAXED) == BUDGET_BACKPRESSURE) {
+		if (memoryBudget->waitWithinLimit(BUDGET_MAX_WAIT)) {
+			return;
+		}
+
+		CORE_LOG_WARN_EVERY(SinkEngine, "Outbound queues didn't drain within " << BUDGET_MAX_WAIT << " seconds, shedding the slowest ports");
+	}
+
+	// Only the sender that writes a connection may touch its ports,
+	// so it sheds the slowest one before the next packet it sends
+	if (not senders.empty()) {
+		size_t queued = 0;
+		size_t slowest = 0;
+
+		for (size_t i = 0; i != connections->connections.size(); ++i) {
+			unsigned short port = 0;
+			size_t candidate = connections->connections[i]->slowestPort(port);
+
+			if (candidate > queued) {
+				queued = candidate;
+				slowest = i;
+			}
+		}
+
+		if (queued != 0) {
+			senders[slowest % senders.size()]->shed(connections, slowest);
+		}
+
+		return;
+	}
+
+	shedSlowest(connections->connections, *memoryBudget, 0, 1);
+}
+
+void shedSlowest(const std::vector<boost::shared_ptr<InternalConnection> > &connections, MemoryBudget &budget, size_t first, size_t count)
+{
+	while (budget.exceeded()) {
+		boost::shared_ptr<InternalConnection> slowest;
+		unsigned short port = 0;
+		size_t queued = 0;
+
+		for (size_t i = first; i < connections.size(); i += count) {
+			unsigned short candidatePort = 0;
+			size_t candidate = connections[i]->slowestPort(candidatePort);
+
+			if (candidate > queued) {
+				queued = candidate;
+				port = candidatePort;
+				slowest = connections[i];
+			}
+		}
+
+		// Data that is being written can't be dropped
+		if (not slowest or slowest->shedPort(port) == 0) {
+			break;
+		}
+
+		CORE_LOG_WARN_EVERY(SinkEngine, "Memory budget exceeded, dropped the data queued for port " << port);
+	}
+}
+
+const StageCounter &SinkEngine::swapCounter() const
+{
+	return swapTime;
+}
+
+const StageCounter &SinkEngine::sendCounter() const
+{
+	return sendTime;
+}
+
+void SinkEngine::resetCounters()
+{
+	sendTime.reset();
+	swapTime.reset();
+}
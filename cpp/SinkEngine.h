@@ -0,0 +1,172 @@
+#ifndef SINKENGINE_H_
+#define SINKENGINE_H_
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "CompressionPool.h"
+#include "InternalConnection.h"
+#include "MemoryBudget.h"
+#include "SinkConfig.h"
+#include "corelog.h"
+#include "outputformat.h"
+#include "probes.h"
+#include "stagetimer.h"
+
+// The most compressed frames of one stream waiting to be sent
+// before the service thread waits on the compression workers
+#define MAX_PENDING_FRAMES 64
+
+/*
+ * The connections the data path writes to.  A new set is
+ * built off to the side for each reconfiguration and then
+ * published in one step, so sends that are in progress
+ * finish on the set they started with
+ */
+struct ConnectionSet {
+	ConnectionSet() :
+		onlyTransforms(true),
+		performTransform(false)
+	{}
+
+	boost::shared_ptr<CompressionPool> compressionPool;
+	std::vector<boost::shared_ptr<InternalConnection> > connections;
+	bool onlyTransforms;
+	bool performTransform;
+};
+
+typedef boost::shared_ptr<const ConnectionSet> ConnectionSetPtr;
+
+// Drop the data queued for the slowest ports of every count-th
+// connection, starting at first, until the budget is met
+void shedSlowest(const std::vector<boost::shared_ptr<InternalConnection> > &connections, MemoryBudget &budget, size_t first, size_t count);
+
+/*
+ * The sender threads the data path should run.  No threads
+ * means the connections are written by the writing thread
+ */
+struct SenderSettings {
+	SenderSettings() :
+		queueDepth(0),
+		spin(0),
+		threads(0)
+	{}
+
+	std::string cpus;
+	size_t queueDepth;
+	size_t spin;
+	size_t threads;
+};
+
+class ConnectionSender;
+
+/*
+ * The data path of the sink, independent of any framework.
+ * Packets of samples are transformed, compressed and written
+ * to every configured connection, and the status of each
+ * port is returned for the caller to report.
+ *
+ * write and flush must be called from a single thread, which
+ * owns the transform buffers and pending frames.  configure
+ * may be called from any thread at any time; it publishes a
+ * new connection set atomically, so the data path takes no
+ * lock of its own.  The budget and flow control settings may
+ * also be changed from any thread, and are read atomically.
+ *
+ * With sender threads, the writing thread still transforms
+ * and compresses each packet once, then hands it to the
+ * senders, which write it to their share of the connections
+ * in parallel
+ */
+class SinkEngine
+{
+public:
+	SinkEngine();
+	~SinkEngine();
+
+	void configure(const std::vector<ConnectionConfig> &requested, std::vector<ConnectionConfig> &applied, std::vector<ConnectionStatus> &statuses);
+
+	// The stream ID is only used to label the tracepoints
+	template<typename T, typename U>
+	void write(std::vector<T, U> &samples, std::vector<ConnectionStatus> &statuses, const std::string &streamID = std::string());
+
+	bool flush(std::vector<ConnectionStatus> &statuses);
+	bool framesPending() const;
+
+	// Limit the data queued for every socket together, in bytes,
+	// or 0 for no limit
+	void setMemoryBudget(size_t bytes, BudgetPolicy policy);
+	size_t memoryUsed() const;
+	size_t memoryHighWater() const;
+
+	// Lossless mode: once the data queued for every socket passes
+	// the high watermark, stop taking packets until it falls to
+	// the low watermark, and never shed queued data
+	void setFlowControl(bool lossless, size_t highWatermark, size_t lowWatermark);
+	bool readyForPacket(double timeout);
+	bool roomForBatch(size_t bytes) const;
+	bool throttled() const;
+
+	// Pin the I/O thread of every port to a list of CPUs, or unpin
+	// them with an empty list, and describe where each one runs
+	void setIoCpus(const std::string &cpus);
+	void ioPlacement(std::vector<std::string> &placements);
+
+	// Write the connections from this many sender threads, each
+	// queueing up to queueDepth packets, checking spin times for
+	// more before it sleeps, and pinned to cpus.  Takes effect
+	// when the writing thread calls applySenders, which returns
+	// true if the senders were changed
+	void setSenders(size_t threads, size_t queueDepth, size_t spin, const std::string &cpus);
+	bool applySenders();
+
+	// The time spent transforming samples and writing them to the
+	// connections.  Only read or reset these from the thread that
+	// writes
+	const StageCounter &swapCounter() const;
+	const StageCounter &sendCounter() const;
+	void resetCounters();
+
+private:
+	SinkEngine(const SinkEngine &copy);
+	SinkEngine &operator=(const SinkEngine &copy);
+
+	template<typename T, typename U>
+	void createByteSwappedVector(const std::vector<T, U> &original, const OutputFormat &output, const std::string &streamID);
+
+	void enforceBudget(const ConnectionSetPtr &connections);
+	void sendToSenders(const ConnectionSetPtr &connections, outputDataMap &data, std::vector<ConnectionStatus> &statuses);
+	void collectCompressedFrames(outputDataMap &dataMap, const boost::posix_time::time_duration &timeout);
+	std::vector<ConnectionConfig> normalize(const std::vector<ConnectionConfig> &requested);
+
+	BudgetPolicy budgetPolicy;
+	std::map<std::string, outputDataMap> byteSwapped;
+	compressionStatsMap compressionStats;
+	ConnectionSetPtr connectionSet;
+	size_t highWatermark;
+	std::string ioCpus;
+	std::map<std::string, outputDataMap> leftovers;
+	bool lossless;
+	size_t lowWatermark;
+	boost::shared_ptr<MemoryBudget> memoryBudget;
+	std::map<OutputFormat, std::deque<CompressionJobPtr> > pendingFrames;
+	boost::mutex placementLock_;
+	boost::mutex reconfigureLock_;
+	std::vector<boost::shared_ptr<ConnectionSender> > senders;
+	std::vector<std::string> senderPlacement;
+	boost::shared_ptr<const SenderSettings> senderSettings;
+	boost::shared_ptr<const SenderSettings> senderSettingsApplied;
+	StageCounter sendTime;
+	ConnectionSetPtr sentSet;
+	boost::shared_ptr<const compressionStatsMap> sharedCompressionStats;
+	StageCounter swapTime;
+	bool throttling;
+};
+
+#include "SinkEngineTemplate.h"
+
+#endif /* SINKENGINE_H_ */
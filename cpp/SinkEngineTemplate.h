@@ -0,0 +1,149 @@
+#ifndef SINKENGINETEMPLATE_H_
+#define SINKENGINETEMPLATE_H_
+
+#include <set>
+#include <typeinfo>
+
+#include "SinkEngine.h"
+#include "transform.h"
+
+template<typename T, typename U>
+void SinkEngine::createByteSwappedVector(const std::vector<T, U> &original, const OutputFormat &output, const std::string &streamID)
+{
+	unsigned long long start = readCycles();
+	unsigned int numSwap = swapWidth(output, sizeof(T));
+	size_t dataSize = sampleFormatSize(output.format, sizeof(T));
+
+	if (numSwap > 1 && numSwap != dataSize) {
+		CORE_LOG_WARN_EVERY(SinkEngine, "Data size of " << dataSize << " is not equal to byte swap size  of " << numSwap <<".");
+	}
+
+	DataBuffer &swapped = byteSwapped[typeid(T).name()][output];
+
+	SINK_PROBE3(swap_start, original.size() * sizeof(T), streamID.c_str(), numSwap);
+
+	if (not transformSamples(original, output, leftovers[typeid(T).name()][output], swapped)) {
+		CORE_LOG_WARN_EVERY(SinkEngine, "Byte swapping and packet sizes are not compatible.  Swapping bytes over adjacent packets");
+	}
+
+	SINK_PROBE3(swap_end, swapped.size(), streamID.c_str(), numSwap);
+
+	swapTime.add(readCycles() - start);
+}
+
+/*
+ * Send a packet to every connection, returning the status
+ * of each port
+ */
+template<typename T, typename U>
+void SinkEngine::write(std::vector<T, U> &samples, std::vector<ConnectionStatus> &statuses, const std::string &streamID)
+{
+	CORE_LOG_TRACE(SinkEngine, __PRETTY_FUNCTION__);
+
+	// Use the same connections for the whole packet, even if a new
+	// set is published in the meantime
+	ConnectionSetPtr connections = boost::atomic_load(&connectionSet);
+
+	std::vector<ConnectionStatus> returned;
+
+	statuses.clear();
+
+	enforceBudget(connections);
+
+	// Avoid unnecessary processing and allocation if no byte swaps
+	// or conversions are being performed.  The senders always take
+	// the data of every format from one shared map
+	if (connections->performTransform or not senders.empty()) {
+		// Use the data type as the key into the byteSwapped and
+		// leftovers member maps
+		std::string byteSwapKey = typeid(T).name();
+
+		// This copy isn't necessary if all of the connections require
+		// byte swaps or conversions
+		if (not connections->onlyTransforms) {
+			byteSwapped[byteSwapKey][OutputFormat()] = DataBuffer(reinterpret_cast<char *>(samples.data()),reinterpret_cast<char *>(samples.data()) + samples.size() * sizeof(T));
+		}
+
+		// Iterate through the internal connections, building the byte
+		// swapped and converted vectors as necessary.  This should
+		// prevent multiple transforms for the same output format from
+		// being performed in the same call
+		std::set<OutputFormat> compressedFormats;
+		std::set<OutputFormat> directFormats;
+		std::map<OutputFormat, size_t> compressedUses;
+
+		for (std::vector<boost::shared_ptr<InternalConnection> >::const_iterator i = connections->connections.begin(); i != connections->connections.end(); ++i) {
+			std::vector<OutputFormat> formats = (*i)->getOutputFormats();
+
+			for (std::vector<OutputFormat>::iterator j = formats.begin(); j != formats.end(); ++j) {
+				OutputFormat uncompressed = j->uncompressed();
+
+				if (j->compression != COMPRESSION_NONE) {
+					if (compressedFormats.insert(*j).second) {
+						++compressedUses[uncompressed];
+					}
+				} else {
+					directFormats.insert(*j);
+				}
+
+				if (not uncompressed.isNative()) {
+					if (byteSwapped[byteSwapKey].find(uncompressed) == byteSwapped[byteSwapKey].end()) {
+						createByteSwappedVector(samples, uncompressed, streamID);
+					}
+				}
+			}
+		}
+
+		// Hand each distinct compressed stream to the worker pool.  The
+		// frames are collected in order once they are ready, so the
+		// caller never waits on the compression of this packet.  The
+		// transformed data is only taken by the last stream that
+		// compresses it; the others, and any connection sending it
+		// uncompressed, need their own copy
+		for (std::set<OutputFormat>::const_iterator i = compressedFormats.begin(); i != compressedFormats.end(); ++i) {
+			OutputFormat uncompressed = i->uncompressed();
+			DataBuffer input;
+
+			if (uncompressed.isNative()) {
+				input.assign(reinterpret_cast<char *>(samples.data()), reinterpret_cast<char *>(samples.data()) + samples.size() * sizeof(T));
+			} else if (--compressedUses[uncompressed] != 0 or directFormats.count(uncompressed)) {
+				input = byteSwapped[byteSwapKey][uncompressed];
+			} else {
+				input.swap(byteSwapped[byteSwapKey][uncompressed]);
+			}
+
+			pendingFrames[*i].push_back(CompressionJobPtr(new CompressionJob(i->compression, input)));
+			connections->compressionPool->submit(pendingFrames[*i].back());
+		}
+
+		collectCompressedFrames(byteSwapped[byteSwapKey], boost::posix_time::time_duration());
+
+		unsigned long long start = readCycles();
+
+		if (not senders.empty()) {
+			sendToSenders(connections, byteSwapped[byteSwapKey], statuses);
+		} else {
+			for (std::vector<boost::shared_ptr<InternalConnection> >::const_iterator i = connections->connections.begin(); i != connections->connections.end(); ++i) {
+				returned = (*i)->writeByteSwap(byteSwapped[byteSwapKey], compressionStats);
+
+				statuses.insert(statuses.end(), returned.begin(), returned.end());
+			}
+		}
+
+		sendTime.add(readCycles() - start);
+		byteSwapped[byteSwapKey].clear();
+	} else {
+		unsigned long long start = readCycles();
+
+		// Iterate through the internal connections and write the data buffer
+		for (std::vector<boost::shared_ptr<InternalConnection> >::const_iterator i = connections->connections.begin(); i != connections->connections.end(); ++i) {
+			returned = (*i)->write(samples);
+
+			statuses.insert(statuses.end(), returned.begin(), returned.end());
+		}
+
+		sendTime.add(readCycles() - start);
+	}
+}
+
+#endif /* SINKENGINETEMPLATE_H_ */
@@ -0,0 +1,225 @@
+#include "affinity.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+
+#ifdef HAVE_LINUX_MEMPOLICY_H
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#endif
+
+#include "corelog.h"
+
+#define NODE_DIRECTORY "/sys/devices/system/node"
+
+bool parseCpuList(const std::string &list, cpu_set_t &cpus)
+{
+	CPU_ZERO(&cpus);
+
+	std::istringstream ranges(list);
+	std::string range;
+
+	while (std::getline(ranges, range, ',')) {
+		if (range.find_first_not_of(" \t\n") == std::string::npos) {
+			continue;
+		}
+
+		const char *text = range.c_str();
+		char *end;
+		long first = strtol(text, &end, 10);
+		long last = first;
+
+		if (end == text) {
+			return false;
+		}
+
+		if (*end == '-') {
+			text = end + 1;
+			last = strtol(text, &end, 10);
+
+			if (end == text) {
+				return false;
+			}
+		}
+
+		while (*end == ' ' or *end == '\t' or *end == '\n') {
+			++end;
+		}
+
+		if (*end or first < 0 or last < first or last >= CPU_SETSIZE) {
+			return false;
+		}
+
+		for (long cpu = first; cpu <= last; ++cpu) {
+			CPU_SET(cpu, &cpus);
+		}
+	}
+
+	return true;
+}
+
+std::string formatCpuList(const cpu_set_t &cpus)
+{
+	std::ostringstream list;
+
+	for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+		if (not CPU_ISSET(cpu, &cpus)) {
+			continue;
+		}
+
+		int last = cpu;
+
+		while (last + 1 < CPU_SETSIZE and CPU_ISSET(last + 1, &cpus)) {
+			++last;
+		}
+
+		if (list.tellp() > 0) {
+			list << ",";
+		}
+
+		list << cpu;
+
+		if (last > cpu) {
+			list << "-" << last;
+		}
+
+		cpu = last;
+	}
+
+	return list.str();
+}
+
+std::set<int> cpuNodes(const cpu_set_t &cpus)
+{
+	std::set<int> nodes;
+	DIR *directory = opendir(NODE_DIRECTORY);
+
+	if (not directory) {
+		return nodes;
+	}
+
+	while (dirent *entry = readdir(directory)) {
+		if (strncmp(entry->d_name, "node", 4) != 0 or not isdigit(entry->d_name[4])) {
+			continue;
+		}
+
+		std::ifstream file((std::string(NODE_DIRECTORY "/") + entry->d_name + "/cpulist").c_str());
+		std::string list;
+		cpu_set_t nodeCpus;
+
+		if (not std::getline(file, list) or not parseCpuList(list, nodeCpus)) {
+			continue;
+		}
+
+		CPU_AND(&nodeCpus, &nodeCpus, &cpus);
+
+		if (CPU_COUNT(&nodeCpus)) {
+			nodes.insert(atoi(entry->d_name + 4));
+		}
+	}
+
+	closedir(directory);
+
+	return nodes;
+}
+
+bool pinThread(pthread_t thread, const std::string &cpus)
+{
+	cpu_set_t set;
+
+	if (cpus.empty()) {
+		// The main thread is never pinned, so it has the
+		// process's own affinity
+		if (sched_getaffinity(getpid(), sizeof(set), &set) != 0) {
+			CORE_LOG_ERROR(Affinity, "Unable to read the process's CPU affinity: " << strerror(errno));
+			return false;
+		}
+	} else if (not parseCpuList(cpus, set) or not CPU_COUNT(&set)) {
+		CORE_LOG_ERROR(Affinity, "Invalid CPU list \"" << cpus << "\"");
+		return false;
+	}
+
+	int error = pthread_setaffinity_np(thread, sizeof(set), &set);
+
+	if (error) {
+		CORE_LOG_ERROR(Affinity, "Unable to pin a thread to CPUs " << cpus << ": " << strerror(error));
+		return false;
+	}
+
+	return true;
+}
+
+bool preferLocalNode()
+{
+	cpu_set_t cpus;
+
+	if (sched_getaffinity(0, sizeof(cpus), &cpus) != 0) {
+		return false;
+	}
+
+	std::set<int> nodes = cpuNodes(cpus);
+
+#ifdef HAVE_LINUX_MEMPOLICY_H
+	unsigned long mask = 0;
+	int mode = MPOL_DEFAULT;
+
+	if (nodes.size() == 1 and *nodes.begin() < int(sizeof(mask) * 8)) {
+		mask = 1UL << *nodes.begin();
+		mode = MPOL_PREFERRED;
+	}
+
+	// The kernel reads one bit less than the node count it's given
+	if (syscall(SYS_set_mempolicy, mode, mask ? &mask : NULL, mask ? sizeof(mask) * 8 + 1 : 0) != 0) {
+		CORE_LOG_WARN(Affinity, "Unable to set the NUMA memory policy: " << strerror(errno));
+		return false;
+	}
+
+	return true;
+#else
+	return nodes.size() <= 1;
+#endif
+}
+
+bool resetMemoryPolicy()
+{
+#ifdef HAVE_LINUX_MEMPOLICY_H
+	if (syscall(SYS_set_mempolicy, MPOL_DEFAULT, NULL, 0) != 0) {
+		CORE_LOG_WARN(Affinity, "Unable to reset the NUMA memory policy: " << strerror(errno));
+		return false;
+	}
+#endif
+
+	return true;
+}
+
+std::string describePlacement(pthread_t thread)
+{
+	cpu_set_t cpus;
+
+	if (pthread_getaffinity_np(thread, sizeof(cpus), &cpus) != 0) {
+		return "unknown";
+	}
+
+	std::ostringstream placement;
+	std::set<int> nodes = cpuNodes(cpus);
+
+	placement << "cpus " << formatCpuList(cpus);
+
+	if (not nodes.empty()) {
+		placement << (nodes.size() == 1 ? " (node " : " (nodes ");
+
+		for (std::set<int>::const_iterator i = nodes.begin(); i != nodes.end(); ++i) {
+			placement << (i == nodes.begin() ? "" : ",") << *i;
+		}
+
+		placement << ")";
+	}
+
+	return placement.str();
+}
@@ -0,0 +1,39 @@
+#ifndef AFFINITY_H_
+#define AFFINITY_H_
+
+#include <pthread.h>
+#include <sched.h>
+#include <set>
+#include <string>
+
+/*
+ * Placement of the sink's threads on CPUs and NUMA nodes.  CPU
+ * sets are written as lists like "0-3,8,10-11".  Memory follows
+ * the thread that first touches it, so a thread pinned to one
+ * node and preferring that node's memory keeps the buffers it
+ * allocates local
+ */
+bool parseCpuList(const std::string &list, cpu_set_t &cpus);
+std::string formatCpuList(const cpu_set_t &cpus);
+
+// The NUMA nodes holding any of the CPUs, empty if the machine
+// doesn't say
+std::set<int> cpuNodes(const cpu_set_t &cpus);
+
+// Pin a thread to a list of CPUs.  An empty list lets it run on
+// any CPU the process may use
+bool pinThread(pthread_t thread, const std::string &cpus);
+
+// Allocate the calling thread's memory from the node its CPUs
+// are on, when they are all on one node, and from anywhere
+// otherwise
+bool preferLocalNode();
+
+// Allocate the calling thread's memory the system's default way
+// again, after it was unpinned
+bool resetMemoryPolicy();
+
+// Where a thread may run, like "cpus 0-3 (node 0)"
+std::string describePlacement(pthread_t thread);
+
+#endif /* AFFINITY_H_ */
@@ -0,0 +1,44 @@
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <vector>
+
+/*
+ * Batching of the packets already queued on an input port, so
+ * they are written with one write per connection and one
+ * statistics update.  Packets work with any type that has the
+ * streamID, sriChanged, EOS and dataBuffer members of a bulkio
+ * packet.
+ *
+ * A batch only holds the packets of one stream under one SRI:
+ * a packet of another stream, or one that changes the SRI,
+ * starts the next batch, and an end of stream ends the one it
+ * is in
+ */
+template<typename P>
+bool joinable(const P &last, const P &next)
+{
+	return not last.EOS and not next.sriChanged and next.streamID == last.streamID;
+}
+
+/*
+ * Join the data of a batch onto the end of its first packet.
+ * The space is reserved up front, so each packet is copied once
+ */
+template<typename P>
+void joinPackets(const std::vector<P *> &batch)
+{
+	size_t size = 0;
+
+	for (size_t i = 0; i != batch.size(); ++i) {
+		size += batch[i]->dataBuffer.size();
+	}
+
+	batch[0]->dataBuffer.reserve(size);
+
+	for (size_t i = 1; i != batch.size(); ++i) {
+		batch[0]->dataBuffer.insert(batch[0]->dataBuffer.end(), batch[i]->dataBuffer.begin(), batch[i]->dataBuffer.end());
+	}
+}
+
+#endif /* BATCH_H_ */
@@ -0,0 +1,323 @@
+/*
+ * Microbenchmarks of the data path, built with "make benchmark"
+ * and not installed.  Run as
+ *
+ *   ./benchmark [--min-time=SECONDS] [--port=FIRST_PORT] [FILTER]
+ *
+ * Only cases whose name contains FILTER are run.  Each case is
+ * repeated, doubling the count, until it has run for at least
+ * the minimum time, and one CSV line is printed per case:
+ *
+ *   name,type,bytes,parameters,iterations,ns_per_op,mb_per_sec
+ *
+ * bytes is the input consumed by one operation.  The connection
+ * cases write to local servers starting at FIRST_PORT and include
+ * the time for the data to reach them
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "InternalConnection.h"
+#include "quickstats.h"
+#include "transform.h"
+#include "vectorswap.h"
+
+// Connection cases wait for the servers after this many bytes per port
+#define BENCHMARK_DRAIN_BYTES (8 * 1024 * 1024)
+
+static double minTime = 0.1;
+static unsigned short firstPort = 47000;
+static std::string filter;
+
+// Keeps results alive so the work isn't optimized away
+static volatile float sink;
+
+static double now()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/*
+ * Time op, which must provide operator() for one operation and
+ * finish() to wait for any work left in flight
+ */
+template<typename F>
+void run(const std::string &name, const std::string &type, size_t bytes, const std::string &parameters, F &op)
+{
+	if (name.find(filter) == std::string::npos) {
+		return;
+	}
+
+	size_t iterations = 1;
+	double elapsed = 0;
+
+	op();
+	op.finish();
+
+	while (true) {
+		double start = now();
+
+		for (size_t i = 0; i != iterations; ++i) {
+			op();
+		}
+
+		op.finish();
+		elapsed = now() - start;
+
+		if (elapsed >= minTime) {
+			break;
+		}
+
+		iterations *= 2;
+	}
+
+	printf("%s,%s,%zu,%s,%zu,%.2f,%.2f\n", name.c_str(), type.c_str(), bytes, parameters.c_str(), iterations,
+			elapsed * 1e9 / iterations, bytes * iterations / elapsed / 1e6);
+	fflush(stdout);
+}
+
+template<typename T>
+std::string parameter(const std::string &name, const T &value)
+{
+	std::ostringstream text;
+	text << name << "=" << value;
+	return text.str();
+}
+
+struct SwapInPlace {
+	SwapInPlace(size_t bytes, unsigned char width) :
+		data(bytes - bytes % width, 1),
+		width(width)
+	{}
+
+	void operator()() { vectorSwap(data, width); }
+	void finish() { sink = data[0]; }
+
+	std::vector<char> data;
+	unsigned char width;
+};
+
+struct SwapCopy {
+	SwapCopy(size_t bytes, unsigned char width) :
+		in(bytes - bytes % width, 1),
+		out(in.size()),
+		width(width)
+	{}
+
+	void operator()() { vectorSwap(in.data(), out, width); }
+	void finish() { sink = out[0]; }
+
+	std::vector<char> in;
+	std::vector<char> out;
+	unsigned char width;
+};
+
+struct NewPacket {
+	explicit NewPacket(size_t bytes) :
+		bytes(bytes)
+	{}
+
+	void operator()() { sink = stats.newPacket(bytes); }
+	void finish() {}
+
+	size_t bytes;
+	QuickStats stats;
+};
+
+template<typename T>
+struct Transform {
+	Transform(size_t bytes, const OutputFormat &format) :
+		format(format),
+		in(bytes / sizeof(T), T(1))
+	{}
+
+	void operator()() { transformSamples(in, format, leftover, out); }
+	void finish() { sink = out.empty() ? 0 : out[0]; }
+
+	OutputFormat format;
+	std::vector<T> in;
+	DataBuffer leftover;
+	DataBuffer out;
+};
+
+/*
+ * A client connection to one local server per port.  The servers
+ * buffer what they receive, which is read back after every few
+ * megabytes so the send queues can't grow without limit
+ */
+struct ConnectionWrite {
+	ConnectionWrite(size_t bytes, size_t connections) :
+		buffer(1024 * 1024),
+		data(bytes / sizeof(float), 1.0f),
+		received(0),
+		sent(0)
+	{
+		ConnectionConfig settings;
+
+		settings.connection_type = "client";
+		settings.ip_address = "127.0.0.1";
+		settings.ports.clear();
+
+		for (size_t i = 0; i != connections; ++i) {
+			servers.push_back(new server(firstPort + i, 65536, 4 * BENCHMARK_DRAIN_BYTES));
+			settings.ports.push_back(firstPort + i);
+		}
+
+		settings.byte_swap.assign(connections, 0);
+		connection.setConnection(settings);
+
+		// Wait for every port to connect
+		for (int tries = 0; tries != 500 && not allConnected(); ++tries) {
+			usleep(10000);
+		}
+	}
+
+	~ConnectionWrite()
+	{
+		for (size_t i = 0; i != servers.size(); ++i) {
+			delete servers[i];
+		}
+	}
+
+	bool allConnected()
+	{
+		for (size_t i = 0; i != servers.size(); ++i) {
+			if (not servers[i]->is_connected()) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	void operator()()
+	{
+		connection.write(data);
+		sent += data.size() * sizeof(float);
+
+		if (sent - received >= BENCHMARK_DRAIN_BYTES) {
+			finish();
+		}
+	}
+
+	// Read until every server has everything sent to it
+	void finish()
+	{
+		size_t expected = (sent - received) * servers.size();
+		size_t total = 0;
+		double deadline = now() + 10;
+
+		while (total < expected && now() < deadline) {
+			size_t count = 0;
+
+			for (size_t i = 0; i != servers.size(); ++i) {
+				buffer.resize(buffer.capacity());
+				servers[i]->read(buffer);
+				count += buffer.size();
+			}
+
+			if (count == 0) {
+				usleep(50);
+			}
+
+			total += count;
+		}
+
+		received = sent;
+	}
+
+	std::vector<char> buffer;
+	InternalConnection connection;
+	std::vector<float> data;
+	size_t received;
+	size_t sent;
+	std::vector<server *> servers;
+};
+
+template<typename T>
+void runTransforms(const std::string &type, const std::vector<size_t> &sizes)
+{
+	const SampleFormat formats[] = { FORMAT_NATIVE, FORMAT_INT8, FORMAT_INT16, FORMAT_FLOAT };
+	const char *formatNames[] = { "native", "int8", "int16", "float" };
+	const unsigned short swaps[] = { 0, 1, 8 };
+
+	for (size_t size = 0; size != sizes.size(); ++size) {
+		for (size_t format = 0; format != 4; ++format) {
+			for (size_t swap = 0; swap != 3; ++swap) {
+				Transform<T> op(sizes[size], OutputFormat(swaps[swap], formats[format], 100.0f));
+
+				run("transformSamples", type, op.in.size() * sizeof(T), parameter("format", formatNames[format]) + ";" + parameter("byte_swap", swaps[swap]), op);
+			}
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	for (int i = 1; i < argc; ++i) {
+		if (strncmp(argv[i], "--min-time=", 11) == 0) {
+			minTime = atof(argv[i] + 11);
+		} else if (strncmp(argv[i], "--port=", 7) == 0) {
+			firstPort = atoi(argv[i] + 7);
+		} else {
+			filter = argv[i];
+		}
+	}
+
+	std::vector<size_t> sizes;
+
+	sizes.push_back(1024);
+	sizes.push_back(64 * 1024);
+	sizes.push_back(1024 * 1024);
+
+	printf("name,type,bytes,parameters,iterations,ns_per_op,mb_per_sec\n");
+
+	const unsigned char widths[] = { 2, 4, 8, 3 };
+
+	for (size_t size = 0; size != sizes.size(); ++size) {
+		for (size_t width = 0; width != 4; ++width) {
+			SwapInPlace inPlace(sizes[size], widths[width]);
+			SwapCopy copy(sizes[size], widths[width]);
+
+			run("vectorSwap_in_place", "char", inPlace.data.size(), parameter("width", int(widths[width])), inPlace);
+			run("vectorSwap_copy", "char", copy.in.size(), parameter("width", int(widths[width])), copy);
+		}
+	}
+
+	for (size_t size = 0; size != sizes.size(); ++size) {
+		NewPacket op(sizes[size]);
+
+		run("QuickStats_newPacket", "char", sizes[size], "", op);
+	}
+
+	runTransforms<int8_t>("int8", sizes);
+	runTransforms<int16_t>("int16", sizes);
+	runTransforms<int32_t>("int32", sizes);
+	runTransforms<float>("float", sizes);
+	runTransforms<double>("double", sizes);
+
+	const size_t connections[] = { 1, 4, 16 };
+
+	for (size_t size = 0; size != sizes.size(); ++size) {
+		for (size_t count = 0; count != 3; ++count) {
+			if (std::string("InternalConnection_write").find(filter) == std::string::npos) {
+				continue;
+			}
+
+			ConnectionWrite op(sizes[size], connections[count]);
+
+			run("InternalConnection_write", "float", op.data.size() * sizeof(float), parameter("connections", connections[count]), op);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,124 @@
+#ifndef BYTERING_H_
+#define BYTERING_H_
+
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+/*
+ * A fixed capacity FIFO of bytes.  Data is copied in and
+ * out in at most two memcpy calls.  When it is full, the
+ * oldest bytes are overwritten so the ring always holds
+ * the most recent data, and the number of bytes lost is
+ * counted
+ *
+ * This class is not thread safe, the owner must serialize
+ * access to it
+ */
+class ByteRing
+{
+public:
+	explicit ByteRing(size_t capacity=0) :
+		data_(capacity),
+		head_(0),
+		overwritten_(0),
+		size_(0)
+	{}
+
+	// Change the capacity, keeping the newest bytes that fit
+	void resize(size_t capacity)
+	{
+		if (capacity == data_.size())
+			return;
+
+		std::vector<char> contents(size_);
+		read(contents.data(), contents.size());
+
+		data_.assign(capacity, 0);
+		head_ = 0;
+		size_ = 0;
+		write(contents.data(), contents.size());
+	}
+
+	void write(const char *bytes, size_t count)
+	{
+		size_t capacity = data_.size();
+
+		// Only the newest capacity bytes can be kept
+		if (count > capacity) {
+			overwritten_ += count - capacity;
+			bytes += count - capacity;
+			count = capacity;
+		}
+
+		if (count == 0)
+			return;
+
+		// Make room by discarding the oldest bytes
+		if (size_ + count > capacity) {
+			size_t overflow = size_ + count - capacity;
+
+			head_ = (head_ + overflow) % capacity;
+			size_ -= overflow;
+			overwritten_ += overflow;
+		}
+
+		size_t tail = (head_ + size_) % capacity;
+		size_t first = std::min(count, capacity - tail);
+
+		memcpy(&data_[tail], bytes, first);
+		memcpy(&data_[0], bytes + first, count - first);
+
+		size_ += count;
+	}
+
+	// Copy out up to count of the oldest bytes, returning the
+	// number copied
+	size_t read(char *out, size_t count)
+	{
+		count = std::min(count, size_);
+
+		if (count == 0)
+			return 0;
+
+		size_t first = std::min(count, data_.size() - head_);
+
+		memcpy(out, &data_[head_], first);
+		memcpy(out + first, &data_[0], count - first);
+
+		head_ = (head_ + count) % data_.size();
+		size_ -= count;
+
+		return count;
+	}
+
+	void clear()
+	{
+		head_ = 0;
+		size_ = 0;
+	}
+
+	size_t capacity() const
+	{
+		return data_.size();
+	}
+
+	// Total bytes lost because the ring was full
+	size_t overwritten() const
+	{
+		return overwritten_;
+	}
+
+	size_t size() const
+	{
+		return size_;
+	}
+
+private:
+	std::vector<char> data_;
+	size_t head_;
+	size_t overwritten_;
+	size_t size_;
+};
+
+#endif /* BYTERING_H_ */
@@ -0,0 +1,46 @@
+#include "corelog.h"
+
+#include <time.h>
+#include <iostream>
+
+static const char *levelNames[] = { "TRACE", "DEBUG", "INFO", "WARN", "ERROR" };
+
+static CoreLogHandler logHandler = NULL;
+CoreLogLevel coreLogThreshold = CORE_LOG_WARN;
+
+void setCoreLogHandler(CoreLogHandler handler, CoreLogLevel threshold)
+{
+	logHandler = handler;
+	coreLogThreshold = threshold;
+}
+
+void coreLog(CoreLogLevel level, const char *logger, const std::string &message)
+{
+	if (logHandler) {
+		logHandler(level, logger, message);
+	} else {
+		std::cerr << levelNames[level] << " " << logger << " - " << message << std::endl;
+	}
+}
+
+/*
+ * Only one caller wins the compare and swap when the interval
+ * has passed, so concurrent callers can't both log
+ */
+bool coreLogAllowed(CoreLogSite &site, double interval, unsigned int &suppressed)
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	long long now = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+	long long next = site.next;
+
+	if (now < next or not __sync_bool_compare_and_swap(&site.next, next, now + (long long) (interval * 1e9))) {
+		__sync_fetch_and_add(&site.suppressed, 1);
+		return false;
+	}
+
+	suppressed = __sync_lock_test_and_set(&site.suppressed, 0);
+
+	return true;
+}
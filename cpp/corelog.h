@@ -0,0 +1,101 @@
+#ifndef CORELOG_H_
+#define CORELOG_H_
+
+#include <sstream>
+#include <string>
+
+/*
+ * Logging for the sink's core library, which can't use the
+ * framework's loggers.  Messages at or above the threshold go
+ * to a handler set by the program using the library, or to
+ * standard error if it doesn't set one.  The message is only
+ * formatted when it will be logged
+ */
+enum CoreLogLevel {
+	CORE_LOG_TRACE = 0,
+	CORE_LOG_DEBUG = 1,
+	CORE_LOG_INFO = 2,
+	CORE_LOG_WARN = 3,
+	CORE_LOG_ERROR = 4
+};
+
+// Levels below this are compiled out, costing nothing at run time.
+// Trace logging is only built in with -DCORE_LOG_MIN_LEVEL=0
+#ifndef CORE_LOG_MIN_LEVEL
+#define CORE_LOG_MIN_LEVEL 1
+#endif
+
+// The default interval between messages from one rate limited site
+#define CORE_LOG_INTERVAL 10.0
+
+typedef void (*CoreLogHandler)(CoreLogLevel level, const char *logger, const std::string &message);
+
+// Set before the library is used; a NULL handler restores standard error
+void setCoreLogHandler(CoreLogHandler handler, CoreLogLevel threshold);
+
+void coreLog(CoreLogLevel level, const char *logger, const std::string &message);
+
+extern CoreLogLevel coreLogThreshold;
+
+inline bool coreLogEnabled(CoreLogLevel level)
+{
+	return level >= CORE_LOG_MIN_LEVEL && level >= coreLogThreshold;
+}
+
+/*
+ * The state of one rate limited logging site.  Every site has
+ * its own, statically initialized, so sites don't need a lock
+ * or any setup
+ */
+struct CoreLogSite {
+	volatile long long next;
+	volatile unsigned int suppressed;
+};
+
+// Whether the site may log now, and if so how many of its messages
+// were dropped since it last did
+bool coreLogAllowed(CoreLogSite &site, double interval, unsigned int &suppressed);
+
+#define CORE_LOG(level, logger, expression) \
+	do { \
+		if (coreLogEnabled(level)) { \
+			std::ostringstream coreLogStream_; \
+			coreLogStream_ << expression; \
+			coreLog(level, #logger, coreLogStream_.str()); \
+		} \
+	} while (0)
+
+/*
+ * Log at most once every interval seconds from this site.  The
+ * messages dropped in between are counted and the count is added
+ * to the next one that is logged
+ */
+#define CORE_LOG_EVERY(level, logger, interval, expression) \
+	do { \
+		if (coreLogEnabled(level)) { \
+			static CoreLogSite coreLogSite_ = { 0, 0 }; \
+			unsigned int coreLogSuppressed_; \
+			if (coreLogAllowed(coreLogSite_, interval, coreLogSuppressed_)) { \
+				std::ostringstream coreLogStream_; \
+				coreLogStream_ << expression; \
+				if (coreLogSuppressed_) { \
+					coreLogStream_ << " (" << coreLogSuppressed_ << " similar messages suppressed)"; \
+				} \
+				coreLog(level, #logger, coreLogStream_.str()); \
+			} \
+		} \
+	} while (0)
+
+#define CORE_LOG_TRACE(logger, expression) CORE_LOG(CORE_LOG_TRACE, logger, expression)
+#define CORE_LOG_DEBUG(logger, expression) CORE_LOG(CORE_LOG_DEBUG, logger, expression)
+#define CORE_LOG_INFO(logger, expression) CORE_LOG(CORE_LOG_INFO, logger, expression)
+#define CORE_LOG_WARN(logger, expression) CORE_LOG(CORE_LOG_WARN, logger, expression)
+#define CORE_LOG_ERROR(logger, expression) CORE_LOG(CORE_LOG_ERROR, logger, expression)
+
+// For the data path, where a condition can repeat on every packet
+#define CORE_LOG_DEBUG_EVERY(logger, expression) CORE_LOG_EVERY(CORE_LOG_DEBUG, logger, CORE_LOG_INTERVAL, expression)
+#define CORE_LOG_INFO_EVERY(logger, expression) CORE_LOG_EVERY(CORE_LOG_INFO, logger, CORE_LOG_INTERVAL, expression)
+#define CORE_LOG_WARN_EVERY(logger, expression) CORE_LOG_EVERY(CORE_LOG_WARN, logger, CORE_LOG_INTERVAL, expression)
+#define CORE_LOG_ERROR_EVERY(logger, expression) CORE_LOG_EVERY(CORE_LOG_ERROR, logger, CORE_LOG_INTERVAL, expression)
+
+#endif /* CORELOG_H_ */
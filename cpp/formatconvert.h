@@ -0,0 +1,293 @@
+#ifndef FORMATCONVERT_H_
+#define FORMATCONVERT_H_
+
+#include <byteswap.h>
+#include <math.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * Sample formats that data can be converted to before
+ * being sent over the network.  FORMAT_NATIVE leaves
+ * the samples in the format of the input port
+ */
+enum SampleFormat {
+	FORMAT_NATIVE,
+	FORMAT_INT8,
+	FORMAT_INT16,
+	FORMAT_FLOAT
+};
+
+inline bool parseSampleFormat(const std::string &name, SampleFormat &format)
+{
+	if (name == "native" || name == "") {
+		format = FORMAT_NATIVE;
+	} else if (name == "int8") {
+		format = FORMAT_INT8;
+	} else if (name == "int16") {
+		format = FORMAT_INT16;
+	} else if (name == "float") {
+		format = FORMAT_FLOAT;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+// The number of bytes in a single sample of the given format
+inline size_t sampleFormatSize(SampleFormat format, size_t nativeSize)
+{
+	switch (format) {
+	case FORMAT_INT8:
+		return 1;
+	case FORMAT_INT16:
+		return 2;
+	case FORMAT_FLOAT:
+		return 4;
+	default:
+		return nativeSize;
+	}
+}
+
+//scale, round to nearest and saturate a single sample.  NaN saturates low to match the SIMD kernels
+template<typename T> inline int32_t scaleAndClamp(T value, float scale, int32_t low, int32_t high)
+{
+	double scaled = double(value) * scale;
+
+	if (!(scaled > low)) {
+		return low;
+	} else if (scaled >= high) {
+		return high;
+	}
+
+	return int32_t(lrint(scaled));
+}
+
+inline int32_t scaleAndClamp(float value, float scale, int32_t low, int32_t high)
+{
+	float scaled = value * scale;
+
+	if (!(scaled > low)) {
+		return low;
+	} else if (scaled >= high) {
+		return high;
+	}
+
+	return int32_t(lrintf(scaled));
+}
+
+template<typename T> void convertToInt8(const T* in, size_t count, int8_t* out, float scale)
+{
+	for (size_t i=0; i!=count; i++)
+	{
+		out[i] = int8_t(scaleAndClamp(in[i], scale, -128, 127));
+	}
+}
+
+template<typename T> void convertToInt16(const T* in, size_t count, int16_t* out, float scale, bool swap)
+{
+	for (size_t i=0; i!=count; i++)
+	{
+		int16_t value = int16_t(scaleAndClamp(in[i], scale, -32768, 32767));
+		out[i] = swap ? int16_t(bswap_16(uint16_t(value))) : value;
+	}
+}
+
+template<typename T> void convertToFloat(const T* in, size_t count, float* out, float scale, bool swap)
+{
+	uint32_t* to = reinterpret_cast<uint32_t*>(out);
+
+	for (size_t i=0; i!=count; i++)
+	{
+		out[i] = float(in[i] * scale);
+
+		if (swap)
+		{
+			to[i] = bswap_32(to[i]);
+		}
+	}
+}
+
+#ifdef __SSE2__
+static inline __m128i bswap16_sse2(__m128i v)
+{
+	return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+static inline __m128i bswap32_sse2(__m128i v)
+{
+	// swap the bytes in each 16 bit word, then swap the words
+	v = bswap16_sse2(v);
+	v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+	return _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+}
+
+// Scale, clamp to [low, high] and round four floats to 32 bit integers
+static inline __m128i scaleAndClamp_sse2(const float* in, __m128 scale, __m128 low, __m128 high)
+{
+	__m128 v = _mm_mul_ps(_mm_loadu_ps(in), scale);
+	v = _mm_min_ps(_mm_max_ps(v, low), high);
+	return _mm_cvtps_epi32(v);
+}
+
+// Scale, clamp to [low, high] and round four doubles to 32 bit integers
+static inline __m128i scaleAndClamp_sse2(const double* in, __m128d scale, __m128d low, __m128d high)
+{
+	__m128d a = _mm_mul_pd(_mm_loadu_pd(in), scale);
+	__m128d b = _mm_mul_pd(_mm_loadu_pd(in + 2), scale);
+	a = _mm_min_pd(_mm_max_pd(a, low), high);
+	b = _mm_min_pd(_mm_max_pd(b, low), high);
+	return _mm_unpacklo_epi64(_mm_cvtpd_epi32(a), _mm_cvtpd_epi32(b));
+}
+
+inline void convertToInt8(const float* in, size_t count, int8_t* out, float scale)
+{
+	const __m128 s = _mm_set1_ps(scale);
+	const __m128 low = _mm_set1_ps(-128.0f);
+	const __m128 high = _mm_set1_ps(127.0f);
+	size_t i = 0;
+
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i a = _mm_packs_epi32(scaleAndClamp_sse2(in + i, s, low, high), scaleAndClamp_sse2(in + i + 4, s, low, high));
+		__m128i b = _mm_packs_epi32(scaleAndClamp_sse2(in + i + 8, s, low, high), scaleAndClamp_sse2(in + i + 12, s, low, high));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi16(a, b));
+	}
+
+	convertToInt8<float>(in + i, count - i, out + i, scale);
+}
+
+inline void convertToInt8(const double* in, size_t count, int8_t* out, float scale)
+{
+	const __m128d s = _mm_set1_pd(scale);
+	const __m128d low = _mm_set1_pd(-128.0);
+	const __m128d high = _mm_set1_pd(127.0);
+	size_t i = 0;
+
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i a = _mm_packs_epi32(scaleAndClamp_sse2(in + i, s, low, high), scaleAndClamp_sse2(in + i + 4, s, low, high));
+		__m128i b = _mm_packs_epi32(scaleAndClamp_sse2(in + i + 8, s, low, high), scaleAndClamp_sse2(in + i + 12, s, low, high));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi16(a, b));
+	}
+
+	convertToInt8<double>(in + i, count - i, out + i, scale);
+}
+
+inline void convertToInt16(const float* in, size_t count, int16_t* out, float scale, bool swap)
+{
+	const __m128 s = _mm_set1_ps(scale);
+	const __m128 low = _mm_set1_ps(-32768.0f);
+	const __m128 high = _mm_set1_ps(32767.0f);
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i v = _mm_packs_epi32(scaleAndClamp_sse2(in + i, s, low, high), scaleAndClamp_sse2(in + i + 4, s, low, high));
+
+		if (swap)
+		{
+			v = bswap16_sse2(v);
+		}
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), v);
+	}
+
+	convertToInt16<float>(in + i, count - i, out + i, scale, swap);
+}
+
+inline void convertToInt16(const double* in, size_t count, int16_t* out, float scale, bool swap)
+{
+	const __m128d s = _mm_set1_pd(scale);
+	const __m128d low = _mm_set1_pd(-32768.0);
+	const __m128d high = _mm_set1_pd(32767.0);
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i v = _mm_packs_epi32(scaleAndClamp_sse2(in + i, s, low, high), scaleAndClamp_sse2(in + i + 4, s, low, high));
+
+		if (swap)
+		{
+			v = bswap16_sse2(v);
+		}
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), v);
+	}
+
+	convertToInt16<double>(in + i, count - i, out + i, scale, swap);
+}
+
+inline void convertToFloat(const float* in, size_t count, float* out, float scale, bool swap)
+{
+	const __m128 s = _mm_set1_ps(scale);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i v = _mm_castps_si128(_mm_mul_ps(_mm_loadu_ps(in + i), s));
+
+		if (swap)
+		{
+			v = bswap32_sse2(v);
+		}
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), v);
+	}
+
+	convertToFloat<float>(in + i, count - i, out + i, scale, swap);
+}
+
+inline void convertToFloat(const double* in, size_t count, float* out, float scale, bool swap)
+{
+	const __m128d s = _mm_set1_pd(scale);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 a = _mm_cvtpd_ps(_mm_mul_pd(_mm_loadu_pd(in + i), s));
+		__m128 b = _mm_cvtpd_ps(_mm_mul_pd(_mm_loadu_pd(in + i + 2), s));
+		__m128i v = _mm_castps_si128(_mm_movelh_ps(a, b));
+
+		if (swap)
+		{
+			v = bswap32_sse2(v);
+		}
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), v);
+	}
+
+	convertToFloat<double>(in + i, count - i, out + i, scale, swap);
+}
+#endif
+
+/*
+ * Convert count samples into the requested format, writing
+ * the packed result to out.  If swap is set, the bytes of each
+ * output sample are reversed in the same pass so the data is
+ * only touched once
+ */
+template<typename T> void convertSamples(const T* in, size_t count, char* out, SampleFormat format, float scale, bool swap)
+{
+	switch (format) {
+	case FORMAT_INT8:
+		convertToInt8(in, count, reinterpret_cast<int8_t*>(out), scale);
+		break;
+	case FORMAT_INT16:
+		convertToInt16(in, count, reinterpret_cast<int16_t*>(out), scale, swap);
+		break;
+	case FORMAT_FLOAT:
+		convertToFloat(in, count, reinterpret_cast<float*>(out), scale, swap);
+		break;
+	default:
+		break;
+	}
+}
+
+#endif /* FORMATCONVERT_H_ */
@@ -0,0 +1,340 @@
+/*
+ * Loopback load test of the data path, built with "make loadtest"
+ * and not installed.  Synthetic packets are written through an
+ * InternalConnection at a fixed rate and size, and received by
+ * native receivers in the same process.  Run as
+ *
+ *   ./loadtest [--topology=client|server] [--connections=N]
+ *              [--size=BYTES] [--rate=PACKETS_PER_SEC]
+ *              [--duration=SECONDS] [--port=FIRST_PORT]
+ *
+ * With the client topology the sink connects to one receiver per
+ * port, with the server topology the receivers connect to the
+ * sink.  A rate of 0 sends as fast as the receivers keep up.
+ *
+ * Each packet starts with its sequence number and send time, so
+ * the receivers can measure the latency from the write call to
+ * the whole packet arriving.  One CSV line is printed with the
+ * throughput, the CPU time used per GB received and the latency
+ * percentiles.  The process CPU time includes the receivers,
+ * whose share is also given on its own
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <boost/scoped_ptr.hpp>
+
+#include "InternalConnection.h"
+
+// The sequence number and send time at the start of every packet
+#define LOADTEST_HEADER_SIZE 16
+
+// The sender waits when a receiver is this far behind
+#define LOADTEST_WINDOW_BYTES (64 * 1024 * 1024)
+
+static double now()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static double threadCpuTime()
+{
+	timespec t;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static double processCpuTime()
+{
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+}
+
+/*
+ * Reads whole packets from one port on its own thread, keeping
+ * the latency of each one
+ */
+class Receiver
+{
+public:
+	Receiver(bool listen, unsigned short port, size_t packetSize) :
+		bytes_(0),
+		connected_(false),
+		cpuTime_(0),
+		listen_(listen),
+		packetSize_(packetSize),
+		port_(port),
+		socket_(io_service_),
+		thread_(NULL)
+	{
+		if (listen_) {
+			acceptor_.reset(new tcp::acceptor(io_service_, tcp::endpoint(tcp::v4(), port_)));
+		}
+
+		latencies_.reserve(1024 * 1024);
+	}
+
+	~Receiver()
+	{
+		if (thread_) {
+			thread_->join();
+			delete thread_;
+		}
+	}
+
+	void start()
+	{
+		thread_ = new boost::thread(boost::bind(&Receiver::run, this));
+	}
+
+	void join()
+	{
+		thread_->join();
+		delete thread_;
+		thread_ = NULL;
+	}
+
+	size_t bytes()
+	{
+		boost::mutex::scoped_lock lock(lock_);
+		return bytes_;
+	}
+
+	bool connected()
+	{
+		boost::mutex::scoped_lock lock(lock_);
+		return connected_;
+	}
+
+	double cpuTime() const { return cpuTime_; }
+	const std::vector<float> &latencies() const { return latencies_; }
+
+private:
+	void run()
+	{
+		double startCpu = threadCpuTime();
+
+		try {
+			if (listen_) {
+				acceptor_->accept(socket_);
+			} else {
+				socket_.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), port_));
+			}
+
+			socket_.set_option(tcp::no_delay(true));
+
+			{
+				boost::mutex::scoped_lock lock(lock_);
+				connected_ = true;
+			}
+
+			std::vector<char> packet(packetSize_);
+
+			// Stops when the sink closes the connection
+			while (true) {
+				boost::asio::read(socket_, boost::asio::buffer(packet));
+
+				double received = now();
+				double sent;
+				memcpy(&sent, &packet[8], sizeof(sent));
+
+				latencies_.push_back((received - sent) * 1e6);
+
+				boost::mutex::scoped_lock lock(lock_);
+				bytes_ += packetSize_;
+			}
+		} catch (std::exception &e) {
+		}
+
+		cpuTime_ = threadCpuTime() - startCpu;
+	}
+
+	boost::asio::io_service io_service_;
+	boost::scoped_ptr<tcp::acceptor> acceptor_;
+	size_t bytes_;
+	bool connected_;
+	double cpuTime_;
+	std::vector<float> latencies_;
+	bool listen_;
+	boost::mutex lock_;
+	size_t packetSize_;
+	unsigned short port_;
+	tcp::socket socket_;
+	boost::thread *thread_;
+};
+
+static double percentile(const std::vector<float> &sorted, double fraction)
+{
+	if (sorted.empty()) {
+		return 0;
+	}
+
+	return sorted[std::min(sorted.size() - 1, size_t(fraction * sorted.size()))];
+}
+
+int main(int argc, char *argv[])
+{
+	std::string topology = "client";
+	size_t connections = 1;
+	size_t packetSize = 65536;
+	double rate = 10000;
+	double duration = 10;
+	unsigned short firstPort = 48000;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		std::string value = arg.substr(arg.find('=') + 1);
+
+		if (arg.compare(0, 11, "--topology=") == 0) {
+			topology = value;
+		} else if (arg.compare(0, 14, "--connections=") == 0) {
+			connections = std::max(1, atoi(value.c_str()));
+		} else if (arg.compare(0, 7, "--size=") == 0) {
+			packetSize = std::max(LOADTEST_HEADER_SIZE, atoi(value.c_str()));
+		} else if (arg.compare(0, 7, "--rate=") == 0) {
+			rate = atof(value.c_str());
+		} else if (arg.compare(0, 11, "--duration=") == 0) {
+			duration = atof(value.c_str());
+		} else if (arg.compare(0, 7, "--port=") == 0) {
+			firstPort = atoi(value.c_str());
+		} else {
+			fprintf(stderr, "Unknown option %s\n", arg.c_str());
+			return 1;
+		}
+	}
+
+	if (topology != "client" && topology != "server") {
+		fprintf(stderr, "Unknown topology %s\n", topology.c_str());
+		return 1;
+	}
+
+	// The receivers listen for the sink's clients, or connect to the
+	// sink's servers once they exist
+	bool sinkIsClient = (topology == "client");
+	std::vector<Receiver *> receivers;
+	ConnectionConfig settings;
+
+	settings.connection_type = topology;
+	settings.ip_address = sinkIsClient ? "127.0.0.1" : "";
+	settings.ports.clear();
+
+	for (size_t i = 0; i != connections; ++i) {
+		receivers.push_back(new Receiver(sinkIsClient, firstPort + i, packetSize));
+		settings.ports.push_back(firstPort + i);
+	}
+
+	settings.byte_swap.assign(connections, 0);
+
+	InternalConnection *connection = new InternalConnection(settings);
+
+	for (size_t i = 0; i != connections; ++i) {
+		receivers[i]->start();
+	}
+
+	// Wait for every receiver, then give the servers time to accept
+	double deadline = now() + 10;
+
+	for (size_t i = 0; i != connections; ++i) {
+		while (not receivers[i]->connected()) {
+			if (now() > deadline) {
+				fprintf(stderr, "Port %u didn't connect\n", firstPort + unsigned(i));
+				return 1;
+			}
+
+			usleep(1000);
+		}
+	}
+
+	usleep(200000);
+
+	std::vector<char> packet(packetSize, 0);
+	uint64_t sequence = 0;
+	double interval = (rate > 0) ? 1.0 / rate : 0;
+	double startCpu = processCpuTime();
+	double start = now();
+	double next = start;
+
+	while (now() - start < duration) {
+		// Keep to the schedule, sleeping when there is time and
+		// spinning for the last stretch
+		if (interval) {
+			double wait;
+
+			while ((wait = next - now()) > 0) {
+				if (wait > 200e-6) {
+					usleep(long((wait - 100e-6) * 1e6));
+				}
+			}
+
+			next += interval;
+		}
+
+		// Don't let any receiver fall too far behind
+		for (size_t i = 0; i != connections; ++i) {
+			while (sequence * packetSize - receivers[i]->bytes() > LOADTEST_WINDOW_BYTES) {
+				usleep(50);
+			}
+		}
+
+		double sent = now();
+
+		memcpy(&packet[0], &sequence, sizeof(sequence));
+		memcpy(&packet[8], &sent, sizeof(sent));
+
+		connection->write(packet);
+		++sequence;
+	}
+
+	// Let the receivers catch up before stopping the clock
+	deadline = now() + 10;
+
+	for (size_t i = 0; i != connections; ++i) {
+		while (receivers[i]->bytes() < sequence * packetSize && now() < deadline) {
+			usleep(100);
+		}
+	}
+
+	double elapsed = now() - start;
+	double cpu = processCpuTime() - startCpu;
+
+	// Closing the sink's sockets stops the receivers
+	delete connection;
+
+	std::vector<float> latencies;
+	double receiverCpu = 0;
+	size_t received = 0;
+
+	for (size_t i = 0; i != connections; ++i) {
+		receivers[i]->join();
+		received += receivers[i]->bytes();
+		receiverCpu += receivers[i]->cpuTime();
+		latencies.insert(latencies.end(), receivers[i]->latencies().begin(), receivers[i]->latencies().end());
+		delete receivers[i];
+	}
+
+	std::sort(latencies.begin(), latencies.end());
+
+	double gigabytes = received / 1e9;
+
+	printf("topology,connections,packet_bytes,target_pps,seconds,packets_sent,packets_received,gbps,pps,"
+			"cpu_s_per_gb,receiver_cpu_s_per_gb,latency_p50_us,latency_p90_us,latency_p99_us,latency_p999_us,latency_max_us\n");
+	printf("%s,%zu,%zu,%.0f,%.3f,%llu,%zu,%.3f,%.0f,%.3f,%.3f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+			topology.c_str(), connections, packetSize, rate, elapsed, (unsigned long long) sequence, received / packetSize,
+			received * 8 / elapsed / 1e9, sequence / elapsed,
+			gigabytes ? cpu / gigabytes : 0, gigabytes ? receiverCpu / gigabytes : 0,
+			percentile(latencies, 0.5), percentile(latencies, 0.9), percentile(latencies, 0.99), percentile(latencies, 0.999),
+			latencies.empty() ? 0 : latencies.back());
+
+	return 0;
+}
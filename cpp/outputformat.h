@@ -0,0 +1,75 @@
+#ifndef OUTPUTFORMAT_H_
+#define OUTPUTFORMAT_H_
+
+#include <map>
+#include <vector>
+
+#include "CompressionPool.h"
+#include "formatconvert.h"
+
+/*
+ * Everything that determines the bytes sent to a port:
+ * the byte swap value, the sample format, the scale
+ * factor applied before converting and the compression.
+ * Connections with the same OutputFormat share a single
+ * transformed buffer
+ */
+struct OutputFormat {
+	OutputFormat() :
+		byteSwap(0),
+		compression(COMPRESSION_NONE),
+		format(FORMAT_NATIVE),
+		scale(1.0)
+	{}
+
+	OutputFormat(unsigned short byte_swap, SampleFormat sample_format, float scale_factor, CompressionType compression_type=COMPRESSION_NONE) :
+		byteSwap(byte_swap),
+		compression(compression_type),
+		format(sample_format),
+		scale(sample_format == FORMAT_NATIVE ? 1.0f : scale_factor)
+	{}
+
+	// The same format before compression is applied
+	OutputFormat uncompressed() const
+	{
+		return OutputFormat(byteSwap, format, scale);
+	}
+
+	// True if the data can be sent exactly as it was received
+	bool isNative() const
+	{
+		return byteSwap == 0 && format == FORMAT_NATIVE && compression == COMPRESSION_NONE;
+	}
+
+	unsigned short byteSwap;
+	CompressionType compression;
+	SampleFormat format;
+	float scale;
+};
+
+inline bool operator<(const OutputFormat &lhs, const OutputFormat &rhs)
+{
+	if (lhs.byteSwap != rhs.byteSwap) {
+		return lhs.byteSwap < rhs.byteSwap;
+	}
+
+	if (lhs.format != rhs.format) {
+		return lhs.format < rhs.format;
+	}
+
+	if (lhs.compression != rhs.compression) {
+		return lhs.compression < rhs.compression;
+	}
+
+	return lhs.scale < rhs.scale;
+}
+
+inline bool operator==(const OutputFormat &lhs, const OutputFormat &rhs)
+{
+	return lhs.byteSwap == rhs.byteSwap && lhs.format == rhs.format && lhs.scale == rhs.scale && lhs.compression == rhs.compression;
+}
+
+typedef std::map<OutputFormat, DataBuffer> outputDataMap;
+typedef std::map<OutputFormat, CompressionStats> compressionStatsMap;
+
+#endif /* OUTPUTFORMAT_H_ */
@@ -0,0 +1,64 @@
+#ifndef PORTRANGE_H_
+#define PORTRANGE_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/*
+ * Parse a list of ports and port ranges such as
+ * "40000-40999, 41500" and append every port it names,
+ * in order, to ports.  Returns false if any entry isn't
+ * a port or a range of ports, after appending the ports
+ * of the entries that are
+ */
+inline bool parsePortRanges(const std::string &ranges, std::vector<unsigned short> &ports)
+{
+	bool valid = true;
+	size_t start = 0;
+
+	while (start <= ranges.size()) {
+		size_t end = ranges.find(',', start);
+
+		if (end == std::string::npos) {
+			end = ranges.size();
+		}
+
+		std::string entry = ranges.substr(start, end - start);
+		size_t first = entry.find_first_not_of(" \t");
+
+		start = end + 1;
+
+		// Skip empty entries, such as a trailing comma
+		if (first == std::string::npos) {
+			continue;
+		}
+
+		const char *text = entry.c_str() + first;
+		char *rest;
+		unsigned long low = strtoul(text, &rest, 10);
+		unsigned long high = low;
+
+		if (rest != text && rest[strspn(rest, " \t")] == '-') {
+			rest += strspn(rest, " \t");
+			text = rest + 1;
+			high = strtoul(text, &rest, 10);
+		}
+
+		if (rest == text || rest[strspn(rest, " \t")] != '\0' || low == 0 || low > high || high > 65535) {
+			valid = false;
+			continue;
+		}
+
+		ports.reserve(ports.size() + high - low + 1);
+
+		for (unsigned long port = low; port <= high; ++port) {
+			ports.push_back(port);
+		}
+	}
+
+	return valid;
+}
+
+#endif /* PORTRANGE_H_ */
@@ -0,0 +1,40 @@
+#ifndef PROBES_H_
+#define PROBES_H_
+
+/*
+ * Static tracepoints on the data path, for bpftrace, perf or
+ * systemtap.  With sys/sdt.h each probe is a single nop and a
+ * note in the binary, so it costs nothing until a tracer
+ * attaches; without it the probes compile to nothing.  The
+ * arguments must be cheap to evaluate, since they are
+ * evaluated whether or not a tracer is attached.
+ *
+ * All probes belong to the customsink provider:
+ *
+ *   packet_arrival(bytes, stream_id, sample_size)
+ *   swap_start(bytes, stream_id, swap_width)
+ *   swap_end(bytes, stream_id, swap_width)
+ *   enqueue(bytes, port, queued_bytes)
+ *   write_done(bytes, port, error)
+ *   connect(port, address)
+ *   disconnect(port, error)
+ *
+ * Strings are passed as pointers, read with str() in bpftrace.
+ * The sockets only see bytes, so the enqueue probes don't carry
+ * the stream; they fire on the thread that handled the packet,
+ * right after its packet_arrival, so a script can match them up
+ * by thread.  For example
+ *
+ *   bpftrace -e 'usdt:./CustomSink:customsink:enqueue { @[arg1] = sum(arg0); }'
+ */
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+
+#define SINK_PROBE2(name, a, b) DTRACE_PROBE2(customsink, name, a, b)
+#define SINK_PROBE3(name, a, b, c) DTRACE_PROBE3(customsink, name, a, b, c)
+#else
+#define SINK_PROBE2(name, a, b) do {} while (0)
+#define SINK_PROBE3(name, a, b, c) do {} while (0)
+#endif
+
+#endif /* PROBES_H_ */
@@ -11,6 +11,7 @@ public:
 		maxSize(max_size),
 		maxTime(max_time),
 		maxBytes(max_bytes),
+		lastRate(0.0),
 		totalBytes(0)
 	{}
 
@@ -32,15 +33,23 @@ public:
 				times.pop_front();
 				packetSizes.pop_front();
 			}
-			return totalBytes/delT;
+			return lastRate = totalBytes/delT;
 		}
 		else
-			return 0.0;
+			return lastRate = 0.0;
+	}
+
+	// The rate as of the last packet, for reporting without
+	// counting a packet
+	float rate() const
+	{
+		return lastRate;
 	}
 private:
 	const size_t maxSize;
 	const float maxTime;
 	const unsigned long maxBytes;
+	float lastRate;
 	std::list<size_t> packetSizes;
 	std::list<timeval> times;
 	unsigned long totalBytes;
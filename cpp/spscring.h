@@ -0,0 +1,89 @@
+#ifndef SPSCRING_H_
+#define SPSCRING_H_
+
+#include <stddef.h>
+#include <vector>
+
+// The indices are kept this far apart so the producer and the
+// consumer don't write to the same cache line
+#define SPSC_CACHE_LINE 64
+
+/*
+ * A fixed capacity FIFO passed from one thread to another
+ * without a lock.  Each side only writes its own index, and
+ * publishes it after the slot it covers, so the other side
+ * never sees a slot before it is ready.  The capacity is
+ * rounded up to a power of two.
+ *
+ * Only one thread may push and only one thread may pop
+ */
+template<typename T>
+class SpscRing
+{
+public:
+	explicit SpscRing(size_t capacity) :
+		head_(0),
+		tail_(0)
+	{
+		size_t size = 1;
+
+		while (size < capacity)
+			size <<= 1;
+
+		slots_.resize(size);
+		mask_ = size - 1;
+	}
+
+	// Returns false if the ring is full
+	bool push(const T &value)
+	{
+		size_t tail = __atomic_load_n(&tail_, __ATOMIC_RELAXED);
+
+		if (tail - __atomic_load_n(&head_, __ATOMIC_ACQUIRE) == slots_.size())
+			return false;
+
+		slots_[tail & mask_] = value;
+		__atomic_store_n(&tail_, tail + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+
+	// Returns false if the ring is empty.  The slot is cleared, so
+	// the ring doesn't keep what it held alive
+	bool pop(T &value)
+	{
+		size_t head = __atomic_load_n(&head_, __ATOMIC_RELAXED);
+
+		if (head == __atomic_load_n(&tail_, __ATOMIC_ACQUIRE))
+			return false;
+
+		T &slot = slots_[head & mask_];
+		value = slot;
+		slot = T();
+		__atomic_store_n(&head_, head + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+
+	bool empty() const
+	{
+		return __atomic_load_n(&head_, __ATOMIC_ACQUIRE) == __atomic_load_n(&tail_, __ATOMIC_ACQUIRE);
+	}
+
+	size_t capacity() const
+	{
+		return slots_.size();
+	}
+
+private:
+	SpscRing(const SpscRing &copy);
+	SpscRing &operator=(const SpscRing &copy);
+
+	std::vector<T> slots_;
+	size_t mask_;
+	char padHead_[SPSC_CACHE_LINE];
+	size_t head_;
+	char padTail_[SPSC_CACHE_LINE - sizeof(size_t)];
+	size_t tail_;
+	char padEnd_[SPSC_CACHE_LINE - sizeof(size_t)];
+};
+
+#endif /* SPSCRING_H_ */
@@ -0,0 +1,95 @@
+#ifndef STAGETIMER_H_
+#define STAGETIMER_H_
+
+#include <time.h>
+
+/*
+ * Read the CPU's cycle counter, or the monotonic clock in
+ * nanoseconds where there isn't one.  Costs a few nanoseconds,
+ * so it can time every packet
+ */
+inline unsigned long long readCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned int low, high;
+	__asm__ __volatile__ ("rdtsc" : "=a" (low), "=d" (high));
+	return ((unsigned long long) high << 32) | low;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/*
+ * Converts cycles to seconds.  The rate of the counter is
+ * measured against the monotonic clock over the lifetime of
+ * the clock, so nothing has to be calibrated up front and the
+ * estimate improves the longer it runs
+ */
+class CycleClock
+{
+public:
+	CycleClock() :
+		startCycles_(readCycles()),
+		startTime_(now())
+	{}
+
+	double secondsPerCycle() const
+	{
+		unsigned long long cycles = readCycles() - startCycles_;
+		double elapsed = now() - startTime_;
+
+		if (cycles == 0 or elapsed <= 0) {
+			return 0;
+		}
+
+		return elapsed / cycles;
+	}
+
+private:
+	static double now()
+	{
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec + ts.tv_nsec / 1e9;
+	}
+
+	unsigned long long startCycles_;
+	double startTime_;
+};
+
+/*
+ * The time spent in one stage of the data path, in cycles.
+ * Only updated by one thread
+ */
+struct StageCounter {
+	StageCounter() :
+		count(0),
+		cycles(0),
+		maxCycles(0)
+	{}
+
+	// A stage that handled several items at once counts each of
+	// them, while the maximum stays the longest single call
+	void add(unsigned long long elapsed, unsigned long long items = 1)
+	{
+		count += items;
+		cycles += elapsed;
+
+		if (elapsed > maxCycles) {
+			maxCycles = elapsed;
+		}
+	}
+
+	void reset()
+	{
+		*this = StageCounter();
+	}
+
+	unsigned long long count;
+	unsigned long long cycles;
+	unsigned long long maxCycles;
+};
+
+#endif /* STAGETIMER_H_ */
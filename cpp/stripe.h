@@ -0,0 +1,61 @@
+#ifndef STRIPE_H_
+#define STRIPE_H_
+
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+#include "SendQueue.h"
+
+#define STRIPE_HEADER_SIZE 20
+
+/*
+ * How a connection distributes data across its ports.
+ * DISTRIBUTION_COPY sends every port a full copy, the
+ * others split the stream so each port gets a share
+ */
+enum DistributionMode {
+	DISTRIBUTION_COPY,
+	DISTRIBUTION_ROUND_ROBIN,
+	DISTRIBUTION_LEAST_LOADED
+};
+
+inline bool parseDistributionMode(const std::string &name, DistributionMode &mode)
+{
+	if (name == "copy" || name == "") {
+		mode = DISTRIBUTION_COPY;
+	} else if (name == "round_robin") {
+		mode = DISTRIBUTION_ROUND_ROBIN;
+	} else if (name == "least_loaded") {
+		mode = DISTRIBUTION_LEAST_LOADED;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Build a stripe: a 20 byte header followed by length bytes of
+ * the packet starting at offset.  The header is the magic "CSKS"
+ * then the packet sequence number, the packet size, the offset
+ * and the length as big endian 32 bit integers, which is enough
+ * for the receiver to put the packet back together
+ */
+inline SharedBuffer makeStripe(uint32_t sequence, const char *packet, size_t packetSize, size_t offset, size_t length)
+{
+	SendBuffer *stripe = new SendBuffer(STRIPE_HEADER_SIZE + length);
+	uint32_t header[4] = { htonl(sequence), htonl(packetSize), htonl(offset), htonl(length) };
+
+	memcpy(&(*stripe)[0], "CSKS", 4);
+	memcpy(&(*stripe)[4], header, sizeof(header));
+
+	if (length) {
+		memcpy(&(*stripe)[STRIPE_HEADER_SIZE], packet + offset, length);
+	}
+
+	return SharedBuffer(stripe);
+}
+
+#endif /* STRIPE_H_ */
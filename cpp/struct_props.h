@@ -18,6 +18,23 @@ struct Connection_struct {
         ip_address = "";
         byte_swap.push_back(0);
         ports.push_back(32191);
+        output_format = "native";
+        scale_factor = 1.0;
+        compression = "none";
+        rate_limit = 0;
+        burst_size = 65536;
+        distribution = "copy";
+        stripe_size = 0;
+        inbound_mode = "buffer";
+        inbound_buffer_size = 1048576;
+        read_chunk_size = 65536;
+        port_ranges = "";
+        connect_timeout = 5.0;
+        coalesce_bytes = 0;
+        coalesce_delay = 0.001;
+        slow_consumer_lag = 0;
+        slow_consumer_bytes = 0;
+        slow_consumer_action = "disconnect";
     };
 
     static std::string getId() {
@@ -28,6 +45,23 @@ struct Connection_struct {
     std::string ip_address;
     std::vector<unsigned short> byte_swap;
     std::vector<unsigned short> ports;
+    std::string output_format;
+    float scale_factor;
+    std::string compression;
+    double rate_limit;
+    CORBA::ULong burst_size;
+    std::string distribution;
+    CORBA::ULong stripe_size;
+    std::string inbound_mode;
+    CORBA::ULong inbound_buffer_size;
+    CORBA::ULong read_chunk_size;
+    std::string port_ranges;
+    double connect_timeout;
+    CORBA::ULong coalesce_bytes;
+    double coalesce_delay;
+    double slow_consumer_lag;
+    CORBA::ULong slow_consumer_bytes;
+    std::string slow_consumer_action;
 };
 
 inline bool operator>>= (const CORBA::Any& a, Connection_struct& s) {
@@ -46,6 +80,57 @@ inline bool operator>>= (const CORBA::Any& a, Connection_struct& s) {
     if (props.contains("Connection::ports")) {
         if (!(props["Connection::ports"] >>= s.ports)) return false;
     }
+    if (props.contains("Connection::output_format")) {
+        if (!(props["Connection::output_format"] >>= s.output_format)) return false;
+    }
+    if (props.contains("Connection::scale_factor")) {
+        if (!(props["Connection::scale_factor"] >>= s.scale_factor)) return false;
+    }
+    if (props.contains("Connection::compression")) {
+        if (!(props["Connection::compression"] >>= s.compression)) return false;
+    }
+    if (props.contains("Connection::rate_limit")) {
+        if (!(props["Connection::rate_limit"] >>= s.rate_limit)) return false;
+    }
+    if (props.contains("Connection::burst_size")) {
+        if (!(props["Connection::burst_size"] >>= s.burst_size)) return false;
+    }
+    if (props.contains("Connection::distribution")) {
+        if (!(props["Connection::distribution"] >>= s.distribution)) return false;
+    }
+    if (props.contains("Connection::stripe_size")) {
+        if (!(props["Connection::stripe_size"] >>= s.stripe_size)) return false;
+    }
+    if (props.contains("Connection::inbound_mode")) {
+        if (!(props["Connection::inbound_mode"] >>= s.inbound_mode)) return false;
+    }
+    if (props.contains("Connection::inbound_buffer_size")) {
+        if (!(props["Connection::inbound_buffer_size"] >>= s.inbound_buffer_size)) return false;
+    }
+    if (props.contains("Connection::read_chunk_size")) {
+        if (!(props["Connection::read_chunk_size"] >>= s.read_chunk_size)) return false;
+    }
+    if (props.contains("Connection::port_ranges")) {
+        if (!(props["Connection::port_ranges"] >>= s.port_ranges)) return false;
+    }
+    if (props.contains("Connection::connect_timeout")) {
+        if (!(props["Connection::connect_timeout"] >>= s.connect_timeout)) return false;
+    }
+    if (props.contains("Connection::coalesce_bytes")) {
+        if (!(props["Connection::coalesce_bytes"] >>= s.coalesce_bytes)) return false;
+    }
+    if (props.contains("Connection::coalesce_delay")) {
+        if (!(props["Connection::coalesce_delay"] >>= s.coalesce_delay)) return false;
+    }
+    if (props.contains("Connection::slow_consumer_lag")) {
+        if (!(props["Connection::slow_consumer_lag"] >>= s.slow_consumer_lag)) return false;
+    }
+    if (props.contains("Connection::slow_consumer_bytes")) {
+        if (!(props["Connection::slow_consumer_bytes"] >>= s.slow_consumer_bytes)) return false;
+    }
+    if (props.contains("Connection::slow_consumer_action")) {
+        if (!(props["Connection::slow_consumer_action"] >>= s.slow_consumer_action)) return false;
+    }
     return true;
 }
 
@@ -59,6 +144,40 @@ inline void operator<<= (CORBA::Any& a, const Connection_struct& s) {
     props["Connection::byte_swap"] = s.byte_swap;
  
     props["Connection::ports"] = s.ports;
+ 
+    props["Connection::output_format"] = s.output_format;
+ 
+    props["Connection::scale_factor"] = s.scale_factor;
+ 
+    props["Connection::compression"] = s.compression;
+ 
+    props["Connection::rate_limit"] = s.rate_limit;
+ 
+    props["Connection::burst_size"] = s.burst_size;
+ 
+    props["Connection::distribution"] = s.distribution;
+ 
+    props["Connection::stripe_size"] = s.stripe_size;
+ 
+    props["Connection::inbound_mode"] = s.inbound_mode;
+ 
+    props["Connection::inbound_buffer_size"] = s.inbound_buffer_size;
+ 
+    props["Connection::read_chunk_size"] = s.read_chunk_size;
+ 
+    props["Connection::port_ranges"] = s.port_ranges;
+ 
+    props["Connection::connect_timeout"] = s.connect_timeout;
+ 
+    props["Connection::coalesce_bytes"] = s.coalesce_bytes;
+ 
+    props["Connection::coalesce_delay"] = s.coalesce_delay;
+ 
+    props["Connection::slow_consumer_lag"] = s.slow_consumer_lag;
+ 
+    props["Connection::slow_consumer_bytes"] = s.slow_consumer_bytes;
+ 
+    props["Connection::slow_consumer_action"] = s.slow_consumer_action;
     a <<= props;
 }
 
@@ -71,6 +190,40 @@ inline bool operator== (const Connection_struct& s1, const Connection_struct& s2
         return false;
     if (s1.ports!=s2.ports)
         return false;
+    if (s1.output_format!=s2.output_format)
+        return false;
+    if (s1.scale_factor!=s2.scale_factor)
+        return false;
+    if (s1.compression!=s2.compression)
+        return false;
+    if (s1.rate_limit!=s2.rate_limit)
+        return false;
+    if (s1.burst_size!=s2.burst_size)
+        return false;
+    if (s1.distribution!=s2.distribution)
+        return false;
+    if (s1.stripe_size!=s2.stripe_size)
+        return false;
+    if (s1.inbound_mode!=s2.inbound_mode)
+        return false;
+    if (s1.inbound_buffer_size!=s2.inbound_buffer_size)
+        return false;
+    if (s1.read_chunk_size!=s2.read_chunk_size)
+        return false;
+    if (s1.port_ranges!=s2.port_ranges)
+        return false;
+    if (s1.connect_timeout!=s2.connect_timeout)
+        return false;
+    if (s1.coalesce_bytes!=s2.coalesce_bytes)
+        return false;
+    if (s1.coalesce_delay!=s2.coalesce_delay)
+        return false;
+    if (s1.slow_consumer_lag!=s2.slow_consumer_lag)
+        return false;
+    if (s1.slow_consumer_bytes!=s2.slow_consumer_bytes)
+        return false;
+    if (s1.slow_consumer_action!=s2.slow_consumer_action)
+        return false;
     return true;
 }
 
@@ -92,6 +245,12 @@ struct ConnectionStat_struct {
     std::string status;
     float bytes_per_second;
     double bytes_sent;
+    float compression_ratio;
+    double compression_cpu_time;
+    double pacing_delay;
+    double bytes_dropped;
+    CORBA::ULong packets_dropped;
+    CORBA::ULong slow_consumers;
 };
 
 inline bool operator>>= (const CORBA::Any& a, ConnectionStat_struct& s) {
@@ -113,6 +272,24 @@ inline bool operator>>= (const CORBA::Any& a, ConnectionStat_struct& s) {
     if (props.contains("ConnectionStat::bytes_sent")) {
         if (!(props["ConnectionStat::bytes_sent"] >>= s.bytes_sent)) return false;
     }
+    if (props.contains("ConnectionStat::compression_ratio")) {
+        if (!(props["ConnectionStat::compression_ratio"] >>= s.compression_ratio)) return false;
+    }
+    if (props.contains("ConnectionStat::compression_cpu_time")) {
+        if (!(props["ConnectionStat::compression_cpu_time"] >>= s.compression_cpu_time)) return false;
+    }
+    if (props.contains("ConnectionStat::pacing_delay")) {
+        if (!(props["ConnectionStat::pacing_delay"] >>= s.pacing_delay)) return false;
+    }
+    if (props.contains("ConnectionStat::bytes_dropped")) {
+        if (!(props["ConnectionStat::bytes_dropped"] >>= s.bytes_dropped)) return false;
+    }
+    if (props.contains("ConnectionStat::packets_dropped")) {
+        if (!(props["ConnectionStat::packets_dropped"] >>= s.packets_dropped)) return false;
+    }
+    if (props.contains("ConnectionStat::slow_consumers")) {
+        if (!(props["ConnectionStat::slow_consumers"] >>= s.slow_consumers)) return false;
+    }
     return true;
 }
 
@@ -128,6 +305,18 @@ inline void operator<<= (CORBA::Any& a, const ConnectionStat_struct& s) {
     props["ConnectionStat::bytes_per_second"] = s.bytes_per_second;
  
     props["ConnectionStat::bytes_sent"] = s.bytes_sent;
+ 
+    props["ConnectionStat::compression_ratio"] = s.compression_ratio;
+ 
+    props["ConnectionStat::compression_cpu_time"] = s.compression_cpu_time;
+ 
+    props["ConnectionStat::pacing_delay"] = s.pacing_delay;
+ 
+    props["ConnectionStat::bytes_dropped"] = s.bytes_dropped;
+ 
+    props["ConnectionStat::packets_dropped"] = s.packets_dropped;
+ 
+    props["ConnectionStat::slow_consumers"] = s.slow_consumers;
     a <<= props;
 }
 
@@ -142,6 +331,18 @@ inline bool operator== (const ConnectionStat_struct& s1, const ConnectionStat_st
         return false;
     if (s1.bytes_sent!=s2.bytes_sent)
         return false;
+    if (s1.compression_ratio!=s2.compression_ratio)
+        return false;
+    if (s1.compression_cpu_time!=s2.compression_cpu_time)
+        return false;
+    if (s1.pacing_delay!=s2.pacing_delay)
+        return false;
+    if (s1.bytes_dropped!=s2.bytes_dropped)
+        return false;
+    if (s1.packets_dropped!=s2.packets_dropped)
+        return false;
+    if (s1.slow_consumers!=s2.slow_consumers)
+        return false;
     return true;
 }
 
@@ -149,4 +350,152 @@ inline bool operator!= (const ConnectionStat_struct& s1, const ConnectionStat_st
     return !(s1==s2);
 }
 
+struct PerformanceCounters_struct {
+    PerformanceCounters_struct ()
+    {
+        packets = 0;
+        ingest_total = 0;
+        ingest_average = 0;
+        ingest_max = 0;
+        swap_total = 0;
+        swap_average = 0;
+        swap_max = 0;
+        send_total = 0;
+        send_average = 0;
+        send_max = 0;
+        stats_total = 0;
+        stats_average = 0;
+        stats_max = 0;
+    };
+
+    static std::string getId() {
+        return std::string("PerformanceCounters");
+    };
+
+    double packets;
+    double ingest_total;
+    double ingest_average;
+    double ingest_max;
+    double swap_total;
+    double swap_average;
+    double swap_max;
+    double send_total;
+    double send_average;
+    double send_max;
+    double stats_total;
+    double stats_average;
+    double stats_max;
+};
+
+inline bool operator>>= (const CORBA::Any& a, PerformanceCounters_struct& s) {
+    CF::Properties* temp;
+    if (!(a >>= temp)) return false;
+    const redhawk::PropertyMap& props = redhawk::PropertyMap::cast(*temp);
+    if (props.contains("PerformanceCounters::packets")) {
+        if (!(props["PerformanceCounters::packets"] >>= s.packets)) return false;
+    }
+    if (props.contains("PerformanceCounters::ingest_total")) {
+        if (!(props["PerformanceCounters::ingest_total"] >>= s.ingest_total)) return false;
+    }
+    if (props.contains("PerformanceCounters::ingest_average")) {
+        if (!(props["PerformanceCounters::ingest_average"] >>= s.ingest_average)) return false;
+    }
+    if (props.contains("PerformanceCounters::ingest_max")) {
+        if (!(props["PerformanceCounters::ingest_max"] >>= s.ingest_max)) return false;
+    }
+    if (props.contains("PerformanceCounters::swap_total")) {
+        if (!(props["PerformanceCounters::swap_total"] >>= s.swap_total)) return false;
+    }
+    if (props.contains("PerformanceCounters::swap_average")) {
+        if (!(props["PerformanceCounters::swap_average"] >>= s.swap_average)) return false;
+    }
+    if (props.contains("PerformanceCounters::swap_max")) {
+        if (!(props["PerformanceCounters::swap_max"] >>= s.swap_max)) return false;
+    }
+    if (props.contains("PerformanceCounters::send_total")) {
+        if (!(props["PerformanceCounters::send_total"] >>= s.send_total)) return false;
+    }
+    if (props.contains("PerformanceCounters::send_average")) {
+        if (!(props["PerformanceCounters::send_average"] >>= s.send_average)) return false;
+    }
+    if (props.contains("PerformanceCounters::send_max")) {
+        if (!(props["PerformanceCounters::send_max"] >>= s.send_max)) return false;
+    }
+    if (props.contains("PerformanceCounters::stats_total")) {
+        if (!(props["PerformanceCounters::stats_total"] >>= s.stats_total)) return false;
+    }
+    if (props.contains("PerformanceCounters::stats_average")) {
+        if (!(props["PerformanceCounters::stats_average"] >>= s.stats_average)) return false;
+    }
+    if (props.contains("PerformanceCounters::stats_max")) {
+        if (!(props["PerformanceCounters::stats_max"] >>= s.stats_max)) return false;
+    }
+    return true;
+}
+
+inline void operator<<= (CORBA::Any& a, const PerformanceCounters_struct& s) {
+    redhawk::PropertyMap props;
+ 
+    props["PerformanceCounters::packets"] = s.packets;
+ 
+    props["PerformanceCounters::ingest_total"] = s.ingest_total;
+ 
+    props["PerformanceCounters::ingest_average"] = s.ingest_average;
+ 
+    props["PerformanceCounters::ingest_max"] = s.ingest_max;
+ 
+    props["PerformanceCounters::swap_total"] = s.swap_total;
+ 
+    props["PerformanceCounters::swap_average"] = s.swap_average;
+ 
+    props["PerformanceCounters::swap_max"] = s.swap_max;
+ 
+    props["PerformanceCounters::send_total"] = s.send_total;
+ 
+    props["PerformanceCounters::send_average"] = s.send_average;
+ 
+    props["PerformanceCounters::send_max"] = s.send_max;
+ 
+    props["PerformanceCounters::stats_total"] = s.stats_total;
+ 
+    props["PerformanceCounters::stats_average"] = s.stats_average;
+ 
+    props["PerformanceCounters::stats_max"] = s.stats_max;
+    a <<= props;
+}
+
+inline bool operator== (const PerformanceCounters_struct& s1, const PerformanceCounters_struct& s2) {
+    if (s1.packets!=s2.packets)
+        return false;
+    if (s1.ingest_total!=s2.ingest_total)
+        return false;
+    if (s1.ingest_average!=s2.ingest_average)
+        return false;
+    if (s1.ingest_max!=s2.ingest_max)
+        return false;
+    if (s1.swap_total!=s2.swap_total)
+        return false;
+    if (s1.swap_average!=s2.swap_average)
+        return false;
+    if (s1.swap_max!=s2.swap_max)
+        return false;
+    if (s1.send_total!=s2.send_total)
+        return false;
+    if (s1.send_average!=s2.send_average)
+        return false;
+    if (s1.send_max!=s2.send_max)
+        return false;
+    if (s1.stats_total!=s2.stats_total)
+        return false;
+    if (s1.stats_average!=s2.stats_average)
+        return false;
+    if (s1.stats_max!=s2.stats_max)
+        return false;
+    return true;
+}
+
+inline bool operator!= (const PerformanceCounters_struct& s1, const PerformanceCounters_struct& s2) {
+    return !(s1==s2);
+}
+
 #endif // STRUCTPROPS_H
@@ -0,0 +1,66 @@
+/*
+ * Unit tests of CPU list parsing and formatting
+ */
+#define BOOST_TEST_MODULE affinity
+#include <boost/test/included/unit_test.hpp>
+
+#include <unistd.h>
+
+#include "affinity.h"
+
+static std::string roundTrip(const std::string &list)
+{
+	cpu_set_t cpus;
+
+	BOOST_REQUIRE(parseCpuList(list, cpus));
+	return formatCpuList(cpus);
+}
+
+BOOST_AUTO_TEST_CASE(lists_are_parsed_and_formatted)
+{
+	cpu_set_t cpus;
+
+	BOOST_REQUIRE(parseCpuList("0-3,8,10-11", cpus));
+	BOOST_CHECK_EQUAL(CPU_COUNT(&cpus), 7);
+	BOOST_CHECK(CPU_ISSET(3, &cpus));
+	BOOST_CHECK(not CPU_ISSET(4, &cpus));
+	BOOST_CHECK(CPU_ISSET(11, &cpus));
+
+	BOOST_CHECK_EQUAL(roundTrip("0-3,8,10-11"), "0-3,8,10-11");
+}
+
+BOOST_AUTO_TEST_CASE(lists_are_normalized)
+{
+	// Overlapping, out of order and adjacent ranges merge
+	BOOST_CHECK_EQUAL(roundTrip("5,1-3, 2-4 ,0"), "0-5");
+	BOOST_CHECK_EQUAL(roundTrip("7-7,9"), "7,9");
+	BOOST_CHECK_EQUAL(roundTrip(" , 2,"), "2");
+	BOOST_CHECK_EQUAL(roundTrip(""), "");
+}
+
+BOOST_AUTO_TEST_CASE(invalid_lists_are_rejected)
+{
+	const char *invalid[] = { "a", "1-", "-1", "3-2", "1x", "1-2-3", "0-100000" };
+	cpu_set_t cpus;
+
+	for (size_t i = 0; i != sizeof(invalid) / sizeof(invalid[0]); ++i) {
+		BOOST_CHECK_MESSAGE(not parseCpuList(invalid[i], cpus), invalid[i]);
+	}
+
+	// A thread can't be pinned to a bad list, or to no CPUs
+	BOOST_CHECK(not pinThread(pthread_self(), "bogus"));
+	BOOST_CHECK(not pinThread(pthread_self(), " , "));
+}
+
+BOOST_AUTO_TEST_CASE(empty_list_runs_anywhere)
+{
+	cpu_set_t process;
+	cpu_set_t thread;
+
+	BOOST_REQUIRE(pinThread(pthread_self(), ""));
+	BOOST_REQUIRE_EQUAL(sched_getaffinity(getpid(), sizeof(process), &process), 0);
+	BOOST_REQUIRE_EQUAL(pthread_getaffinity_np(pthread_self(), sizeof(thread), &thread), 0);
+
+	BOOST_CHECK_EQUAL(formatCpuList(thread), formatCpuList(process));
+	BOOST_CHECK(resetMemoryPolicy());
+}
@@ -0,0 +1,182 @@
+/*
+ * Unit tests of the buffer arena: size classes, reuse, splitting
+ * and falling back to the heap
+ */
+#define BOOST_TEST_MODULE arena
+#include <boost/test/included/unit_test.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "BufferArena.h"
+
+static void reserve(size_t bytes)
+{
+	BOOST_REQUIRE(BufferArena::instance().reserve(bytes, ARENA_PAGES_NORMAL, false));
+}
+
+static void churn(size_t bytes)
+{
+	BufferArena &arena = BufferArena::instance();
+
+	for (int i = 0; i != 10000; ++i) {
+		void *block = arena.allocate(bytes);
+
+		static_cast<char *>(block)[bytes - 1] = 1;
+		arena.deallocate(block, bytes);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(sizes_round_up_to_a_class)
+{
+	BufferArena &arena = BufferArena::instance();
+
+	reserve(1024 * 1024);
+
+	// Small buffers always come from the heap
+	void *small = arena.allocate(100);
+
+	BOOST_CHECK_EQUAL(arena.used(), 0u);
+
+	void *page = arena.allocate(ARENA_MIN_BLOCK);
+	void *larger = arena.allocate(ARENA_MIN_BLOCK + 1);
+
+	BOOST_CHECK_EQUAL(arena.used(), 3u * ARENA_MIN_BLOCK);
+
+	arena.deallocate(larger, ARENA_MIN_BLOCK + 1);
+	arena.deallocate(page, ARENA_MIN_BLOCK);
+	arena.deallocate(small, 100);
+
+	BOOST_CHECK_EQUAL(arena.used(), 0u);
+	BOOST_CHECK_EQUAL(arena.misses(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(released_blocks_are_reused)
+{
+	BufferArena &arena = BufferArena::instance();
+
+	reserve(1024 * 1024);
+
+	void *first = arena.allocate(10000);
+
+	arena.deallocate(first, 10000);
+
+	// Any size in the same class gets the same block back
+	void *second = arena.allocate(12000);
+
+	BOOST_CHECK_EQUAL(first, second);
+
+	arena.deallocate(second, 12000);
+}
+
+/*
+ * With the arena carved up into one large free block, smaller
+ * sizes split it instead of going to the heap
+ */
+BOOST_AUTO_TEST_CASE(larger_blocks_are_split)
+{
+	BufferArena &arena = BufferArena::instance();
+
+	reserve(4 * ARENA_MIN_BLOCK);
+
+	char *whole = static_cast<char *>(arena.allocate(4 * ARENA_MIN_BLOCK));
+
+	arena.deallocate(whole, 4 * ARENA_MIN_BLOCK);
+
+	void *first = arena.allocate(ARENA_MIN_BLOCK);
+	void *second = arena.allocate(ARENA_MIN_BLOCK);
+	void *third = arena.allocate(2 * ARENA_MIN_BLOCK);
+
+	BOOST_CHECK_EQUAL(first, whole);
+	BOOST_CHECK_EQUAL(second, whole + ARENA_MIN_BLOCK);
+	BOOST_CHECK_EQUAL(third, whole + 2 * ARENA_MIN_BLOCK);
+	BOOST_CHECK_EQUAL(arena.used(), 4u * ARENA_MIN_BLOCK);
+	BOOST_CHECK_EQUAL(arena.misses(), 0u);
+
+	// Now it's full, so the next one comes from the heap
+	void *heap = arena.allocate(ARENA_MIN_BLOCK);
+
+	BOOST_CHECK_EQUAL(arena.misses(), 1u);
+	BOOST_CHECK_EQUAL(arena.used(), 4u * ARENA_MIN_BLOCK);
+
+	arena.deallocate(heap, ARENA_MIN_BLOCK);
+	arena.deallocate(third, 2 * ARENA_MIN_BLOCK);
+	arena.deallocate(second, ARENA_MIN_BLOCK);
+	arena.deallocate(first, ARENA_MIN_BLOCK);
+
+	BOOST_CHECK_EQUAL(arena.used(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(blocks_outlive_a_new_reserve)
+{
+	BufferArena &arena = BufferArena::instance();
+
+	reserve(1024 * 1024);
+
+	char *old = static_cast<char *>(arena.allocate(ARENA_MIN_BLOCK));
+
+	reserve(1024 * 1024);
+
+	// The old region is still mapped until the block is released
+	old[0] = 1;
+
+	BOOST_CHECK_EQUAL(arena.used(), 0u);
+
+	arena.deallocate(old, ARENA_MIN_BLOCK);
+
+	BOOST_CHECK_EQUAL(arena.used(), 0u);
+
+	// Without an arena everything comes from the heap, and that
+	// isn't a miss
+	reserve(0);
+
+	void *heap = arena.allocate(ARENA_MIN_BLOCK);
+
+	BOOST_CHECK_EQUAL(arena.misses(), 0u);
+
+	arena.deallocate(heap, ARENA_MIN_BLOCK);
+}
+
+/*
+ * Stopping the arena sends new buffers to the heap, but the
+ * blocks still out are returned to their region
+ */
+BOOST_AUTO_TEST_CASE(blocks_outlive_stopping_the_arena)
+{
+	BufferArena &arena = BufferArena::instance();
+
+	reserve(1024 * 1024);
+
+	char *old = static_cast<char *>(arena.allocate(ARENA_MIN_BLOCK));
+
+	reserve(0);
+
+	char *heap = static_cast<char *>(arena.allocate(ARENA_MIN_BLOCK));
+
+	old[0] = 1;
+	heap[0] = 1;
+
+	BOOST_CHECK_EQUAL(arena.used(), 0u);
+
+	arena.deallocate(heap, ARENA_MIN_BLOCK);
+	arena.deallocate(old, ARENA_MIN_BLOCK);
+
+	BOOST_CHECK_EQUAL(arena.misses(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(threads_share_the_arena)
+{
+	boost::thread_group threads;
+
+	reserve(1024 * 1024);
+
+	for (size_t i = 0; i != 4; ++i) {
+		threads.create_thread(boost::bind(&churn, ARENA_MIN_BLOCK << i));
+		threads.create_thread(boost::bind(&churn, ARENA_MIN_BLOCK << i));
+	}
+
+	threads.join_all();
+
+	BOOST_CHECK_EQUAL(BufferArena::instance().used(), 0u);
+	BOOST_CHECK_EQUAL(BufferArena::instance().misses(), 0u);
+}
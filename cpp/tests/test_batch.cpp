@@ -0,0 +1,147 @@
+/*
+ * Unit tests of which packets are batched together, and how
+ * their data is joined
+ */
+#define BOOST_TEST_MODULE batch
+#include <boost/test/included/unit_test.hpp>
+
+#include <string>
+
+#include "batch.h"
+
+// The members of a bulkio packet that batching looks at
+struct Packet {
+	Packet(const std::string &streamID, short first, size_t count, bool sriChanged = false, bool EOS = false) :
+		EOS(EOS),
+		sriChanged(sriChanged),
+		streamID(streamID)
+	{
+		for (size_t i = 0; i != count; ++i) {
+			dataBuffer.push_back(first + i);
+		}
+	}
+
+	std::vector<short> dataBuffer;
+	bool EOS;
+	bool sriChanged;
+	std::string streamID;
+};
+
+/*
+ * Split packets into batches the way the service thread does,
+ * returning the joined data of each batch
+ */
+static std::vector<std::vector<short> > batches(std::vector<Packet> &packets)
+{
+	std::vector<std::vector<short> > joined;
+	size_t i = 0;
+
+	while (i != packets.size()) {
+		std::vector<Packet *> batch(1, &packets[i++]);
+
+		while (i != packets.size() and joinable(*batch.back(), packets[i])) {
+			batch.push_back(&packets[i++]);
+		}
+
+		joinPackets(batch);
+		joined.push_back(batch[0]->dataBuffer);
+	}
+
+	return joined;
+}
+
+BOOST_AUTO_TEST_CASE(packets_of_one_stream_join)
+{
+	std::vector<Packet> packets;
+
+	packets.push_back(Packet("a", 0, 3, true));
+	packets.push_back(Packet("a", 3, 2));
+	packets.push_back(Packet("a", 5, 0));
+	packets.push_back(Packet("a", 5, 4));
+
+	std::vector<std::vector<short> > joined = batches(packets);
+
+	BOOST_REQUIRE_EQUAL(joined.size(), 1u);
+	BOOST_REQUIRE_EQUAL(joined[0].size(), 9u);
+
+	for (size_t i = 0; i != joined[0].size(); ++i) {
+		BOOST_CHECK_EQUAL(joined[0][i], short(i));
+	}
+}
+
+/*
+ * Interleaved streams are never joined, so each stream's data
+ * stays with its own stream ID
+ */
+BOOST_AUTO_TEST_CASE(another_stream_starts_a_new_batch)
+{
+	std::vector<Packet> packets;
+
+	packets.push_back(Packet("a", 0, 2));
+	packets.push_back(Packet("b", 100, 2));
+	packets.push_back(Packet("b", 102, 2));
+	packets.push_back(Packet("a", 2, 2));
+
+	std::vector<std::vector<short> > joined = batches(packets);
+
+	BOOST_REQUIRE_EQUAL(joined.size(), 3u);
+	BOOST_CHECK_EQUAL(packets[0].dataBuffer.size(), 2u);
+	BOOST_CHECK_EQUAL(joined[1].size(), 4u);
+	BOOST_CHECK_EQUAL(joined[1][3], 103);
+	BOOST_CHECK_EQUAL(packets[3].streamID, "a");
+	BOOST_CHECK_EQUAL(joined[2][0], 2);
+}
+
+BOOST_AUTO_TEST_CASE(sri_change_starts_a_new_batch)
+{
+	std::vector<Packet> packets;
+
+	packets.push_back(Packet("a", 0, 2));
+	packets.push_back(Packet("a", 2, 2));
+	packets.push_back(Packet("a", 4, 2, true));
+
+	std::vector<std::vector<short> > joined = batches(packets);
+
+	BOOST_REQUIRE_EQUAL(joined.size(), 2u);
+	BOOST_CHECK_EQUAL(joined[0].size(), 4u);
+	BOOST_CHECK_EQUAL(joined[1].size(), 2u);
+}
+
+BOOST_AUTO_TEST_CASE(end_of_stream_ends_the_batch)
+{
+	std::vector<Packet> packets;
+
+	packets.push_back(Packet("a", 0, 2));
+	packets.push_back(Packet("a", 2, 2, false, true));
+	packets.push_back(Packet("a", 0, 2));
+
+	std::vector<std::vector<short> > joined = batches(packets);
+
+	// The end of stream packet is the last of its batch, and a new
+	// stream with the same ID starts afresh
+	BOOST_REQUIRE_EQUAL(joined.size(), 2u);
+	BOOST_CHECK_EQUAL(joined[0].size(), 4u);
+	BOOST_CHECK_EQUAL(joined[1].size(), 2u);
+}
+
+BOOST_AUTO_TEST_CASE(joining_reserves_the_whole_batch)
+{
+	Packet first("a", 0, 1);
+	Packet second("a", 1, 1000);
+	std::vector<Packet *> batch;
+
+	batch.push_back(&first);
+	batch.push_back(&second);
+
+	joinPackets(batch);
+
+	BOOST_CHECK_EQUAL(first.dataBuffer.size(), 1001u);
+	BOOST_CHECK_EQUAL(first.dataBuffer.capacity(), 1001u);
+	BOOST_CHECK_EQUAL(first.dataBuffer[1000], 1000);
+
+	// A batch of one is left alone
+	batch.resize(1);
+	joinPackets(batch);
+
+	BOOST_CHECK_EQUAL(first.dataBuffer.size(), 1001u);
+}
@@ -0,0 +1,165 @@
+/*
+ * Unit tests of the byte ring that buffers inbound data
+ */
+#define BOOST_TEST_MODULE bytering
+#include <boost/test/included/unit_test.hpp>
+
+#include <stdlib.h>
+#include <deque>
+#include <string>
+
+#include "bytering.h"
+
+static std::string readAll(ByteRing &ring)
+{
+	std::string out(ring.size(), '\0');
+
+	out.resize(ring.read(&out[0], out.size()));
+	return out;
+}
+
+BOOST_AUTO_TEST_CASE(reads_back_what_was_written)
+{
+	ByteRing ring(8);
+	char out[8];
+
+	ring.write("abc", 3);
+
+	BOOST_CHECK_EQUAL(ring.size(), 3u);
+	BOOST_CHECK_EQUAL(ring.read(out, 2), 2u);
+	BOOST_CHECK_EQUAL(std::string(out, 2), "ab");
+	BOOST_CHECK_EQUAL(ring.read(out, 8), 1u);
+	BOOST_CHECK_EQUAL(out[0], 'c');
+	BOOST_CHECK_EQUAL(ring.read(out, 8), 0u);
+	BOOST_CHECK_EQUAL(ring.overwritten(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(data_wraps_around_the_end)
+{
+	ByteRing ring(8);
+	char out[8];
+
+	ring.write("012345", 6);
+	ring.read(out, 5);
+
+	// Starts at offset 6 and wraps after two bytes
+	ring.write("abcdef", 6);
+
+	BOOST_CHECK_EQUAL(ring.size(), 7u);
+	BOOST_CHECK_EQUAL(readAll(ring), "5abcdef");
+	BOOST_CHECK_EQUAL(ring.overwritten(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(full_ring_keeps_the_newest_bytes)
+{
+	ByteRing ring(4);
+
+	ring.write("abc", 3);
+	ring.write("def", 3);
+
+	BOOST_CHECK_EQUAL(ring.size(), 4u);
+	BOOST_CHECK_EQUAL(ring.overwritten(), 2u);
+	BOOST_CHECK_EQUAL(readAll(ring), "cdef");
+}
+
+BOOST_AUTO_TEST_CASE(write_larger_than_the_ring)
+{
+	ByteRing ring(4);
+
+	ring.write("xy", 2);
+	ring.write("0123456789", 10);
+
+	BOOST_CHECK_EQUAL(ring.overwritten(), 8u);
+	BOOST_CHECK_EQUAL(readAll(ring), "6789");
+}
+
+BOOST_AUTO_TEST_CASE(empty_ring_drops_everything)
+{
+	ByteRing ring;
+
+	ring.write("abc", 3);
+
+	BOOST_CHECK_EQUAL(ring.size(), 0u);
+	BOOST_CHECK_EQUAL(ring.overwritten(), 3u);
+}
+
+BOOST_AUTO_TEST_CASE(resize_keeps_the_newest_bytes)
+{
+	ByteRing ring(8);
+	char out[8];
+
+	ring.write("0123456", 7);
+	ring.read(out, 4);
+	ring.write("abcd", 4);
+
+	// "3456abcd" wraps, and only the last five fit
+	ring.resize(5);
+
+	BOOST_CHECK_EQUAL(ring.capacity(), 5u);
+	BOOST_CHECK_EQUAL(readAll(ring), "6abcd");
+
+	ring.write("xy", 2);
+	ring.resize(16);
+
+	BOOST_CHECK_EQUAL(readAll(ring), "xy");
+}
+
+BOOST_AUTO_TEST_CASE(clear_empties_the_ring)
+{
+	ByteRing ring(4);
+
+	ring.write("abc", 3);
+	ring.clear();
+
+	BOOST_CHECK_EQUAL(ring.size(), 0u);
+
+	ring.write("defg", 4);
+
+	BOOST_CHECK_EQUAL(readAll(ring), "defg");
+}
+
+/*
+ * Random writes and reads of every size give the same bytes,
+ * and the same count of lost bytes, as a simple model
+ */
+BOOST_AUTO_TEST_CASE(matches_a_model)
+{
+	const size_t capacity = 37;
+	ByteRing ring(capacity);
+	std::deque<char> model;
+	size_t lost = 0;
+	char counter = 0;
+
+	srand(3);
+
+	for (int i = 0; i != 10000; ++i) {
+		if (rand() % 2) {
+			std::vector<char> bytes(rand() % (capacity * 2));
+
+			for (size_t j = 0; j != bytes.size(); ++j) {
+				bytes[j] = counter++;
+				model.push_back(bytes[j]);
+			}
+
+			ring.write(bytes.data(), bytes.size());
+
+			while (model.size() > capacity) {
+				model.pop_front();
+				++lost;
+			}
+		} else {
+			std::vector<char> out(rand() % capacity + 1);
+			size_t count = ring.read(out.data(), out.size());
+
+			BOOST_REQUIRE_EQUAL(count, std::min(out.size(), model.size()));
+
+			for (size_t j = 0; j != count; ++j) {
+				BOOST_REQUIRE_EQUAL(out[j], model.front());
+				model.pop_front();
+			}
+		}
+
+		BOOST_REQUIRE_EQUAL(ring.size(), model.size());
+		BOOST_REQUIRE_EQUAL(ring.overwritten(), lost);
+	}
+}
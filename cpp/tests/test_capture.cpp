@@ -0,0 +1,211 @@
+/*
+ * Unit tests of packet capture files, written and read back
+ */
+#define BOOST_TEST_MODULE capture
+#include <boost/test/included/unit_test.hpp>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "PacketCapture.h"
+
+/*
+ * A file name that is removed again at the end of a test
+ */
+struct TemporaryFile {
+	TemporaryFile()
+	{
+		char name[] = "/tmp/test_captureXXXXXX";
+		int fd = mkstemp(name);
+
+		::close(fd);
+		path = name;
+	}
+
+	~TemporaryFile()
+	{
+		unlink(path.c_str());
+	}
+
+	std::string path;
+};
+
+static CapturedPacket makePacket(const std::string &streamID, const std::vector<int16_t> &samples, uint8_t flags = 0)
+{
+	CapturedPacket packet;
+
+	memset(&packet.sri, 0, sizeof(packet.sri));
+	memset(&packet.time, 0, sizeof(packet.time));
+
+	packet.data = reinterpret_cast<const char *>(samples.data());
+	packet.flags = flags;
+	packet.size = samples.size() * sizeof(int16_t);
+	packet.streamID = streamID;
+	packet.type = captureDataType<int16_t>();
+
+	return packet;
+}
+
+BOOST_AUTO_TEST_CASE(packets_round_trip)
+{
+	TemporaryFile file;
+	CaptureWriter writer;
+	std::vector<int16_t> first(100);
+	std::vector<int16_t> second(3, -7);
+
+	for (size_t i = 0; i != first.size(); ++i) {
+		first[i] = i * 3;
+	}
+
+	BOOST_REQUIRE(writer.open(file.path, 0));
+
+	CapturedPacket packet = makePacket("stream_a", first, CAPTURE_QUEUE_FLUSHED);
+
+	packet.sri.xdelta = 0.5;
+	packet.sri.mode = 1;
+	packet.time.twsec = 12345;
+	packet.time.tcmode = 1;
+
+	BOOST_CHECK(writer.write(packet));
+
+	// The second record of the stream has an odd size, and its SRI
+	// isn't kept since it didn't change
+	packet = makePacket("stream_a", second, CAPTURE_EOS);
+	packet.sri.xdelta = 99;
+
+	BOOST_CHECK(writer.write(packet));
+	BOOST_CHECK_EQUAL(writer.bytesWritten() % 8, 0u);
+
+	writer.close();
+
+	CaptureReader reader;
+	CapturedPacket read;
+
+	BOOST_REQUIRE(reader.open(file.path));
+	BOOST_REQUIRE(reader.next(read));
+
+	BOOST_CHECK_EQUAL(read.streamID, "stream_a");
+	BOOST_CHECK_EQUAL(read.type, CAPTURE_SHORT);
+	BOOST_CHECK_EQUAL(read.flags, CAPTURE_QUEUE_FLUSHED | CAPTURE_HAS_SRI);
+	BOOST_CHECK_EQUAL(read.sri.xdelta, 0.5);
+	BOOST_CHECK_EQUAL(read.sri.mode, 1);
+	BOOST_CHECK_EQUAL(read.time.twsec, 12345);
+	BOOST_CHECK_EQUAL(read.time.tcmode, 1);
+	BOOST_CHECK_GE(read.arrival, 0.0);
+	BOOST_REQUIRE_EQUAL(read.size, first.size() * sizeof(int16_t));
+	BOOST_CHECK(memcmp(read.data, first.data(), read.size) == 0);
+
+	BOOST_REQUIRE(reader.next(read));
+
+	BOOST_CHECK_EQUAL(read.flags, CAPTURE_EOS);
+	BOOST_CHECK_EQUAL(read.sri.xdelta, 0);
+	BOOST_REQUIRE_EQUAL(read.size, second.size() * sizeof(int16_t));
+	BOOST_CHECK(memcmp(read.data, second.data(), read.size) == 0);
+
+	BOOST_CHECK(not reader.next(read));
+
+	// Rewinding starts again from the first record
+	reader.rewind();
+
+	BOOST_REQUIRE(reader.next(read));
+	BOOST_CHECK_EQUAL(read.size, first.size() * sizeof(int16_t));
+}
+
+BOOST_AUTO_TEST_CASE(sri_is_kept_for_each_new_stream_and_change)
+{
+	TemporaryFile file;
+	CaptureWriter writer;
+	std::vector<int16_t> samples(4);
+
+	BOOST_REQUIRE(writer.open(file.path, 0));
+
+	writer.write(makePacket("a", samples));
+	writer.write(makePacket("b", samples));
+	writer.write(makePacket("a", samples));
+	writer.write(makePacket("a", samples, CAPTURE_SRI_CHANGED | CAPTURE_HAS_SRI));
+	writer.close();
+
+	CaptureReader reader;
+	CapturedPacket read;
+	uint8_t expected[] = { CAPTURE_HAS_SRI, CAPTURE_HAS_SRI, 0, CAPTURE_SRI_CHANGED | CAPTURE_HAS_SRI };
+
+	BOOST_REQUIRE(reader.open(file.path));
+
+	for (size_t i = 0; i != sizeof(expected); ++i) {
+		BOOST_REQUIRE(reader.next(read));
+		BOOST_CHECK_EQUAL(read.flags, expected[i]);
+	}
+
+	BOOST_CHECK(not reader.next(read));
+}
+
+BOOST_AUTO_TEST_CASE(capture_stops_when_full)
+{
+	TemporaryFile file;
+	CaptureWriter writer;
+	std::vector<int16_t> samples(500);
+
+	BOOST_REQUIRE(writer.open(file.path, 2500));
+
+	BOOST_CHECK(writer.write(makePacket("s", samples)));
+	BOOST_CHECK(writer.write(makePacket("s", samples)));
+	BOOST_CHECK(not writer.write(makePacket("s", samples)));
+
+	// Even a packet that would still fit isn't written
+	BOOST_CHECK(not writer.write(makePacket("s", std::vector<int16_t>())));
+
+	writer.close();
+
+	CaptureReader reader;
+	CapturedPacket read;
+	size_t records = 0;
+
+	BOOST_REQUIRE(reader.open(file.path));
+
+	while (reader.next(read)) {
+		++records;
+	}
+
+	BOOST_CHECK_EQUAL(records, 2u);
+}
+
+BOOST_AUTO_TEST_CASE(damaged_and_foreign_files_are_rejected)
+{
+	TemporaryFile file;
+	CaptureWriter writer;
+	std::vector<int16_t> samples(10);
+
+	BOOST_REQUIRE(writer.open(file.path, 0));
+	writer.write(makePacket("s", samples));
+	writer.write(makePacket("s", samples));
+	writer.close();
+
+	// Cut the last record short
+	{
+		int fd = ::open(file.path.c_str(), O_RDWR);
+		off_t size = lseek(fd, 0, SEEK_END);
+
+		BOOST_REQUIRE_EQUAL(ftruncate(fd, size - 4), 0);
+		::close(fd);
+	}
+
+	CaptureReader reader;
+	CapturedPacket read;
+
+	BOOST_REQUIRE(reader.open(file.path));
+	BOOST_CHECK(reader.next(read));
+	BOOST_CHECK(not reader.next(read));
+
+	// Anything without the magic isn't a capture
+	{
+		int fd = ::open(file.path.c_str(), O_WRONLY);
+
+		BOOST_REQUIRE_EQUAL(pwrite(fd, "NOTACAP!", 8, 0), 8);
+		::close(fd);
+	}
+
+	BOOST_CHECK(not reader.open(file.path));
+	BOOST_CHECK(not reader.open(file.path + ".missing"));
+}
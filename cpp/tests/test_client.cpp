@@ -0,0 +1,155 @@
+/*
+ * Unit tests of client connections: connecting in the
+ * background, reconnecting, and sharing the I/O threads
+ */
+#define BOOST_TEST_MODULE client
+#include <boost/test/included/unit_test.hpp>
+
+#include <dirent.h>
+
+#include "BoostClient.h"
+
+// The ports the tests listen on, or leave closed
+#define TEST_PORT 47331
+#define TEST_CLOSED_PORT 47332
+
+static size_t threadCount()
+{
+	DIR *tasks = opendir("/proc/self/task");
+	size_t count = 0;
+
+	while (dirent *entry = readdir(tasks)) {
+		if (entry->d_name[0] != '.') {
+			++count;
+		}
+	}
+
+	closedir(tasks);
+	return count;
+}
+
+// Wait up to a few seconds for a client to connect
+static bool waitConnected(const boost::shared_ptr<client> &connection)
+{
+	for (int i = 0; i != 300 and not connection->is_connected(); ++i) {
+		boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+	}
+
+	return connection->is_connected();
+}
+
+BOOST_AUTO_TEST_CASE(clients_share_a_few_threads)
+{
+	std::vector<boost::shared_ptr<client> > clients;
+
+	// Start the pool, and the resolver thread asio starts on the
+	// first connect, before counting
+	clients.push_back(client::create(TEST_CLOSED_PORT, "127.0.0.1"));
+	clients.back()->connect(1.0);
+	boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+
+	size_t before = threadCount();
+
+	for (int i = 0; i != 200; ++i) {
+		clients.push_back(client::create(TEST_CLOSED_PORT, "127.0.0.1"));
+		clients.back()->connect(1.0);
+	}
+
+	BOOST_CHECK_EQUAL(threadCount(), before);
+
+	// Releasing clients that are still trying to connect is safe
+	clients.clear();
+	boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+}
+
+BOOST_AUTO_TEST_CASE(client_sends_once_connected)
+{
+	boost::asio::io_service io_service;
+	tcp::acceptor acceptor(io_service, tcp::endpoint(boost::asio::ip::address_v4::loopback(), TEST_PORT));
+	tcp::socket peer(io_service);
+	boost::shared_ptr<client> connection = client::create(TEST_PORT, "127.0.0.1");
+
+	BOOST_CHECK(not connection->connect_if_necessary());
+
+	connection->connect(1.0);
+	acceptor.accept(peer);
+
+	BOOST_REQUIRE(waitConnected(connection));
+
+	std::vector<char> data(10000, 'a');
+
+	connection->write(data);
+
+	std::vector<char> received(data.size());
+
+	boost::asio::read(peer, boost::asio::buffer(received));
+
+	BOOST_CHECK(received == data);
+}
+
+/*
+ * Once the last pointer to a client is released its socket is
+ * closed, even though it runs on a thread that lives on
+ */
+BOOST_AUTO_TEST_CASE(released_client_closes_its_socket)
+{
+	boost::asio::io_service io_service;
+	tcp::acceptor acceptor(io_service, tcp::endpoint(boost::asio::ip::address_v4::loopback(), TEST_PORT));
+	tcp::socket peer(io_service);
+	boost::shared_ptr<client> connection = client::create(TEST_PORT, "127.0.0.1");
+
+	connection->connect(1.0);
+	acceptor.accept(peer);
+
+	BOOST_REQUIRE(waitConnected(connection));
+
+	boost::shared_ptr<client> copy = connection;
+
+	connection.reset();
+	boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+
+	// A copy keeps it open
+	BOOST_CHECK(copy->is_connected());
+
+	copy.reset();
+
+	char byte;
+	boost::system::error_code error;
+
+	peer.read_some(boost::asio::buffer(&byte, 1), error);
+
+	BOOST_CHECK(error == boost::asio::error::eof);
+}
+
+BOOST_AUTO_TEST_CASE(client_reconnects_after_the_peer_goes_away)
+{
+	boost::asio::io_service io_service;
+	tcp::acceptor acceptor(io_service, tcp::endpoint(boost::asio::ip::address_v4::loopback(), TEST_PORT));
+	boost::shared_ptr<client> connection = client::create(TEST_PORT, "127.0.0.1");
+
+	{
+		tcp::socket peer(io_service);
+
+		connection->connect(1.0);
+		acceptor.accept(peer);
+
+		BOOST_REQUIRE(waitConnected(connection));
+	}
+
+	// Writing to the closed socket fails, and the client starts
+	// reconnecting in the background
+	std::vector<char> data(1000, 'b');
+
+	for (int i = 0; i != 300 and connection->is_connected(); ++i) {
+		connection->write(data);
+		boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+	}
+
+	BOOST_REQUIRE(not connection->is_connected());
+
+	tcp::socket peer(io_service);
+
+	acceptor.accept(peer);
+
+	BOOST_CHECK(waitConnected(connection));
+}
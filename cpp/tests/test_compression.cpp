@@ -0,0 +1,192 @@
+/*
+ * Unit tests of the compression frame format and of compressed
+ * connections in the data path
+ */
+#define BOOST_TEST_MODULE compression
+#include <boost/test/included/unit_test.hpp>
+
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SinkEngine.h"
+
+using boost::asio::ip::tcp;
+
+// The ports the tests listen on
+#define TEST_PORT_LZ4 47311
+#define TEST_PORT_ZSTD 47312
+
+static uint32_t headerField(const char *header, size_t offset)
+{
+	uint32_t value;
+
+	memcpy(&value, header + offset, 4);
+	return ntohl(value);
+}
+
+/*
+ * Read one frame from a socket, returning its codec and filling
+ * in its payload
+ */
+static int readFrame(tcp::socket &socket, uint32_t &rawSize, std::vector<char> &payload)
+{
+	char header[COMPRESSION_FRAME_HEADER_SIZE];
+
+	boost::asio::read(socket, boost::asio::buffer(header, sizeof(header)));
+
+	BOOST_REQUIRE(memcmp(header, "CSKF", 4) == 0);
+
+	rawSize = headerField(header, 8);
+	payload.resize(headerField(header, 12));
+
+	if (not payload.empty()) {
+		boost::asio::read(socket, boost::asio::buffer(payload));
+	}
+
+	return header[4];
+}
+
+BOOST_AUTO_TEST_CASE(parse_compression_type)
+{
+	CompressionType type;
+
+	BOOST_CHECK(parseCompressionType("", type) && type == COMPRESSION_NONE);
+	BOOST_CHECK(parseCompressionType("none", type) && type == COMPRESSION_NONE);
+	BOOST_CHECK(parseCompressionType("lz4", type) && type == COMPRESSION_LZ4);
+	BOOST_CHECK(parseCompressionType("zstd", type) && type == COMPRESSION_ZSTD);
+	BOOST_CHECK(not parseCompressionType("gzip", type));
+	BOOST_CHECK(compressionAvailable(COMPRESSION_NONE));
+}
+
+/*
+ * Data that doesn't shrink is stored as is, behind a header
+ * giving its size twice
+ */
+BOOST_AUTO_TEST_CASE(incompressible_data_is_stored)
+{
+	std::vector<char> data(1000);
+	DataBuffer frame;
+
+	srand(1);
+
+	for (size_t i = 0; i != data.size(); ++i) {
+		data[i] = rand();
+	}
+
+	compressFrame(COMPRESSION_LZ4, data.data(), data.size(), frame);
+
+	BOOST_REQUIRE_EQUAL(frame.size(), COMPRESSION_FRAME_HEADER_SIZE + data.size());
+	BOOST_CHECK(memcmp(frame.data(), "CSKF", 4) == 0);
+	BOOST_CHECK_EQUAL(frame[4], 0);
+	BOOST_CHECK_EQUAL(frame[5] | frame[6] | frame[7], 0);
+	BOOST_CHECK_EQUAL(headerField(frame.data(), 8), data.size());
+	BOOST_CHECK_EQUAL(headerField(frame.data(), 12), data.size());
+	BOOST_CHECK(memcmp(frame.data() + COMPRESSION_FRAME_HEADER_SIZE, data.data(), data.size()) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(compressible_data_shrinks)
+{
+	std::vector<char> data(64 * 1024, 'x');
+	DataBuffer frame;
+
+	for (int type = COMPRESSION_LZ4; type <= COMPRESSION_ZSTD; ++type) {
+		if (not compressionAvailable(CompressionType(type))) {
+			continue;
+		}
+
+		compressFrame(CompressionType(type), data.data(), data.size(), frame);
+
+		BOOST_CHECK_EQUAL(frame[4], type);
+		BOOST_CHECK_EQUAL(headerField(frame.data(), 8), data.size());
+		BOOST_CHECK_EQUAL(headerField(frame.data(), 12), frame.size() - COMPRESSION_FRAME_HEADER_SIZE);
+		BOOST_CHECK(frame.size() < data.size() / 10);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(empty_data_makes_an_empty_frame)
+{
+	DataBuffer frame;
+
+	compressFrame(COMPRESSION_ZSTD, NULL, 0, frame);
+
+	BOOST_REQUIRE_EQUAL(frame.size(), COMPRESSION_FRAME_HEADER_SIZE);
+	BOOST_CHECK_EQUAL(headerField(frame.data(), 8), 0u);
+	BOOST_CHECK_EQUAL(headerField(frame.data(), 12), 0u);
+}
+
+/*
+ * Two connections that transform the samples the same way but
+ * compress them differently share the transformed data.  Each
+ * one must still compress the whole packet
+ */
+BOOST_AUTO_TEST_CASE(streams_sharing_a_transform_each_get_the_data)
+{
+	if (not compressionAvailable(COMPRESSION_LZ4) or not compressionAvailable(COMPRESSION_ZSTD)) {
+		BOOST_TEST_MESSAGE("lz4 and zstd are both needed, skipping");
+		return;
+	}
+
+	SinkEngine engine;
+	std::vector<ConnectionConfig> requested(2);
+	std::vector<ConnectionConfig> applied;
+	std::vector<ConnectionStatus> statuses;
+
+	requested[0].ports[0] = TEST_PORT_LZ4;
+	requested[0].byte_swap[0] = 2;
+	requested[0].compression = "lz4";
+	requested[1].ports[0] = TEST_PORT_ZSTD;
+	requested[1].byte_swap[0] = 2;
+	requested[1].compression = "zstd";
+
+	engine.configure(requested, applied, statuses);
+
+	BOOST_REQUIRE_EQUAL(applied.size(), 2u);
+
+	boost::asio::io_service io_service;
+	tcp::socket lz4(io_service);
+	tcp::socket zstd(io_service);
+
+	lz4.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), TEST_PORT_LZ4));
+	zstd.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), TEST_PORT_ZSTD));
+
+	// Give the server time to accept both sessions
+	boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+
+	// Random samples don't compress, so the frames carry them as is
+	std::vector<uint16_t> samples(4096);
+
+	srand(2);
+
+	for (size_t i = 0; i != samples.size(); ++i) {
+		samples[i] = rand();
+	}
+
+	engine.write(samples, statuses);
+
+	BOOST_REQUIRE_EQUAL(statuses.size(), 2u);
+	BOOST_CHECK_EQUAL(statuses[0].status, "connected");
+	BOOST_CHECK_EQUAL(statuses[1].status, "connected");
+
+	while (engine.framesPending()) {
+		engine.flush(statuses);
+	}
+
+	tcp::socket *sockets[] = { &lz4, &zstd };
+
+	for (size_t i = 0; i != 2; ++i) {
+		uint32_t rawSize = 0;
+		std::vector<char> payload;
+
+		BOOST_CHECK_EQUAL(readFrame(*sockets[i], rawSize, payload), 0);
+		BOOST_REQUIRE_EQUAL(rawSize, samples.size() * sizeof(uint16_t));
+		BOOST_REQUIRE_EQUAL(payload.size(), rawSize);
+
+		for (size_t j = 0; j != samples.size(); ++j) {
+			uint16_t swapped = (samples[j] >> 8) | (samples[j] << 8);
+
+			BOOST_REQUIRE_EQUAL(memcmp(&payload[j * 2], &swapped, 2), 0);
+		}
+	}
+}
@@ -0,0 +1,194 @@
+/*
+ * Unit tests of the memory budget shared by the send queues
+ */
+#define BOOST_TEST_MODULE memorybudget
+#include <boost/test/included/unit_test.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "SendQueue.h"
+#include "SinkEngine.h"
+
+static SharedBuffer makeBuffer(size_t size)
+{
+	return makeSharedBuffer(std::vector<char>(size, 'x'));
+}
+
+static void releaseLater(MemoryBudget *budget, size_t bytes)
+{
+	boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+	budget->release(bytes);
+}
+
+BOOST_AUTO_TEST_CASE(usage_and_limit)
+{
+	MemoryBudget budget;
+
+	budget.add(100);
+	budget.add(50);
+	budget.release(120);
+
+	BOOST_CHECK_EQUAL(budget.used(), 30u);
+	BOOST_CHECK_EQUAL(budget.highWater(), 150u);
+
+	// No limit is never exceeded
+	BOOST_CHECK(not budget.exceeded());
+
+	budget.setLimit(20);
+
+	BOOST_CHECK(budget.exceeded());
+	BOOST_CHECK(not budget.waitWithinLimit(0.01));
+
+	budget.setLimit(30);
+
+	BOOST_CHECK(not budget.exceeded());
+	BOOST_CHECK(budget.waitWithinLimit(0));
+}
+
+BOOST_AUTO_TEST_CASE(waiter_wakes_when_the_queues_drain)
+{
+	MemoryBudget budget;
+
+	budget.add(1000);
+
+	boost::thread releaser(boost::bind(&releaseLater, &budget, 600));
+
+	BOOST_CHECK(budget.waitUntilAtMost(400, 5.0));
+	BOOST_CHECK_EQUAL(budget.used(), 400u);
+
+	releaser.join();
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_adds_and_releases_balance)
+{
+	MemoryBudget budget;
+	boost::thread_group threads;
+
+	for (int i = 0; i != 4; ++i) {
+		threads.create_thread(boost::bind(&MemoryBudget::add, &budget, 10));
+	}
+
+	threads.join_all();
+
+	for (int i = 0; i != 4; ++i) {
+		threads.create_thread(boost::bind(&MemoryBudget::release, &budget, 10));
+	}
+
+	threads.join_all();
+
+	BOOST_CHECK_EQUAL(budget.used(), 0u);
+	BOOST_CHECK_EQUAL(budget.highWater(), 40u);
+}
+
+/*
+ * A buffer sent to several sockets is counted once, until the
+ * last queue holding it writes or drops it
+ */
+BOOST_AUTO_TEST_CASE(shared_buffers_are_charged_once)
+{
+	boost::shared_ptr<MemoryBudget> budget(new MemoryBudget);
+	SendQueue first;
+	SendQueue second;
+	SharedBuffer buffer = makeBuffer(1000);
+	std::vector<boost::asio::const_buffer> chunks;
+	double delay = 0;
+
+	first.setBudget(budget);
+	second.setBudget(budget);
+
+	first.push(buffer);
+	second.push(buffer);
+
+	BOOST_CHECK_EQUAL(budget->used(), 1000u);
+
+	// Writing part of it releases nothing
+	first.next(chunks, delay);
+	first.consume(400);
+
+	BOOST_CHECK_EQUAL(budget->used(), 1000u);
+
+	first.next(chunks, delay);
+	first.consume(600);
+
+	BOOST_CHECK_EQUAL(budget->used(), 1000u);
+
+	second.clear();
+
+	BOOST_CHECK_EQUAL(budget->used(), 0u);
+	BOOST_CHECK_EQUAL(budget->highWater(), 1000u);
+}
+
+BOOST_AUTO_TEST_CASE(shedding_releases_what_no_other_queue_holds)
+{
+	boost::shared_ptr<MemoryBudget> budget(new MemoryBudget);
+	SendQueue first;
+	SendQueue second;
+	SharedBuffer shared = makeBuffer(100);
+	SharedBuffer own = makeBuffer(30);
+
+	first.setBudget(budget);
+	second.setBudget(budget);
+
+	first.push(shared);
+	first.push(own);
+	second.push(shared);
+
+	BOOST_CHECK_EQUAL(budget->used(), 130u);
+
+	// The front buffer is kept for the write that is due
+	BOOST_CHECK_EQUAL(first.shed(), 30u);
+	BOOST_CHECK_EQUAL(budget->used(), 100u);
+
+	first.clear();
+	BOOST_CHECK_EQUAL(budget->used(), 100u);
+
+	second.clear();
+	BOOST_CHECK_EQUAL(budget->used(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(queues_move_to_a_new_budget)
+{
+	boost::shared_ptr<MemoryBudget> before(new MemoryBudget);
+	boost::shared_ptr<MemoryBudget> after(new MemoryBudget);
+
+	{
+		SendQueue queue;
+
+		queue.setBudget(before);
+		queue.push(makeBuffer(10));
+		queue.push(makeBuffer(20));
+
+		BOOST_CHECK_EQUAL(before->used(), 30u);
+
+		queue.setBudget(after);
+
+		BOOST_CHECK_EQUAL(before->used(), 0u);
+		BOOST_CHECK_EQUAL(after->used(), 30u);
+	}
+
+	// Destroying the queue releases what it held
+	BOOST_CHECK_EQUAL(after->used(), 0u);
+}
+
+/*
+ * In lossless mode a batch stops taking packets once it would
+ * carry the queued data past the high watermark
+ */
+BOOST_AUTO_TEST_CASE(batches_stop_at_the_high_watermark)
+{
+	SinkEngine engine;
+
+	BOOST_CHECK(engine.roomForBatch(1000000));
+
+	engine.setFlowControl(true, 1000, 500);
+
+	BOOST_CHECK(engine.roomForBatch(1000));
+	BOOST_CHECK(not engine.roomForBatch(1001));
+	BOOST_CHECK(engine.readyForPacket(0));
+	BOOST_CHECK(not engine.throttled());
+
+	engine.setFlowControl(false, 1000, 500);
+
+	BOOST_CHECK(engine.roomForBatch(1001));
+}
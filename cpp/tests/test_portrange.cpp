@@ -0,0 +1,165 @@
+/*
+ * Unit tests of port range parsing and of how the requested
+ * connections are cleaned up and combined
+ */
+#define BOOST_TEST_MODULE portrange
+#include <boost/test/included/unit_test.hpp>
+
+#include "SinkEngine.h"
+#include "portrange.h"
+
+// Ports nothing listens on, for client connections that never
+// connect
+#define TEST_FIRST_PORT 47401
+
+static std::vector<unsigned short> parse(const std::string &ranges, bool expectValid = true)
+{
+	std::vector<unsigned short> ports;
+
+	BOOST_CHECK_EQUAL(parsePortRanges(ranges, ports), expectValid);
+	return ports;
+}
+
+static ConnectionConfig clientConfig(unsigned short port)
+{
+	ConnectionConfig config;
+
+	config.connection_type = "client";
+	config.ip_address = "127.0.0.1";
+	config.ports[0] = port;
+	return config;
+}
+
+BOOST_AUTO_TEST_CASE(single_ports_and_ranges)
+{
+	std::vector<unsigned short> ports = parse("40000-40003, 41500,7");
+
+	BOOST_REQUIRE_EQUAL(ports.size(), 6u);
+	BOOST_CHECK_EQUAL(ports[0], 40000);
+	BOOST_CHECK_EQUAL(ports[3], 40003);
+	BOOST_CHECK_EQUAL(ports[4], 41500);
+	BOOST_CHECK_EQUAL(ports[5], 7);
+}
+
+BOOST_AUTO_TEST_CASE(spaces_and_empty_entries_are_allowed)
+{
+	BOOST_CHECK(parse("").empty());
+	BOOST_CHECK(parse(" , ,").empty());
+	BOOST_CHECK_EQUAL(parse(" 10 - 12 ,").size(), 3u);
+	BOOST_CHECK_EQUAL(parse("65535-65535").size(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(invalid_entries_are_skipped)
+{
+	// The valid entries are still returned
+	std::vector<unsigned short> ports = parse("0, 5-3, 70000, 1-65536, abc, 8x, 9-, 100", false);
+
+	BOOST_REQUIRE_EQUAL(ports.size(), 1u);
+	BOOST_CHECK_EQUAL(ports[0], 100);
+
+	parse("-5", false);
+	parse("3-", false);
+}
+
+/*
+ * Ranges are appended to the port list, and ports without a
+ * byte swap of their own take the last one given
+ */
+BOOST_AUTO_TEST_CASE(normalize_expands_ranges)
+{
+	SinkEngine engine;
+	std::vector<ConnectionConfig> requested(1, clientConfig(TEST_FIRST_PORT));
+	std::vector<ConnectionConfig> applied;
+	std::vector<ConnectionStatus> statuses;
+
+	requested[0].byte_swap[0] = 4;
+	requested[0].port_ranges = "47410-47412";
+
+	engine.configure(requested, applied, statuses);
+
+	BOOST_REQUIRE_EQUAL(applied.size(), 1u);
+	BOOST_CHECK_EQUAL(applied[0].port_ranges, "");
+	BOOST_REQUIRE_EQUAL(applied[0].ports.size(), 4u);
+	BOOST_REQUIRE_EQUAL(applied[0].byte_swap.size(), 4u);
+	BOOST_CHECK_EQUAL(applied[0].ports[3], 47412);
+	BOOST_CHECK_EQUAL(applied[0].byte_swap[3], 4);
+	BOOST_CHECK_EQUAL(statuses.size(), 4u);
+}
+
+/*
+ * Entries that only differ in their ports are combined, sorted
+ * by port, and a port named twice keeps its first byte swap
+ */
+BOOST_AUTO_TEST_CASE(normalize_combines_entries)
+{
+	SinkEngine engine;
+	std::vector<ConnectionConfig> requested;
+	std::vector<ConnectionConfig> applied;
+	std::vector<ConnectionStatus> statuses;
+
+	requested.push_back(clientConfig(TEST_FIRST_PORT + 2));
+	requested.push_back(clientConfig(TEST_FIRST_PORT));
+	requested.push_back(clientConfig(TEST_FIRST_PORT + 2));
+	requested.back().byte_swap[0] = 2;
+	requested.push_back(clientConfig(TEST_FIRST_PORT + 1));
+	requested.back().rate_limit = 1000;
+
+	engine.configure(requested, applied, statuses);
+
+	BOOST_REQUIRE_EQUAL(applied.size(), 2u);
+	BOOST_REQUIRE_EQUAL(applied[0].ports.size(), 2u);
+	BOOST_CHECK_EQUAL(applied[0].ports[0], TEST_FIRST_PORT);
+	BOOST_CHECK_EQUAL(applied[0].ports[1], TEST_FIRST_PORT + 2);
+	BOOST_CHECK_EQUAL(applied[0].byte_swap[1], 0);
+	BOOST_CHECK_EQUAL(applied[1].ports.size(), 1u);
+	BOOST_CHECK_EQUAL(applied[1].rate_limit, 1000);
+}
+
+BOOST_AUTO_TEST_CASE(normalize_falls_back_to_defaults)
+{
+	SinkEngine engine;
+	std::vector<ConnectionConfig> requested(1, clientConfig(TEST_FIRST_PORT));
+	std::vector<ConnectionConfig> applied;
+	std::vector<ConnectionStatus> statuses;
+
+	requested[0].ports.push_back(TEST_FIRST_PORT + 1);
+	requested[0].port_ranges = "bogus";
+	requested[0].output_format = "int12";
+	requested[0].compression = "gzip";
+	requested[0].distribution = "random";
+	requested[0].inbound_mode = "keep";
+	requested[0].slow_consumer_action = "ignore";
+	requested[0].burst_size = 0;
+
+	engine.configure(requested, applied, statuses);
+
+	BOOST_REQUIRE_EQUAL(applied.size(), 1u);
+	BOOST_CHECK_EQUAL(applied[0].ports.size(), 2u);
+	BOOST_CHECK_EQUAL(applied[0].byte_swap.size(), 2u);
+	BOOST_CHECK_EQUAL(applied[0].output_format, "native");
+	BOOST_CHECK_EQUAL(applied[0].compression, "none");
+	BOOST_CHECK_EQUAL(applied[0].distribution, "copy");
+	BOOST_CHECK_EQUAL(applied[0].inbound_mode, "buffer");
+	BOOST_CHECK_EQUAL(applied[0].slow_consumer_action, "disconnect");
+	BOOST_CHECK_EQUAL(applied[0].burst_size, 65536u);
+}
+
+BOOST_AUTO_TEST_CASE(striped_ports_share_a_byte_swap)
+{
+	SinkEngine engine;
+	std::vector<ConnectionConfig> requested(1, clientConfig(TEST_FIRST_PORT));
+	std::vector<ConnectionConfig> applied;
+	std::vector<ConnectionStatus> statuses;
+
+	requested[0].ports.push_back(TEST_FIRST_PORT + 1);
+	requested[0].byte_swap.clear();
+	requested[0].byte_swap.push_back(2);
+	requested[0].byte_swap.push_back(4);
+	requested[0].distribution = "round_robin";
+
+	engine.configure(requested, applied, statuses);
+
+	BOOST_REQUIRE_EQUAL(applied.size(), 1u);
+	BOOST_CHECK_EQUAL(applied[0].byte_swap[0], 2);
+	BOOST_CHECK_EQUAL(applied[0].byte_swap[1], 2);
+}
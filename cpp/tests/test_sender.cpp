@@ -0,0 +1,85 @@
+/*
+ * Unit tests of the sender threads: every packet reaches every
+ * connection once and in order, while the writing thread waits
+ * on full rings and moves to new connection sets
+ */
+#define BOOST_TEST_MODULE sender
+#include <boost/test/included/unit_test.hpp>
+
+#include "ConnectionSender.h"
+#include "SinkEngine.h"
+
+using boost::asio::ip::tcp;
+
+// The ports the tests listen on
+#define TEST_FIRST_PORT 47351
+
+static ConnectionConfig serverConfig(unsigned short port)
+{
+	ConnectionConfig config;
+
+	config.ports[0] = port;
+	return config;
+}
+
+BOOST_AUTO_TEST_CASE(packets_survive_new_connection_sets)
+{
+	SinkEngine engine;
+	std::vector<ConnectionConfig> requested;
+	std::vector<ConnectionConfig> applied;
+	std::vector<ConnectionStatus> statuses;
+
+	// Settings that keep the two servers apart, so each sender
+	// writes one of them
+	requested.push_back(serverConfig(TEST_FIRST_PORT));
+	requested.push_back(serverConfig(TEST_FIRST_PORT + 1));
+	requested.back().read_chunk_size = 4096;
+
+	engine.configure(requested, applied, statuses);
+	BOOST_REQUIRE_EQUAL(applied.size(), 2u);
+
+	// A one packet ring keeps the writing thread waiting for room
+	engine.setSenders(2, 1, 0, "");
+	BOOST_REQUIRE(engine.applySenders());
+
+	boost::asio::io_service io_service;
+	tcp::socket first(io_service);
+	tcp::socket second(io_service);
+
+	first.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), TEST_FIRST_PORT));
+	second.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), TEST_FIRST_PORT + 1));
+
+	// Give the servers time to accept both sessions
+	boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+
+	const size_t packets = 50;
+	const size_t samples = 1000;
+
+	for (size_t i = 0; i != packets; ++i) {
+		std::vector<short> data(samples);
+
+		for (size_t j = 0; j != samples; ++j) {
+			data[j] = i * samples + j;
+		}
+
+		engine.write(data, statuses);
+
+		// Every few packets a new set shares the same connections
+		if (i % 7 == 3) {
+			engine.configure(requested, applied, statuses);
+		}
+	}
+
+	std::vector<short> expected(packets * samples);
+	std::vector<short> received(expected.size());
+
+	for (size_t i = 0; i != expected.size(); ++i) {
+		expected[i] = i;
+	}
+
+	boost::asio::read(first, boost::asio::buffer(received));
+	BOOST_CHECK(received == expected);
+
+	boost::asio::read(second, boost::asio::buffer(received));
+	BOOST_CHECK(received == expected);
+}
@@ -0,0 +1,208 @@
+/*
+ * Unit tests of the send queue of a socket: gathering buffers
+ * into one write, holding small writes back to coalesce them,
+ * and shedding
+ */
+#define BOOST_TEST_MODULE sendqueue
+#include <boost/test/included/unit_test.hpp>
+
+#include <boost/thread/thread.hpp>
+
+#include "SendQueue.h"
+
+static SharedBuffer makeBuffer(size_t size, char fill = 'x')
+{
+	return makeSharedBuffer(std::vector<char>(size, fill));
+}
+
+static size_t chunkBytes(const std::vector<boost::asio::const_buffer> &chunks)
+{
+	size_t bytes = 0;
+
+	for (size_t i = 0; i != chunks.size(); ++i) {
+		bytes += boost::asio::buffer_size(chunks[i]);
+	}
+
+	return bytes;
+}
+
+BOOST_AUTO_TEST_CASE(buffers_are_gathered_into_one_write)
+{
+	SendQueue queue;
+	std::vector<boost::asio::const_buffer> chunks;
+	double delay = -1;
+
+	// Only the first push starts a write
+	BOOST_CHECK(queue.push(makeBuffer(10, 'a')));
+	BOOST_CHECK(not queue.push(makeBuffer(20, 'b')));
+	BOOST_CHECK(not queue.push(makeBuffer(0)));
+	BOOST_CHECK_EQUAL(queue.queuedBytes(), 30u);
+
+	BOOST_REQUIRE(queue.next(chunks, delay));
+	BOOST_CHECK_EQUAL(delay, 0);
+	BOOST_REQUIRE_EQUAL(chunks.size(), 2u);
+	BOOST_CHECK_EQUAL(chunkBytes(chunks), 30u);
+
+	// A short write picks up where it left off
+	BOOST_CHECK(queue.consume(15));
+	BOOST_REQUIRE(queue.next(chunks, delay));
+	BOOST_REQUIRE_EQUAL(chunks.size(), 1u);
+	BOOST_CHECK_EQUAL(chunkBytes(chunks), 15u);
+	BOOST_CHECK_EQUAL(*boost::asio::buffer_cast<const char *>(chunks[0]), 'b');
+
+	BOOST_CHECK(not queue.consume(15));
+	BOOST_CHECK(not queue.next(chunks, delay));
+	BOOST_CHECK_EQUAL(queue.drainedBytes(), 30);
+}
+
+BOOST_AUTO_TEST_CASE(gather_is_limited)
+{
+	SendQueue queue;
+	std::vector<boost::asio::const_buffer> chunks;
+	double delay;
+
+	for (int i = 0; i != SEND_MAX_GATHER + 10; ++i) {
+		queue.push(makeBuffer(1));
+	}
+
+	BOOST_REQUIRE(queue.next(chunks, delay));
+	BOOST_CHECK_EQUAL(chunks.size(), size_t(SEND_MAX_GATHER));
+}
+
+BOOST_AUTO_TEST_CASE(small_writes_are_held_back)
+{
+	SendQueue queue;
+	std::vector<boost::asio::const_buffer> chunks;
+	double delay;
+
+	queue.setCoalescing(100, 10.0);
+
+	BOOST_CHECK(queue.push(makeBuffer(40)));
+	BOOST_REQUIRE(queue.next(chunks, delay));
+
+	// Nothing is written yet, the caller waits out the delay
+	BOOST_CHECK(chunks.empty());
+	BOOST_CHECK_GT(delay, 9.0);
+	BOOST_CHECK(queue.holding());
+
+	BOOST_CHECK(not queue.push(makeBuffer(40)));
+
+	// Once enough is queued the caller is told to write at once
+	BOOST_CHECK(queue.push(makeBuffer(40)));
+	BOOST_CHECK(not queue.holding());
+
+	BOOST_REQUIRE(queue.next(chunks, delay));
+	BOOST_CHECK_EQUAL(delay, 0);
+	BOOST_CHECK_EQUAL(chunkBytes(chunks), 120u);
+}
+
+BOOST_AUTO_TEST_CASE(held_writes_go_out_after_the_delay)
+{
+	SendQueue queue;
+	std::vector<boost::asio::const_buffer> chunks;
+	double delay;
+
+	queue.setCoalescing(1000, 0.02);
+	queue.push(makeBuffer(10));
+
+	BOOST_REQUIRE(queue.next(chunks, delay));
+	BOOST_CHECK(chunks.empty());
+	BOOST_CHECK_GT(delay, 0);
+
+	boost::this_thread::sleep(boost::posix_time::milliseconds(30));
+
+	BOOST_REQUIRE(queue.next(chunks, delay));
+	BOOST_CHECK_EQUAL(delay, 0);
+	BOOST_CHECK_EQUAL(chunkBytes(chunks), 10u);
+	BOOST_CHECK(not queue.holding());
+}
+
+/*
+ * Shedding keeps what a write is using, so the socket never
+ * sees a partial buffer, and drops the rest
+ */
+BOOST_AUTO_TEST_CASE(shedding_keeps_the_buffers_being_written)
+{
+	SendQueue queue;
+	std::vector<boost::asio::const_buffer> chunks;
+	double delay;
+
+	queue.push(makeBuffer(10));
+	queue.push(makeBuffer(20));
+
+	BOOST_REQUIRE(queue.next(chunks, delay));
+
+	queue.push(makeBuffer(30));
+	queue.push(makeBuffer(40));
+
+	BOOST_CHECK_EQUAL(queue.shed(), 70u);
+	BOOST_CHECK_EQUAL(queue.queuedBytes(), 30u);
+
+	// The write finishes, and nothing is left
+	BOOST_CHECK(not queue.consume(30));
+	BOOST_CHECK_EQUAL(queue.queuedBytes(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(shedding_a_partly_written_buffer)
+{
+	SendQueue queue;
+	std::vector<boost::asio::const_buffer> chunks;
+	double delay;
+
+	queue.push(makeBuffer(100));
+	queue.push(makeBuffer(50));
+
+	queue.next(chunks, delay);
+	queue.consume(60);
+
+	// Between writes the front buffer is kept, with the 40 bytes
+	// of it still to go
+	BOOST_CHECK_EQUAL(queue.shed(), 50u);
+	BOOST_CHECK_EQUAL(queue.queuedBytes(), 40u);
+
+	BOOST_REQUIRE(queue.next(chunks, delay));
+	BOOST_CHECK_EQUAL(chunkBytes(chunks), 40u);
+}
+
+BOOST_AUTO_TEST_CASE(shedding_while_held_keeps_the_front)
+{
+	SendQueue queue;
+	std::vector<boost::asio::const_buffer> chunks;
+	double delay;
+
+	queue.setCoalescing(1000, 10.0);
+	queue.push(makeBuffer(10));
+	queue.push(makeBuffer(20));
+	queue.next(chunks, delay);
+
+	BOOST_CHECK(queue.holding());
+	BOOST_CHECK_EQUAL(queue.shed(), 20u);
+	BOOST_CHECK_EQUAL(queue.queuedBytes(), 10u);
+
+	queue.clear();
+
+	BOOST_CHECK_EQUAL(queue.queuedBytes(), 0u);
+	BOOST_CHECK(not queue.holding());
+	BOOST_CHECK(queue.push(makeBuffer(5)));
+}
+
+BOOST_AUTO_TEST_CASE(rate_limit_paces_the_writes)
+{
+	SendQueue queue;
+	std::vector<boost::asio::const_buffer> chunks;
+	double delay;
+
+	queue.setRateLimit(1000, 100);
+	queue.push(makeBuffer(250));
+
+	// Writes are no larger than the burst
+	BOOST_REQUIRE(queue.next(chunks, delay));
+	BOOST_CHECK_EQUAL(delay, 0);
+	BOOST_CHECK_EQUAL(chunkBytes(chunks), 100u);
+
+	queue.consume(100);
+
+	BOOST_REQUIRE(queue.next(chunks, delay));
+	BOOST_CHECK_GT(delay, 0.05);
+	BOOST_CHECK_LE(delay, 0.1);
+}
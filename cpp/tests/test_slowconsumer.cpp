@@ -0,0 +1,125 @@
+/*
+ * Unit tests of how a server treats sessions that fall behind:
+ * dropping their backlog until they catch up, or disconnecting
+ * them, whether or not anything is being written
+ */
+#define BOOST_TEST_MODULE slowconsumer
+#include <boost/test/included/unit_test.hpp>
+
+#include "BoostServer.h"
+
+// The ports the tests listen on
+#define TEST_PORT_DROP 47341
+#define TEST_PORT_DISCONNECT 47342
+
+// Slow consumers are those more than this many seconds behind
+#define TEST_MAX_LAG 0.05
+
+static SharedBuffer makeBuffer(size_t size)
+{
+	return makeSharedBuffer(std::vector<char>(size, 'x'));
+}
+
+static void sleepFor(double seconds)
+{
+	boost::this_thread::sleep(boost::posix_time::microseconds(long(seconds * 1e6)));
+}
+
+/*
+ * Connect a peer to a server whose sessions write 10 bytes a
+ * second, so anything queued beyond the first burst falls
+ * behind
+ */
+struct SlowSession {
+	SlowSession(unsigned short port, bool drop) :
+		listener(port),
+		peer(io_service)
+	{
+		listener.setRateLimit(10, 10);
+		listener.setSlowConsumerLimit(TEST_MAX_LAG, 0, drop);
+
+		peer.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), port));
+
+		// Give the server time to accept the session
+		sleepFor(0.2);
+		BOOST_REQUIRE(listener.is_connected());
+	}
+
+	boost::asio::io_service io_service;
+	server listener;
+	tcp::socket peer;
+};
+
+/*
+ * A session is measured from the oldest data that isn't being
+ * written, so once its backlog is dropped it isn't shed again
+ * and again for the write still in progress, and once it has
+ * caught up it gets everything again
+ */
+BOOST_AUTO_TEST_CASE(dropped_sessions_recover)
+{
+	SlowSession slow(TEST_PORT_DROP, true);
+	double checks = TEST_MAX_LAG + SLOW_CONSUMER_CHECK_INTERVAL * 2;
+	size_t dropped = 0;
+
+	// The first 10 bytes go out at once, the rest waits for the
+	// rate limit.  That can't be dropped, so it isn't behind
+	slow.listener.write(makeBuffer(100));
+	sleepFor(checks);
+
+	BOOST_CHECK_EQUAL(slow.listener.takeSlowConsumers(dropped), 0u);
+
+	slow.listener.write(makeBuffer(10));
+	sleepFor(checks);
+
+	BOOST_CHECK_EQUAL(slow.listener.takeSlowConsumers(dropped), 1u);
+	BOOST_CHECK_EQUAL(dropped, 10u);
+
+	// Only the waiting data is left, so nothing more is dropped
+	sleepFor(checks);
+
+	BOOST_CHECK_EQUAL(slow.listener.takeSlowConsumers(dropped), 0u);
+	BOOST_CHECK_EQUAL(dropped, 0u);
+	BOOST_CHECK_EQUAL(slow.listener.queuedBytes(), 90u);
+
+	// New data is kept until it is too old
+	slow.listener.write(makeBuffer(10));
+
+	BOOST_CHECK_EQUAL(slow.listener.queuedBytes(), 100u);
+
+	// The session caught up in between, so this counts again
+	sleepFor(checks);
+
+	BOOST_CHECK_EQUAL(slow.listener.takeSlowConsumers(dropped), 1u);
+	BOOST_CHECK_EQUAL(dropped, 10u);
+}
+
+/*
+ * A session that falls behind while nothing more is written is
+ * still found
+ */
+BOOST_AUTO_TEST_CASE(idle_sessions_are_checked)
+{
+	SlowSession slow(TEST_PORT_DISCONNECT, false);
+	size_t dropped = 0;
+
+	slow.listener.write(makeBuffer(100));
+	slow.listener.write(makeBuffer(10));
+
+	sleepFor(TEST_MAX_LAG * 2 + SLOW_CONSUMER_CHECK_INTERVAL * 2);
+
+	BOOST_CHECK_EQUAL(slow.listener.takeSlowConsumers(dropped), 1u);
+	BOOST_CHECK(not slow.listener.is_connected());
+
+	// The peer is disconnected
+	char bytes[200];
+	boost::system::error_code error;
+	size_t received = 0;
+
+	while (not error) {
+		received += slow.peer.read_some(boost::asio::buffer(bytes), error);
+	}
+
+	BOOST_CHECK(error == boost::asio::error::eof || error == boost::asio::error::connection_reset);
+	BOOST_CHECK_LT(received, 110u);
+}
@@ -0,0 +1,113 @@
+/*
+ * Unit tests of the lock-free ring that hands packets to the
+ * sender threads
+ */
+#define BOOST_TEST_MODULE spscring
+#include <boost/test/included/unit_test.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "spscring.h"
+
+BOOST_AUTO_TEST_CASE(capacity_is_rounded_up_to_a_power_of_two)
+{
+	BOOST_CHECK_EQUAL(SpscRing<int>(1).capacity(), 1u);
+	BOOST_CHECK_EQUAL(SpscRing<int>(3).capacity(), 4u);
+	BOOST_CHECK_EQUAL(SpscRing<int>(256).capacity(), 256u);
+	BOOST_CHECK_EQUAL(SpscRing<int>(257).capacity(), 512u);
+}
+
+BOOST_AUTO_TEST_CASE(values_come_out_in_order)
+{
+	SpscRing<int> ring(4);
+	int value = 0;
+
+	BOOST_CHECK(ring.empty());
+	BOOST_CHECK(not ring.pop(value));
+
+	// Go round the ring a few times
+	for (int i = 0; i != 10; ++i) {
+		BOOST_CHECK(ring.push(i * 2));
+		BOOST_CHECK(ring.push(i * 2 + 1));
+		BOOST_CHECK(not ring.empty());
+
+		BOOST_REQUIRE(ring.pop(value));
+		BOOST_CHECK_EQUAL(value, i * 2);
+		BOOST_REQUIRE(ring.pop(value));
+		BOOST_CHECK_EQUAL(value, i * 2 + 1);
+		BOOST_CHECK(ring.empty());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(full_ring_refuses_more)
+{
+	SpscRing<int> ring(2);
+	int value = 0;
+
+	BOOST_CHECK(ring.push(1));
+	BOOST_CHECK(ring.push(2));
+	BOOST_CHECK(not ring.push(3));
+
+	BOOST_REQUIRE(ring.pop(value));
+	BOOST_CHECK_EQUAL(value, 1);
+
+	BOOST_CHECK(ring.push(3));
+	BOOST_REQUIRE(ring.pop(value));
+	BOOST_CHECK_EQUAL(value, 2);
+	BOOST_REQUIRE(ring.pop(value));
+	BOOST_CHECK_EQUAL(value, 3);
+}
+
+BOOST_AUTO_TEST_CASE(popped_slots_let_go_of_their_value)
+{
+	SpscRing<boost::shared_ptr<int> > ring(2);
+	boost::shared_ptr<int> value(new int(7));
+	boost::shared_ptr<int> popped;
+
+	ring.push(value);
+
+	BOOST_CHECK_EQUAL(value.use_count(), 2);
+
+	ring.pop(popped);
+	popped.reset();
+
+	BOOST_CHECK(value.unique());
+}
+
+static void produce(SpscRing<size_t> *ring, size_t count)
+{
+	for (size_t i = 0; i != count; ++i) {
+		while (not ring->push(i)) {
+			boost::this_thread::yield();
+		}
+	}
+}
+
+/*
+ * A consumer on another thread sees every value once, in the
+ * order it was pushed
+ */
+BOOST_AUTO_TEST_CASE(threads_pass_values_in_order)
+{
+	const size_t count = 200000;
+	SpscRing<size_t> ring(16);
+	boost::thread producer(boost::bind(&produce, &ring, count));
+	size_t expected = 0;
+	size_t value = 0;
+
+	while (expected != count) {
+		if (not ring.pop(value)) {
+			boost::this_thread::yield();
+			continue;
+		}
+
+		BOOST_REQUIRE_EQUAL(value, expected);
+		++expected;
+	}
+
+	producer.join();
+
+	BOOST_CHECK(ring.empty());
+}
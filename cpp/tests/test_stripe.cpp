@@ -0,0 +1,170 @@
+/*
+ * Unit tests of striped distribution: the stripe header and
+ * the sequencing of stripes across the ports of a connection
+ */
+#define BOOST_TEST_MODULE stripe
+#include <boost/test/included/unit_test.hpp>
+
+#include <map>
+#include <set>
+
+#include "InternalConnection.h"
+
+using boost::asio::ip::tcp;
+
+// The ports the tests listen on
+#define TEST_FIRST_PORT 47321
+
+struct StripeHeader {
+	uint32_t sequence;
+	uint32_t packetSize;
+	uint32_t offset;
+	uint32_t length;
+};
+
+static StripeHeader parseHeader(const char *stripe)
+{
+	uint32_t fields[4];
+	StripeHeader header;
+
+	memcpy(fields, stripe + 4, sizeof(fields));
+
+	header.sequence = ntohl(fields[0]);
+	header.packetSize = ntohl(fields[1]);
+	header.offset = ntohl(fields[2]);
+	header.length = ntohl(fields[3]);
+
+	return header;
+}
+
+BOOST_AUTO_TEST_CASE(parse_distribution_mode)
+{
+	DistributionMode mode = DISTRIBUTION_LEAST_LOADED;
+
+	BOOST_CHECK(parseDistributionMode("", mode) && mode == DISTRIBUTION_COPY);
+	BOOST_CHECK(parseDistributionMode("copy", mode) && mode == DISTRIBUTION_COPY);
+	BOOST_CHECK(parseDistributionMode("round_robin", mode) && mode == DISTRIBUTION_ROUND_ROBIN);
+	BOOST_CHECK(parseDistributionMode("least_loaded", mode) && mode == DISTRIBUTION_LEAST_LOADED);
+	BOOST_CHECK(not parseDistributionMode("random", mode));
+}
+
+BOOST_AUTO_TEST_CASE(header_describes_the_piece)
+{
+	const char packet[] = "0123456789";
+	SharedBuffer stripe = makeStripe(0x01020304, packet, 10, 4, 3);
+
+	BOOST_REQUIRE_EQUAL(stripe->size(), size_t(STRIPE_HEADER_SIZE + 3));
+	BOOST_CHECK(memcmp(&(*stripe)[0], "CSKS", 4) == 0);
+
+	// Every field is big endian
+	BOOST_CHECK_EQUAL((*stripe)[4], 1);
+	BOOST_CHECK_EQUAL((*stripe)[7], 4);
+
+	StripeHeader header = parseHeader(&(*stripe)[0]);
+
+	BOOST_CHECK_EQUAL(header.sequence, 0x01020304u);
+	BOOST_CHECK_EQUAL(header.packetSize, 10u);
+	BOOST_CHECK_EQUAL(header.offset, 4u);
+	BOOST_CHECK_EQUAL(header.length, 3u);
+	BOOST_CHECK(memcmp(&(*stripe)[STRIPE_HEADER_SIZE], "456", 3) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(empty_stripe_is_only_a_header)
+{
+	SharedBuffer stripe = makeStripe(7, NULL, 0, 0, 0);
+
+	BOOST_CHECK_EQUAL(stripe->size(), size_t(STRIPE_HEADER_SIZE));
+	BOOST_CHECK_EQUAL(parseHeader(&(*stripe)[0]).length, 0u);
+}
+
+/*
+ * Packets split across two ports in turn can be put back
+ * together from the headers alone.  Each packet has its own
+ * sequence number, shared by all of its stripes
+ */
+BOOST_AUTO_TEST_CASE(stripes_reassemble_in_order)
+{
+	ConnectionConfig config;
+	InternalConnection connection;
+
+	config.ports.clear();
+	config.ports.push_back(TEST_FIRST_PORT);
+	config.ports.push_back(TEST_FIRST_PORT + 1);
+	config.byte_swap.assign(2, 0);
+	config.distribution = "round_robin";
+	config.stripe_size = 100;
+
+	connection.setConnection(config);
+
+	boost::asio::io_service io_service;
+	tcp::socket first(io_service);
+	tcp::socket second(io_service);
+
+	first.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), TEST_FIRST_PORT));
+	second.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), TEST_FIRST_PORT + 1));
+
+	// Give the server time to accept both sessions
+	boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+
+	// Three packets of 250 bytes make three stripes each, the last
+	// one short
+	const size_t packets = 3;
+	std::vector<char> data(250);
+
+	for (size_t i = 0; i != packets; ++i) {
+		for (size_t j = 0; j != data.size(); ++j) {
+			data[j] = i * 7 + j;
+		}
+
+		std::vector<ConnectionStatus> statuses = connection.write(data);
+
+		BOOST_REQUIRE_EQUAL(statuses.size(), 2u);
+		BOOST_CHECK_EQUAL(statuses[0].status, "connected");
+		BOOST_CHECK_EQUAL(statuses[1].status, "connected");
+	}
+
+	// Nine stripes alternate between the ports, starting with the
+	// first, so it gets five and the second four
+	std::map<uint32_t, std::vector<char> > reassembled;
+	std::map<uint32_t, size_t> received;
+	tcp::socket *sockets[] = { &first, &second };
+	size_t counts[] = { 5, 4 };
+	std::set<uint32_t> sequences;
+
+	for (size_t i = 0; i != 2; ++i) {
+		for (size_t j = 0; j != counts[i]; ++j) {
+			char raw[STRIPE_HEADER_SIZE];
+
+			boost::asio::read(*sockets[i], boost::asio::buffer(raw, sizeof(raw)));
+
+			BOOST_REQUIRE(memcmp(raw, "CSKS", 4) == 0);
+
+			StripeHeader header = parseHeader(raw);
+
+			BOOST_REQUIRE_EQUAL(header.packetSize, data.size());
+			BOOST_REQUIRE_LE(header.offset + header.length, header.packetSize);
+			BOOST_CHECK_EQUAL(header.length, std::min(size_t(100), data.size() - header.offset));
+
+			std::vector<char> &packet = reassembled[header.sequence];
+
+			packet.resize(header.packetSize);
+			boost::asio::read(*sockets[i], boost::asio::buffer(&packet[header.offset], header.length));
+			received[header.sequence] += header.length;
+			sequences.insert(header.sequence);
+		}
+	}
+
+	// The sequence numbers are consecutive, one per packet
+	BOOST_REQUIRE_EQUAL(sequences.size(), packets);
+	BOOST_CHECK_EQUAL(*sequences.rbegin() - *sequences.begin(), packets - 1);
+
+	size_t index = 0;
+
+	for (std::map<uint32_t, std::vector<char> >::const_iterator i = reassembled.begin(); i != reassembled.end(); ++i, ++index) {
+		BOOST_CHECK_EQUAL(received[i->first], data.size());
+
+		for (size_t j = 0; j != data.size(); ++j) {
+			BOOST_REQUIRE_EQUAL(i->second[j], char(index * 7 + j));
+		}
+	}
+}
@@ -0,0 +1,104 @@
+/*
+ * Unit tests of the token bucket that paces each connection
+ */
+#define BOOST_TEST_MODULE tokenbucket
+#include <boost/test/included/unit_test.hpp>
+#include <boost/thread.hpp>
+
+#include "tokenbucket.h"
+
+BOOST_AUTO_TEST_CASE(no_rate_is_unlimited)
+{
+	TokenBucket bucket;
+
+	BOOST_CHECK(not bucket.limited());
+	BOOST_CHECK_EQUAL(bucket.acquire(1 << 30), 0.0);
+
+	bucket.configure(-5, 100);
+
+	BOOST_CHECK(not bucket.limited());
+	BOOST_CHECK_EQUAL(bucket.acquire(1 << 30), 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(burst_is_available_at_once)
+{
+	TokenBucket bucket;
+
+	bucket.configure(1000, 4096);
+
+	BOOST_CHECK(bucket.limited());
+	BOOST_CHECK_EQUAL(bucket.burst(), 4096u);
+	BOOST_CHECK_EQUAL(bucket.acquire(4000), 0.0);
+
+	// The 96 bytes left, and maybe a few more that trickled in,
+	// aren't enough for another 1000
+	double wait = bucket.acquire(1000);
+
+	BOOST_CHECK_GT(wait, 0.85);
+	BOOST_CHECK_LE(wait, 0.904);
+}
+
+BOOST_AUTO_TEST_CASE(failed_acquire_takes_nothing)
+{
+	TokenBucket bucket;
+
+	bucket.configure(1, 100);
+
+	BOOST_CHECK_GT(bucket.acquire(200), 0.0);
+	BOOST_CHECK_EQUAL(bucket.acquire(100), 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(tokens_refill_at_the_rate)
+{
+	TokenBucket bucket;
+
+	bucket.configure(100000, 10000);
+
+	BOOST_CHECK_EQUAL(bucket.acquire(10000), 0.0);
+	BOOST_CHECK_GT(bucket.acquire(5000), 0.0);
+
+	boost::this_thread::sleep(boost::posix_time::milliseconds(60));
+
+	BOOST_CHECK_EQUAL(bucket.acquire(5000), 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(refill_stops_at_the_burst)
+{
+	TokenBucket bucket;
+
+	bucket.configure(1000000, 1000);
+
+	boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+
+	BOOST_CHECK_EQUAL(bucket.acquire(1000), 0.0);
+	BOOST_CHECK_GT(bucket.acquire(500), 0.0);
+}
+
+/*
+ * Reapplying the same settings, as every reconfiguration does,
+ * keeps the bucket's state; new settings start with a full one
+ */
+BOOST_AUTO_TEST_CASE(configure_keeps_tokens_unless_changed)
+{
+	TokenBucket bucket;
+
+	bucket.configure(1, 100);
+	bucket.acquire(100);
+	bucket.configure(1, 100);
+
+	BOOST_CHECK_GT(bucket.acquire(50), 0.0);
+
+	bucket.configure(2, 100);
+
+	BOOST_CHECK_EQUAL(bucket.acquire(100), 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(burst_is_at_least_one_byte)
+{
+	TokenBucket bucket;
+
+	bucket.configure(1, 0);
+
+	BOOST_CHECK_EQUAL(bucket.burst(), 1u);
+	BOOST_CHECK_EQUAL(bucket.acquire(1), 0.0);
+}
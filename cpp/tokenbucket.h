@@ -0,0 +1,82 @@
+#ifndef TOKENBUCKET_H_
+#define TOKENBUCKET_H_
+
+#include <algorithm>
+#include <time.h>
+
+/*
+ * Limits a byte stream to an average rate while allowing
+ * bursts of up to burst bytes.  A rate of zero disables
+ * the limit
+ */
+class TokenBucket
+{
+public:
+	TokenBucket() :
+		burst_(0),
+		rate_(0),
+		tokens_(0)
+	{
+		last_ = now();
+	}
+
+	void configure(double rate, size_t burst)
+	{
+		burst = std::max(burst, size_t(1));
+		rate = std::max(rate, 0.0);
+
+		// Keep the accumulated tokens if nothing changed
+		if (burst == burst_ && rate == rate_)
+			return;
+
+		burst_ = burst;
+		rate_ = rate;
+		tokens_ = burst_;
+		last_ = now();
+	}
+
+	bool limited() const
+	{
+		return rate_ > 0;
+	}
+
+	size_t burst() const
+	{
+		return burst_;
+	}
+
+	// Take bytes tokens if they are available, otherwise return
+	// the number of seconds until they will be
+	double acquire(size_t bytes)
+	{
+		if (not limited())
+			return 0;
+
+		double current = now();
+		tokens_ = std::min(double(burst_), tokens_ + (current - last_) * rate_);
+		last_ = current;
+
+		if (tokens_ >= bytes)
+		{
+			tokens_ -= bytes;
+			return 0;
+		}
+
+		return (bytes - tokens_) / rate_;
+	}
+
+	static double now()
+	{
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec + ts.tv_nsec / 1e9;
+	}
+
+private:
+	size_t burst_;
+	double last_;
+	double rate_;
+	double tokens_;
+};
+
+#endif /* TOKENBUCKET_H_ */
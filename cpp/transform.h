@@ -0,0 +1,100 @@
+#ifndef TRANSFORM_H_
+#define TRANSFORM_H_
+
+#include <assert.h>
+#include <vector>
+
+#include "outputformat.h"
+#include "vectorswap.h"
+
+/*
+ * The number of bytes in each word that is byte swapped
+ * for an output format, where 1 means the size of the
+ * converted samples.  Widths of 0 and 1 mean no swap
+ */
+inline unsigned int swapWidth(const OutputFormat &output, size_t nativeSize)
+{
+	return (output.byteSwap == 1) ? sampleFormatSize(output.format, nativeSize) : output.byteSwap;
+}
+
+/*
+ * Convert and byte swap a packet into out.  Swapped data
+ * is always sent in whole words, so bytes that don't fill
+ * a word are kept in leftover and put in front of the
+ * next packet.  Returns false when that happens, which
+ * means words are being swapped across adjacent packets
+ */
+template<typename T, typename U, typename V>
+bool transformSamples(const std::vector<T, U> &original, const OutputFormat &output, V &leftover, V &out)
+{
+	unsigned int numSwap = swapWidth(output, sizeof(T));
+	size_t dataSize = sampleFormatSize(output.format, sizeof(T));
+	size_t numBytes = original.size() * dataSize;
+	size_t oldLeftoverSize = leftover.size();
+	size_t totalSize = numBytes + oldLeftoverSize;
+	size_t newLeftoverSize;
+
+	// Create the vector to hold the swapped data
+	V newData;
+
+	// Make sure to send an exact multiple of numSwap if it's greater than 1
+	if (numSwap > 1) {
+		newLeftoverSize = totalSize % numSwap;
+	} else {
+		newLeftoverSize = 0;
+	}
+
+	//Don't have to deal with leftover data.  This should be the typical case
+	if (newLeftoverSize == 0 && oldLeftoverSize == 0) {
+		if (output.format != FORMAT_NATIVE) {
+			// Convert and swap in a single pass when the swap size
+			// matches the converted sample size
+			newData.resize(numBytes);
+			convertSamples(original.data(), original.size(), newData.data(), output.format, output.scale, numSwap > 1 && numSwap == dataSize);
+
+			if (numSwap > 1 && numSwap != dataSize) {
+				vectorSwap(newData, numSwap);
+			}
+		} else if (numSwap > 1) {
+			newData.resize(numBytes);
+			vectorSwap(reinterpret_cast<const char *>(original.data()), newData, numSwap);
+		} else {
+			newData.assign(reinterpret_cast<const char *>(original.data()), reinterpret_cast<const char *>(original.data()) + numBytes);
+		}
+
+		out.swap(newData);
+
+		return true;
+	}
+
+	const char *source = reinterpret_cast<const char *>(original.data());
+	V converted;
+
+	// The leftover bytes are in the output format, so convert
+	// before splicing in the new data
+	if (output.format != FORMAT_NATIVE) {
+		converted.resize(numBytes);
+		convertSamples(original.data(), original.size(), converted.data(), output.format, output.scale, false);
+		source = converted.data();
+	}
+
+	newData.reserve(totalSize - newLeftoverSize);
+	newData.insert(newData.begin(), leftover.begin(), leftover.end());
+	newData.insert(newData.begin() + oldLeftoverSize, source, source + numBytes - newLeftoverSize);
+
+	if (numSwap > 1) {
+		vectorSwap(newData, numSwap);
+	}
+
+	out.swap(newData);
+	leftover.clear();
+
+	// If we have new leftovers, populate it now
+	if (newLeftoverSize != 0) {
+		leftover.insert(leftover.begin(), source + numBytes - newLeftoverSize, source + numBytes);
+	}
+
+	return false;
+}
+
+#endif /* TRANSFORM_H_ */
@@ -553,8 +553,35 @@ class ComponentTests(ossie.utils.testing.ScaComponentTestCase):
         f= flip(so,SWAP)
         self.assertEqual(s[:len(f)],f)
     
-    def runTest(self, clientFirst=True, client = 'CustomSink',dataPackets=[],maxBytes=None,minBytes=None, portType='octet',byteSwapSrc=None, byteSwapSink=None):
-        self.startTest(client, portType)
+    #Tests for converting the sample format before sending
+    def testFormatInt16(self):
+        self.runTest(client = 'CustomSource', dataPackets=[[float(x) for x in range(i*4096,(i+1)*4096)] for i in xrange(-4,4)], portType='float', outputType='short', outputFormat='int16')
+
+    def testFormatInt16Saturate(self):
+        self.runTest(client = 'CustomSink', dataPackets=self.FLOAT_DATA, portType='float', outputType='short', outputFormat='int16', expected=lambda x: min(x, 32767))
+
+    def testFormatInt16Scale(self):
+        self.runTest(client = 'CustomSource', dataPackets=[[float(4*x) for x in range(i*4096,(i+1)*4096)] for i in xrange(-8,8)], portType='double', outputType='short', outputFormat='int16', scaleFactor=0.25, expected=lambda x: x/4)
+
+    def testFormatInt8(self):
+        self.runTest(client = 'CustomSink', dataPackets=[[float(x) for x in range(-128,128)]*100], portType='float', outputType='char', outputFormat='int8')
+
+    def testFormatDoubleToFloat(self):
+        self.runTest(client = 'CustomSource', dataPackets=self.DOUBLE_DATA, portType='double', outputType='float', outputFormat='float')
+
+    def testFormatInt16ByteSwap(self):
+        TYPE= 'short'
+        self.runTest(client = 'CustomSource', dataPackets=[[float(x) for x in range(0,100)*10]], byteSwapSrc=None, byteSwapSink=1, minBytes=1, portType='float', outputType=TYPE, outputFormat='int16')
+        s = toStr([int(x) for x in self.input],TYPE)
+        so = toStr(self.output,TYPE)
+        f = flip(so,2)
+        self.assertEqual(s[:len(f)],f)
+
+    def runTest(self, clientFirst=True, client = 'CustomSink',dataPackets=[],maxBytes=None,minBytes=None, portType='octet',byteSwapSrc=None, byteSwapSink=None, outputType=None, outputFormat=None, scaleFactor=1.0, expected=None):
+        self.startTest(client, portType, outputType)
+
+        if outputFormat != None:
+            self.outputSettings = {'output_format' : outputFormat, 'scale_factor' : scaleFactor}
         
         if maxBytes!=None:
             self.sourceSocket.setMax_bytes(maxBytes)
@@ -624,6 +651,9 @@ class ComponentTests(ossie.utils.testing.ScaComponentTestCase):
         self.assertTrue(len(self.input)-len(self.output)< self.sourceSocket.max_bytes)
         self.assertTrue(len(self.input)>=len(self.output))
 
+        if expected != None:
+            self.input = [expected(x) for x in self.input]
+
         if byteSwapSrc == byteSwapSink:
             self.assertEquals(self.input[:len(self.output)],self.output)
 
@@ -729,10 +759,10 @@ class ComponentTests(ossie.utils.testing.ScaComponentTestCase):
     def configureClient(self, byteSwapSrc, byteSwapSink):
         if self.client == self.sinkSocket:
             if byteSwapSink != None:
-                self.client.Connections = [{'connection_type' : 'client', 'ip_address' : '127.0.0.1', 'ports' : [self.PORT], 'byte_swap' : [byteSwapSink]}]
+                self.client.Connections = [dict({'connection_type' : 'client', 'ip_address' : '127.0.0.1', 'ports' : [self.PORT], 'byte_swap' : [byteSwapSink]}, **self.outputSettings)]
                 self.assertTrue(self.client.Connections[0].byte_swap[0] == byteSwapSink)
             else:
-                self.client.Connections = [{'connection_type' : 'client', 'ip_address' : '127.0.0.1', 'ports' : [self.PORT], 'byte_swap' : [0]}]
+                self.client.Connections = [dict({'connection_type' : 'client', 'ip_address' : '127.0.0.1', 'ports' : [self.PORT], 'byte_swap' : [0]}, **self.outputSettings)]
 
             self.assertTrue(self.client.Connections[0].connection_type == 'client')
             self.assertTrue(self.client.Connections[0].ports[0] == self.PORT)
@@ -781,10 +811,10 @@ class ComponentTests(ossie.utils.testing.ScaComponentTestCase):
     def configureServer(self, byteSwapSrc, byteSwapSink):
         if self.server == self.sinkSocket:
             if byteSwapSink != None:
-                self.server.Connections = [{'connection_type' : 'server', 'ports' : [self.PORT], 'byte_swap' : [byteSwapSink]}]
+                self.server.Connections = [dict({'connection_type' : 'server', 'ports' : [self.PORT], 'byte_swap' : [byteSwapSink]}, **self.outputSettings)]
                 self.assertTrue(self.server.Connections[0].byte_swap[0] == byteSwapSink)
             else:
-                self.server.Connections = [{'connection_type' : 'server', 'ports' : [self.PORT], 'byte_swap' : [0]}]
+                self.server.Connections = [dict({'connection_type' : 'server', 'ports' : [self.PORT], 'byte_swap' : [0]}, **self.outputSettings)]
 
             self.assertTrue(self.server.Connections[0].connection_type == 'server')
             self.assertTrue(self.server.Connections[0].ports[0] == self.PORT)
@@ -855,8 +885,9 @@ class ComponentTests(ossie.utils.testing.ScaComponentTestCase):
         self.servers = None
         self.sink2 = None
         self.sourceSocket2 = None
+        self.outputSettings = {}
 
-    def startTest(self, client='CustomSink', portType='octet'):
+    def startTest(self, client='CustomSink', portType='octet', outputType=None):
         if client == 'CustomSink':
             self.client = self.sinkSocket
             self.server = self.sourceSocket
@@ -864,9 +895,12 @@ class ComponentTests(ossie.utils.testing.ScaComponentTestCase):
             self.server = self.sinkSocket
             self.client = self.sourceSocket
         
+        if outputType == None:
+            outputType = portType
+
         sinkSocketName = 'data%s_in'%portType.capitalize()
         self.src.connect(self.sinkSocket, sinkSocketName)
-        self.sourceSocket.connect(self.sink, None, '%sOut'%portType)
+        self.sourceSocket.connect(self.sink, None, '%sOut'%outputType)
 
     def startTests(self, client='CustomSink', portType='octet'):
         self.sink2 = sb.DataSink()